@@ -0,0 +1,266 @@
+/*++
+
+Module Name:
+
+command.cpp
+
+Abstract:
+
+Asynchronous command channel. Commands are queued under the interrupt
+lock and written one at a time; the response is picked out of the frame
+stream by the frame decoder, so touch reporting is never paused.
+Callbacks run with the interrupt lock held and may queue further
+commands with ElanQueueCommandLocked.
+
+Diagnostic register reads from the vendor collection go through the
+channel with ElanSubmitCommand.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "elan.h"
+
+static const ULONG ElanDebugLevel = 100;
+static const ULONG ElanDebugCatagories = DBG_INIT | DBG_PNP | DBG_IOCTL;
+
+uint8_t elants_i2c_expected_response(uint8_t cmd) {
+	switch (cmd) {
+	case CMD_HEADER_READ:
+		return CMD_HEADER_RESP;
+
+	case CMD_HEADER_6B_READ:
+		return CMD_HEADER_6B_RESP;
+
+	case CMD_HEADER_ROM_READ:
+		return CMD_HEADER_ROM_RESP;
+
+	default:
+		return 0;
+	}
+}
+
+NTSTATUS ElanQueueCommandLocked(PELAN_CONTEXT pDevice, uint8_t* cmd, size_t cmd_size,
+	const uint8_t* expect, size_t expect_size, ULONG timeoutMs,
+	PELAN_COMMAND_CALLBACK Callback, PVOID Context) {
+	if (cmd_size > ELAN_CMD_MAX_SIZE || expect_size > HEADER_SIZE) {
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	if (pDevice->CmdCount >= ELAN_CMD_QUEUE_DEPTH) {
+		return STATUS_DEVICE_BUSY;
+	}
+
+	PELAN_COMMAND entry = &pDevice->CmdQueue[(pDevice->CmdHead + pDevice->CmdCount) % ELAN_CMD_QUEUE_DEPTH];
+	RtlCopyMemory(entry->Cmd, cmd, cmd_size);
+	entry->CmdSize = (uint8_t)cmd_size;
+	if (expect_size > 0) {
+		RtlCopyMemory(entry->Expect, expect, expect_size);
+	}
+	entry->ExpectSize = (uint8_t)expect_size;
+	entry->TimeoutMs = timeoutMs;
+	entry->Callback = Callback;
+	entry->Context = Context;
+
+	pDevice->CmdCount++;
+	return STATUS_SUCCESS;
+}
+
+static void ElanPopCommand(PELAN_CONTEXT pDevice, NTSTATUS status, uint8_t* resp) {
+	ELAN_COMMAND entry = pDevice->CmdQueue[pDevice->CmdHead];
+
+	pDevice->CmdHead = (pDevice->CmdHead + 1) % ELAN_CMD_QUEUE_DEPTH;
+	pDevice->CmdCount--;
+	pDevice->CmdInFlight = false;
+
+	if (entry.Callback != NULL) {
+		entry.Callback(pDevice, status, resp, entry.Context);
+	}
+}
+
+void ElanIssueCommands(PELAN_CONTEXT pDevice) {
+	while (!pDevice->CmdInFlight && pDevice->CmdCount > 0) {
+		PELAN_COMMAND entry = &pDevice->CmdQueue[pDevice->CmdHead];
+
+		if (!pDevice->TouchScreenBooted) {
+			ElanPopCommand(pDevice, STATUS_DEVICE_NOT_READY, NULL);
+			continue;
+		}
+
+		NTSTATUS status = elants_i2c_send(pDevice, entry->Cmd, entry->CmdSize);
+		if (!NT_SUCCESS(status) || entry->ExpectSize == 0) {
+			ElanPopCommand(pDevice, status, NULL);
+			continue;
+		}
+
+		pDevice->CmdInFlight = true;
+		pDevice->CmdDeadline = KeQueryInterruptTime() + (ULONGLONG)entry->TimeoutMs * 10000;
+		WdfTimerStart(pDevice->CmdTimer, WDF_REL_TIMEOUT_IN_MS(entry->TimeoutMs));
+	}
+}
+
+BOOLEAN ElanCommandResponse(PELAN_CONTEXT pDevice, uint8_t* buf) {
+	if (!pDevice->CmdInFlight)
+		return false;
+
+	PELAN_COMMAND entry = &pDevice->CmdQueue[pDevice->CmdHead];
+	if (memcmp(buf, entry->Expect, entry->ExpectSize))
+		return false;
+
+	WdfTimerStop(pDevice->CmdTimer, FALSE);
+	ElanPopCommand(pDevice, STATUS_SUCCESS, buf);
+	ElanIssueCommands(pDevice);
+	return true;
+}
+
+VOID
+ElanCancelCommands(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	while (pDevice->CmdCount > 0) {
+		ElanPopCommand(pDevice, STATUS_CANCELLED, NULL);
+	}
+}
+
+NTSTATUS
+ElanSubmitCommand(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* cmd,
+	IN size_t cmd_size,
+	IN PELAN_COMMAND_CALLBACK Callback,
+	IN PVOID Context
+)
+{
+	uint8_t expected_response = elants_i2c_expected_response(cmd[0]);
+	NTSTATUS status;
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	if (!pDevice->TouchScreenBooted) {
+		status = STATUS_DEVICE_NOT_READY;
+	}
+	else {
+		status = ElanQueueCommandLocked(pDevice, cmd, cmd_size,
+			&expected_response, expected_response ? 1 : 0, ELAN_CMD_TIMEOUT_MS,
+			Callback, Context);
+		if (NT_SUCCESS(status)) {
+			ElanIssueCommands(pDevice);
+		}
+	}
+
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	return status;
+}
+
+VOID
+ElanCommandTimeout(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	//
+	// The response may have completed the command while the timer
+	// callback waited for the lock, leaving a newer command in flight.
+	//
+	if (pDevice->CmdInFlight) {
+		ULONGLONG now = KeQueryInterruptTime();
+		if (now >= pDevice->CmdDeadline) {
+			ElanPopCommand(pDevice, STATUS_IO_TIMEOUT, NULL);
+			ElanIssueCommands(pDevice);
+		}
+		else {
+			WdfTimerStart(pDevice->CmdTimer, -(LONGLONG)(pDevice->CmdDeadline - now));
+		}
+	}
+
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+}
+
+//
+// Diagnostic register reads
+//
+
+static VOID ElanDiagCommandDone(PELAN_CONTEXT pDevice, NTSTATUS status, uint8_t* resp, PVOID Context) {
+	UNREFERENCED_PARAMETER(Context);
+
+	if (resp != NULL) {
+		RtlCopyMemory(pDevice->DiagResponse, resp, sizeof(pDevice->DiagResponse));
+	}
+
+	pDevice->DiagStatus = status;
+	pDevice->DiagState = NT_SUCCESS(status) ? DIAG_STATE_DONE : DIAG_STATE_FAILED;
+
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL, "Diagnostic read %02x %02x finished 0x%x\n",
+		pDevice->DiagCommand[0], pDevice->DiagCommand[1], status);
+}
+
+NTSTATUS
+ElanStartDiagRead(
+	IN PELAN_CONTEXT pDevice,
+	IN const uint8_t* cmd
+)
+{
+	uint8_t command[DIAG_COMMAND_SIZE];
+	NTSTATUS status = STATUS_SUCCESS;
+
+	//
+	// Only register reads are passed through, a vendor collection client
+	// cannot write the flash key or start calibration this way
+	//
+	if (cmd[0] != CMD_HEADER_READ) {
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	RtlCopyMemory(command, cmd, sizeof(command));
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	if (pDevice->DiagState == DIAG_STATE_RUNNING) {
+		status = STATUS_DEVICE_BUSY;
+	}
+	else {
+		pDevice->DiagState = DIAG_STATE_RUNNING;
+		pDevice->DiagStatus = STATUS_PENDING;
+		RtlCopyMemory(pDevice->DiagCommand, command, sizeof(command));
+		RtlZeroMemory(pDevice->DiagResponse, sizeof(pDevice->DiagResponse));
+	}
+
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	status = ElanSubmitCommand(pDevice, command, sizeof(command), ElanDiagCommandDone, NULL);
+	if (!NT_SUCCESS(status)) {
+		WdfInterruptAcquireLock(pDevice->Interrupt);
+		pDevice->DiagStatus = status;
+		pDevice->DiagState = DIAG_STATE_FAILED;
+		WdfInterruptReleaseLock(pDevice->Interrupt);
+	}
+
+	return status;
+}
+
+VOID
+ElanFillDiagReport(
+	IN PELAN_CONTEXT pDevice,
+	OUT ElanDiagReport* pReport
+)
+{
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	pReport->State = pDevice->DiagState;
+	pReport->Status = pDevice->DiagStatus;
+	RtlCopyMemory(pReport->Command, pDevice->DiagCommand, sizeof(pReport->Command));
+	RtlCopyMemory(pReport->Response, pDevice->DiagResponse, sizeof(pReport->Response));
+
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	RtlZeroMemory(pReport->Reserved, sizeof(pReport->Reserved));
+}
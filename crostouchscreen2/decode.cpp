@@ -0,0 +1,421 @@
+/*++
+
+Module Name:
+
+decode.cpp
+
+Abstract:
+
+Frame decoder. Turns controller frames into contact state and touch
+reports. It only touches the device context, the filters and the few
+driver entry points declared in elan.h, so it can also be built into a
+host tool against a context shim.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "elan.h"
+
+static const ULONG ElanDebugLevel = 100;
+static const ULONG ElanDebugCatagories = DBG_INIT | DBG_PNP | DBG_IOCTL;
+
+C_ASSERT(MAX_CONTACT_NUM <= MULTI_MAX_COUNT);
+
+static void ElanAddContact(PELAN_CONTEXT pDevice, int slot) {
+	uint8_t id = 0;
+
+	//
+	// At most MAX_CONTACT_NUM slots are live, so a free ID below that
+	// always exists
+	//
+	while (pDevice->ContactIdsInUse & (1 << id))
+		id++;
+
+	pDevice->ContactIdsInUse |= 1 << id;
+	pDevice->ContactIds[slot] = id;
+	pDevice->LiveSlots[pDevice->LiveCount++] = (uint8_t)slot;
+}
+
+static void ElanRemoveContact(PELAN_CONTEXT pDevice, int index) {
+	uint8_t slot = pDevice->LiveSlots[index];
+
+	pDevice->ContactIdsInUse &= ~(1 << pDevice->ContactIds[slot]);
+	pDevice->Flags[slot] = 0;
+	pDevice->LiveSlots[index] = pDevice->LiveSlots[--pDevice->LiveCount];
+}
+
+VOID
+ElanClearContacts(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	for (int i = 0; i < MAX_CONTACT_NUM; i++) {
+		pDevice->Flags[i] = 0;
+	}
+
+	pDevice->LiveCount = 0;
+	pDevice->ContactIdsInUse = 0;
+}
+
+static BOOLEAN ElanDuplicateReport(PELAN_CONTEXT pDevice, struct _ELAN_MULTITOUCH_REPORT* report) {
+	struct _ELAN_MULTITOUCH_REPORT* last = &pDevice->LastReport;
+	BOOLEAN duplicate = report->ActualCount == last->ActualCount &&
+		!memcmp(report->Touch, last->Touch, report->ActualCount * sizeof(TOUCH));
+
+	if (duplicate && pDevice->DuplicateCount < pDevice->Config.DuplicateMax) {
+		pDevice->DuplicateCount++;
+		pDevice->AcqStats.DuplicatesSuppressed++;
+		return true;
+	}
+
+	pDevice->DuplicateCount = 0;
+	return false;
+}
+
+static NTSTATUS ElanSubmitTouchReport(PELAN_CONTEXT pDevice, struct _ELAN_MULTITOUCH_REPORT* report) {
+	size_t bytesWritten;
+
+	if (pDevice->Config.Flags & ELAN_CONFIG_PRESSURE)
+		return ElanProcessVendorReport(pDevice, report, sizeof(*report), &bytesWritten);
+
+	//
+	// Without the pressure option contacts are sent without their
+	// trailing Pressure field
+	//
+	BYTE packed[sizeof(*report)];
+	ULONG length = 0;
+
+	packed[length++] = report->ReportID;
+	for (int i = 0; i < MULTI_MAX_COUNT; i++) {
+		RtlCopyMemory(&packed[length], &report->Touch[i], FIELD_OFFSET(TOUCH, Pressure));
+		length += FIELD_OFFSET(TOUCH, Pressure);
+	}
+	packed[length++] = report->ActualCount;
+
+	return ElanProcessVendorReport(pDevice, packed, length, &bytesWritten);
+}
+
+//
+// Builds and sends one report from the live contacts. The report is a
+// pure function of the contact state, the tuning profile and the predictor
+// and transform state, and must stay bit-identical across rewrites:
+//
+//  - contacts appear in live list order with their stable contact IDs
+//  - MXT_T9_DETECT and MXT_T9_PRESS report tip switch and confidence,
+//    MXT_T9_RELEASE reports confidence only
+//  - a released contact is reported until a report carrying the release
+//    has been delivered and is removed from the live list after that
+//  - unused contact slots are zero
+//
+VOID ElanProcessInput(PELAN_CONTEXT pDevice) {
+	struct _ELAN_MULTITOUCH_REPORT report;
+	RtlZeroMemory(&report, sizeof(report));
+	report.ReportID = REPORTID_MTOUCH;
+
+	int count;
+	for (count = 0; count < pDevice->LiveCount; count++) {
+		int i = pDevice->LiveSlots[count];
+
+		report.Touch[count].ContactID = pDevice->ContactIds[i];
+		report.Touch[count].Height = pDevice->AREA[i];
+		report.Touch[count].Width = pDevice->AREA[i];
+		report.Touch[count].Pressure = pDevice->Pressure[i];
+
+		uint16_t x = pDevice->XValue[i];
+		uint16_t y = pDevice->YValue[i];
+
+		uint8_t flags = pDevice->Flags[i];
+		if ((flags & MXT_T9_DETECT) && (pDevice->Config.Flags & ELAN_CONFIG_PREDICT)) {
+			ElanPredictorPredict(&pDevice->Predictors[i], &pDevice->Config.Predict,
+				pDevice->max_x, pDevice->max_y, &x, &y);
+		}
+
+		ElanTransformApply(&pDevice->Transform, &x, &y);
+
+		report.Touch[count].XValue = x;
+		report.Touch[count].YValue = y;
+
+		if (flags & MXT_T9_DETECT) {
+			report.Touch[count].Status = MULTI_CONFIDENCE_BIT | MULTI_TIPSWITCH_BIT;
+		}
+		else if (flags & MXT_T9_PRESS) {
+			report.Touch[count].Status = MULTI_CONFIDENCE_BIT | MULTI_TIPSWITCH_BIT;
+		}
+		else if (flags & MXT_T9_RELEASE) {
+			report.Touch[count].Status = MULTI_CONFIDENCE_BIT;
+		}
+		else
+			report.Touch[count].Status = 0;
+	}
+
+	report.ActualCount = count;
+
+	if (count > 0) {
+		if ((pDevice->Config.Flags & ELAN_CONFIG_COALESCE) && ElanDuplicateReport(pDevice, &report))
+			return;
+
+		ULONGLONG reportStart = ReadTimeStampCounter();
+		NTSTATUS status = ElanSubmitTouchReport(pDevice, &report);
+		pDevice->CostFrame[COST_STAGE_REPORT] += ReadTimeStampCounter() - reportStart;
+		ElanTrace(pDevice, TRACE_EVENT_REPORT, count, status, 0, 0);
+		if (!NT_SUCCESS(status))
+			return;
+
+		pDevice->LastReport = report;
+		pDevice->AcqStats.Reports++;
+	}
+
+	//
+	// Releases are retired only once the OS has seen them, a dropped
+	// report is sent again with the next frame or sweep.
+	//
+	for (int n = pDevice->LiveCount; n-- > 0;) {
+		if (pDevice->Flags[pDevice->LiveSlots[n]] == MXT_T9_RELEASE)
+			ElanRemoveContact(pDevice, n);
+	}
+}
+
+static FORCEINLINE void elants_i2c_mt_event(PELAN_CONTEXT pDevice, uint8_t *buf, const size_t packet_size, const UCHAR chip) {
+	unsigned int n_fingers;
+	uint16_t finger_state;
+
+	n_fingers = buf[FW_POS_STATE + 1] & 0x0f;
+	finger_state = ((buf[FW_POS_STATE + 1] & 0x30) << 4) |
+		buf[FW_POS_STATE];
+
+	ULONGLONG decodeStart = ReadTimeStampCounter();
+
+	//
+	// Trust no more contacts than the packet claims, as Linux does. Extra
+	// state bits from a corrupted packet are treated as lifted fingers.
+	//
+	for (int i = 0; i < MAX_CONTACT_NUM; i++) {
+		if ((finger_state & 1) && n_fingers > 0) {
+			unsigned int x, y, p, w;
+
+			uint8_t *pos;
+
+			pos = &buf[FW_POS_XY + i * 3];
+			x = (((uint16_t)pos[0] & 0xf0) << 4) | pos[1];
+			y = (((uint16_t)pos[0] & 0x0f) << 8) | pos[2];
+			if (chip == EKTF3624 && packet_size == PACKET_SIZE_OLD) {
+				//
+				// Old eKTF firmware packs widths into nibbles and has no
+				// pressure, stand in the contact size for it
+				//
+				w = buf[FW_POS_WIDTH + i / 2];
+				w >>= 4 * (~i & 1);
+				w &= 0x0f;
+				w |= w << 4;
+				p = w;
+			}
+			else {
+				p = buf[FW_POS_PRESSURE + i];
+				w = buf[FW_POS_WIDTH + i];
+			}
+
+			ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL, "i=%d x=%d y=%d p=%d w=%d\n",
+				i, x, y, p, w);
+
+			if (pDevice->Flags[i] != MXT_T9_DETECT) {
+				ElanJitterReset(&pDevice->JitterFilters[i]);
+				ElanPredictorReset(&pDevice->Predictors[i]);
+			}
+
+			uint16_t fx = (uint16_t)x, fy = (uint16_t)y;
+			if (pDevice->Config.Flags & ELAN_CONFIG_JITTER) {
+				ElanJitterFilter(&pDevice->JitterFilters[i], &pDevice->Config.Jitter, &fx, &fy);
+				x = fx;
+				y = fy;
+			}
+
+			if (pDevice->Config.Flags & ELAN_CONFIG_PREDICT) {
+				ElanPredictorUpdate(&pDevice->Predictors[i], &pDevice->Config.Predict,
+					fx, fy, pDevice->FrameTime);
+			}
+
+			if (pDevice->Flags[i] == 0) {
+				ElanAddContact(pDevice, i);
+			}
+
+			pDevice->Flags[i] = MXT_T9_DETECT;
+			pDevice->XValue[i] = x;
+			pDevice->YValue[i] = y;
+			pDevice->AREA[i] = w;
+			pDevice->Pressure[i] = p;
+			pDevice->ContactTime[i] = pDevice->FrameTime;
+
+			n_fingers--;
+		}
+		else if (pDevice->Flags[i] == MXT_T9_DETECT) {
+			pDevice->Flags[i] = MXT_T9_RELEASE;
+		}
+		finger_state >>= 1;
+	}
+
+	pDevice->CostFrame[COST_STAGE_DECODE] += ReadTimeStampCounter() - decodeStart;
+
+	ElanProcessInput(pDevice);
+
+	ElanArmSweepTimer(pDevice);
+}
+
+static uint8_t elants_i2c_calculate_checksum(uint8_t *buf)
+{
+	uint8_t checksum = 0;
+	uint8_t i;
+
+	for (i = 0; i < FW_POS_CHECKSUM; i++)
+		checksum += buf[i];
+
+	return checksum;
+}
+
+static void ElanHealthFrame(PELAN_CONTEXT pDevice, BOOLEAN good) {
+	PELAN_HEALTH_BUCKET bucket = &pDevice->HealthBuckets[pDevice->HealthBucket];
+
+	bucket->Frames++;
+	if (!good) {
+		bucket->BadFrames++;
+		pDevice->HealthStats.BadFrames++;
+	}
+}
+
+VOID ElanBadFrame(PELAN_CONTEXT pDevice, ULONG reason, uint8_t *buf) {
+	switch (reason) {
+	case TRACE_FRAME_CHECKSUM:
+		ElanCount(pDevice, BadChecksums);
+		break;
+	case TRACE_FRAME_PACKET_TYPE:
+		ElanCount(pDevice, UnknownPackets);
+		break;
+	case TRACE_FRAME_WAIT:
+		ElanCount(pDevice, BadWaitPackets);
+		break;
+	case TRACE_FRAME_COUNT:
+		ElanCount(pDevice, BadReportCounts);
+		break;
+	case TRACE_FRAME_LENGTH:
+		ElanCount(pDevice, BadReportLengths);
+		break;
+	case TRACE_FRAME_HEADER:
+		ElanCount(pDevice, UnknownHeaders);
+		break;
+	case TRACE_FRAME_NO_DATA:
+		ElanCount(pDevice, EmptyInterrupts);
+		break;
+	}
+
+	ElanTrace(pDevice, TRACE_EVENT_BAD_FRAME, reason, buf ? ElanTraceBytes(buf, HEADER_SIZE) : 0, 0, 0);
+	ElanHealthFrame(pDevice, false);
+}
+
+static FORCEINLINE void elants_i2c_event(PELAN_CONTEXT pDevice, uint8_t *buf, const size_t packet_size, const UCHAR chip) {
+	uint8_t checksum = elants_i2c_calculate_checksum(buf);
+
+	if (buf[FW_POS_CHECKSUM] != checksum) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "invalid checksum for packet 0x02x: %02x vs. %02x\n", buf[FW_POS_HEADER], checksum, buf[FW_POS_CHECKSUM]);
+		ElanBadFrame(pDevice, TRACE_FRAME_CHECKSUM, buf);
+	}
+	else if (buf[FW_POS_HEADER] != HEADER_REPORT_10_FINGER) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "unknown packet type: %02x\n", buf[FW_POS_HEADER]);
+		ElanBadFrame(pDevice, TRACE_FRAME_PACKET_TYPE, buf);
+	}
+	else {
+		ElanHealthFrame(pDevice, true);
+		ElanCount(pDevice, Packets);
+		elants_i2c_mt_event(pDevice, buf, packet_size, chip);
+	}
+}
+
+//
+// Frame decoder, specialized per chip below. chip is a constant in each
+// specialization so the compiler folds the chip checks away.
+//
+static FORCEINLINE BOOLEAN elants_i2c_frame(PELAN_CONTEXT pDevice, uint8_t *buf, const UCHAR chip) {
+	const uint8_t wait_packet[] = { QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT };
+
+	//
+	// Responses to queued commands share the frame stream with touch
+	// packets; everything else goes to the touch parser.
+	//
+	if (ElanCommandResponse(pDevice, buf))
+		return false;
+
+	switch (buf[FW_HDR_TYPE]) {
+	case QUEUE_HEADER_WAIT:
+		if (memcmp(buf, wait_packet, sizeof(wait_packet))) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "invalid wait packet: %02x %02x %02x %02x\n", buf[0], buf[1], buf[2], buf[3]);
+			ElanBadFrame(pDevice, TRACE_FRAME_WAIT, buf);
+			return false;
+		}
+		return true;
+	case QUEUE_HEADER_SINGLE:
+		//
+		// The header carries the packet length, eKTF firmware sends old
+		// format single packets too
+		//
+		if (chip == EKTF3624 && buf[FW_HDR_LENGTH] == PACKET_SIZE_OLD)
+			elants_i2c_event(pDevice, &buf[HEADER_SIZE], PACKET_SIZE_OLD, chip);
+		else
+			elants_i2c_event(pDevice, &buf[HEADER_SIZE], PACKET_SIZE, chip);
+		break;
+	case QUEUE_HEADER_NORMAL:
+	case QUEUE_HEADER_NORMAL2:
+	{
+		int report_count = buf[FW_HDR_COUNT];
+		if (report_count == 0 || report_count > ELAN_MAX_REPORT_COUNT) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "bad report count: %d\n", report_count);
+			ElanBadFrame(pDevice, TRACE_FRAME_COUNT, buf);
+			break;
+		}
+
+		//
+		// Together with the count and packet size checks this keeps every
+		// packet inside the MAX_PACKET_SIZE frame buffer
+		//
+		if (buf[FW_HDR_LENGTH] > MAX_PACKET_SIZE - HEADER_SIZE) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "frame length too large: %d\n", buf[FW_HDR_LENGTH]);
+			ElanBadFrame(pDevice, TRACE_FRAME_LENGTH, buf);
+			break;
+		}
+
+		int report_len = buf[FW_HDR_LENGTH] / report_count;
+		if (chip == EKTF3624 && report_len == PACKET_SIZE_OLD) {
+			ElanPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL, "using old report format\n");
+		}
+		else if (report_len != PACKET_SIZE) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "mismatching report length: %d\n", report_len);
+			ElanBadFrame(pDevice, TRACE_FRAME_LENGTH, buf);
+			break;
+		}
+
+		for (int i = 0; i < report_count; i++) {
+			uint8_t *newbuf = buf + HEADER_SIZE + i * report_len;
+			if (report_len == PACKET_SIZE)
+				elants_i2c_event(pDevice, newbuf, PACKET_SIZE, chip);
+			else
+				elants_i2c_event(pDevice, newbuf, PACKET_SIZE_OLD, chip);
+		}
+
+		break;
+	}
+	default:
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "unknown frame header: %02x\n", buf[FW_HDR_TYPE]);
+		ElanBadFrame(pDevice, TRACE_FRAME_HEADER, buf);
+		break;
+	}
+
+	return false;
+}
+
+BOOLEAN elants_i2c_frame_ekth3500(PELAN_CONTEXT pDevice, uint8_t *buf) {
+	return elants_i2c_frame(pDevice, buf, EKTH3500);
+}
+
+BOOLEAN elants_i2c_frame_ektf3624(PELAN_CONTEXT pDevice, uint8_t *buf) {
+	return elants_i2c_frame(pDevice, buf, EKTF3624);
+}
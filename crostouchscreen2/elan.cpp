@@ -1,8 +1,8 @@
 #define DESCRIPTOR_DEF
 #include "elan.h"
 
-static ULONG ElanDebugLevel = 100;
-static ULONG ElanDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+static const ULONG ElanDebugLevel = 100;
+static const ULONG ElanDebugCatagories = DBG_INIT | DBG_PNP | DBG_IOCTL;
 
 NTSTATUS
 DriverEntry(
@@ -41,32 +41,28 @@ DriverEntry(
 	return status;
 }
 
-static NTSTATUS elants_i2c_send(PELAN_CONTEXT pDevice, uint8_t *data, size_t size) {
-	return SpbWriteDataSynchronously(&pDevice->I2CContext, data, (ULONG)size);
+NTSTATUS elants_i2c_send(PELAN_CONTEXT pDevice, uint8_t *data, size_t size) {
+	NTSTATUS status = SpbWriteDataSynchronously(&pDevice->I2CContext, data, (ULONG)size);
+	if (!NT_SUCCESS(status))
+		ElanCount(pDevice, SpbWriteErrors);
+	ElanTrace(pDevice, TRACE_EVENT_SPB_WRITE, (ULONG)size, status, ElanTraceBytes(data, size), 0);
+	return status;
 }
 
-static NTSTATUS elants_i2c_read(PELAN_CONTEXT pDevice, uint8_t *data, size_t size) {
-	return SpbReadDataSynchronously(&pDevice->I2CContext, data, (ULONG)size);
+NTSTATUS elants_i2c_read(PELAN_CONTEXT pDevice, uint8_t *data, size_t size) {
+	NTSTATUS status = SpbReadDataSynchronously(&pDevice->I2CContext, data, (ULONG)size);
+	if (!NT_SUCCESS(status))
+		ElanCount(pDevice, SpbReadErrors);
+	ElanTrace(pDevice, TRACE_EVENT_SPB_READ, (ULONG)size, status,
+		NT_SUCCESS(status) ? ElanTraceBytes(data, size) : 0, 0);
+	return status;
 }
 
 static NTSTATUS elants_i2c_execute_command(PELAN_CONTEXT pDevice, uint8_t* cmd, size_t cmd_size,
 	uint8_t* resp, size_t resp_size, const char* cmd_name) {
-	uint8_t expected_response;
-
-	switch (cmd[0]) {
-	case CMD_HEADER_READ:
-		expected_response = CMD_HEADER_RESP;
-		break;
-
-	case CMD_HEADER_6B_READ:
-		expected_response = CMD_HEADER_6B_RESP;
-		break;
+	uint8_t expected_response = elants_i2c_expected_response(cmd[0]);
 
-	case CMD_HEADER_ROM_READ:
-		expected_response = CMD_HEADER_ROM_RESP;
-		break;
-
-	default:
+	if (expected_response == 0) {
 		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "(%s): invalid command: %s\n",
 			cmd_name);
 		return STATUS_INVALID_PARAMETER;
@@ -84,6 +80,458 @@ static NTSTATUS elants_i2c_execute_command(PELAN_CONTEXT pDevice, uint8_t* cmd,
 	return status;
 }
 
+VOID
+ElanCmdTimerFunc(
+	_In_ WDFTIMER hTimer
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
+	PELAN_CONTEXT pDevice = GetDeviceContext(Device);
+
+	ElanCommandTimeout(pDevice);
+}
+
+static BOOLEAN ElanContactsActive(PELAN_CONTEXT pDevice) {
+	return pDevice->LiveCount != 0;
+}
+
+static void ElanAccountPowerState(PELAN_CONTEXT pDevice, ULONGLONG now) {
+	ULONGLONG elapsed = now - pDevice->PowerStats.StateTimestamp;
+
+	if (pDevice->LowPowerActive)
+		pDevice->PowerStats.TimeInLowPower += elapsed;
+	else
+		pDevice->PowerStats.TimeInFullPower += elapsed;
+
+	pDevice->PowerStats.StateTimestamp = now;
+}
+
+static NTSTATUS ElanSetPowerState(PELAN_CONTEXT pDevice, BOOLEAN lowPower) {
+	uint8_t power_cmd[] = {
+		CMD_HEADER_WRITE, lowPower ? E_POWER_STATE_SLEEP : E_POWER_STATE_RESUME, 0x00, 0x01
+	};
+
+	NTSTATUS status = elants_i2c_send(pDevice, power_cmd, sizeof(power_cmd));
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Unable to set power state %d\n", lowPower);
+		return status;
+	}
+
+	ElanAccountPowerState(pDevice, KeQueryInterruptTime());
+	pDevice->LowPowerActive = lowPower;
+	return status;
+}
+
+static void ElanWakeFromIdle(PELAN_CONTEXT pDevice, ULONGLONG interruptTime) {
+	if (!NT_SUCCESS(ElanSetPowerState(pDevice, false))) {
+		return;
+	}
+
+	ULONGLONG latency = pDevice->PowerStats.StateTimestamp - interruptTime;
+	pDevice->PowerStats.WakeCount++;
+	pDevice->PowerStats.WakeLatencyTotal += latency;
+	if (latency > pDevice->PowerStats.WakeLatencyMax)
+		pDevice->PowerStats.WakeLatencyMax = latency;
+}
+
+static void ElanArmIdleTimer(PELAN_CONTEXT pDevice) {
+	if (!(pDevice->Config.Flags & ELAN_CONFIG_IDLE) || pDevice->LowPowerActive)
+		return;
+
+	if (!pDevice->TouchScreenBooted)
+		return;
+
+	if (pDevice->State != ELAN_STATE_NORMAL || pDevice->CmdCount > 0)
+		return;
+
+	if (ElanContactsActive(pDevice))
+		return;
+
+	WdfTimerStart(pDevice->IdleTimer, WDF_REL_TIMEOUT_IN_MS(pDevice->Config.IdleTimeoutMs));
+}
+
+VOID
+ElanIdleTimerFunc(
+	_In_ WDFTIMER hTimer
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
+	PELAN_CONTEXT pDevice = GetDeviceContext(Device);
+
+	//
+	// Serialize against OnInterruptIsr, which runs with the passive
+	// interrupt lock held.
+	//
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	if (pDevice->ConnectInterrupt && pDevice->TouchScreenBooted &&
+		pDevice->State == ELAN_STATE_NORMAL && pDevice->CmdCount == 0 &&
+		!pDevice->LowPowerActive && !ElanContactsActive(pDevice)) {
+		if (NT_SUCCESS(ElanSetPowerState(pDevice, true))) {
+			pDevice->PowerStats.SleepCount++;
+		}
+	}
+
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+}
+
+static void ElanHealthReset(PELAN_CONTEXT pDevice, ULONGLONG now) {
+	RtlZeroMemory(pDevice->HealthBuckets, sizeof(pDevice->HealthBuckets));
+	pDevice->HealthBucket = 0;
+	pDevice->HealthBucketStart = now;
+}
+
+static void ElanHealthAdvance(PELAN_CONTEXT pDevice, ULONGLONG now) {
+	ULONGLONG bucketTime = (ULONGLONG)ELAN_HEALTH_BUCKET_MS * 10000;
+
+	if (now - pDevice->HealthBucketStart >= bucketTime * ELAN_HEALTH_BUCKETS) {
+		ElanHealthReset(pDevice, now);
+		return;
+	}
+
+	while (now - pDevice->HealthBucketStart >= bucketTime) {
+		pDevice->HealthBucket = (pDevice->HealthBucket + 1) % ELAN_HEALTH_BUCKETS;
+		RtlZeroMemory(&pDevice->HealthBuckets[pDevice->HealthBucket], sizeof(ELAN_HEALTH_BUCKET));
+		pDevice->HealthBucketStart += bucketTime;
+	}
+}
+
+static void ElanFinishRecalibration(PELAN_CONTEXT pDevice, NTSTATUS status) {
+	pDevice->State = ELAN_STATE_NORMAL;
+	pDevice->RecalStatus = status;
+	pDevice->RecalElapsed = KeQueryInterruptTime() - pDevice->RecalStartTime;
+	pDevice->RecalState = NT_SUCCESS(status) ? RECALIBRATE_STATE_DONE : RECALIBRATE_STATE_FAILED;
+
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL, "Recalibration finished 0x%x\n", status);
+}
+
+static VOID ElanRecalCommandDone(PELAN_CONTEXT pDevice, NTSTATUS status, uint8_t* resp, PVOID Context) {
+	UNREFERENCED_PARAMETER(resp);
+	UNREFERENCED_PARAMETER(Context);
+
+	ElanFinishRecalibration(pDevice, status);
+}
+
+NTSTATUS
+ElanStartRecalibration(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	uint8_t w_flashkey[] = { 0x54, 0xC0, 0xE1, 0x5A };
+	uint8_t rek[] = { 0x54, 0x29, 0x00, 0x01 };
+
+	//
+	// CMD_HEADER_REK shares its value with QUEUE_HEADER_NORMAL2, so only a
+	// full 66 66 66 66 frame is taken as the REK response.
+	//
+	const uint8_t rek_resp[] = { CMD_HEADER_REK, 0x66, 0x66, 0x66 };
+	NTSTATUS status = STATUS_SUCCESS;
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	if (!pDevice->TouchScreenBooted) {
+		status = STATUS_DEVICE_NOT_READY;
+		goto exit;
+	}
+
+	if (pDevice->State == ELAN_WAIT_RECALIBRATION ||
+		pDevice->CmdCount + 2 > ELAN_CMD_QUEUE_DEPTH) {
+		status = STATUS_DEVICE_BUSY;
+		goto exit;
+	}
+
+	if (pDevice->LowPowerActive) {
+		ElanSetPowerState(pDevice, false);
+	}
+
+	ElanQueueCommandLocked(pDevice, w_flashkey, sizeof(w_flashkey),
+		NULL, 0, 0, NULL, NULL);
+	ElanQueueCommandLocked(pDevice, rek, sizeof(rek),
+		rek_resp, sizeof(rek_resp), ELAN_CALI_TIMEOUT_MSEC, ElanRecalCommandDone, NULL);
+
+	pDevice->State = ELAN_WAIT_RECALIBRATION;
+	pDevice->RecalState = RECALIBRATE_STATE_RUNNING;
+	pDevice->RecalStatus = STATUS_PENDING;
+	pDevice->RecalStartTime = KeQueryInterruptTime();
+
+	ElanIssueCommands(pDevice);
+
+exit:
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	return status;
+}
+
+static NTSTATUS elants_i2c_query_ts_info_ekth(PELAN_CONTEXT devContext, uint16_t *phy_x, uint16_t *phy_y) {
+	NTSTATUS status;
+	uint8_t resp[17];
+	uint16_t rows, cols, osr;
+	uint8_t get_resolution_cmd[] = {
+		CMD_HEADER_6B_READ, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	uint8_t get_osr_cmd[] = {
+		CMD_HEADER_READ, E_INFO_OSR, 0x00, 0x01
+	};
+	uint8_t get_physical_scan_cmd[] = {
+		CMD_HEADER_READ, E_INFO_PHY_SCAN, 0x00, 0x01
+	};
+	uint8_t get_physical_drive_cmd[] = {
+		CMD_HEADER_READ, E_INFO_PHY_DRIVER, 0x00, 0x01
+	};
+	status = elants_i2c_execute_command(devContext, get_resolution_cmd, sizeof(get_resolution_cmd), resp, sizeof(resp), "get resolution");
+	if (status != STATUS_SUCCESS) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get resolution!\n");
+		return status;
+	}
+	rows = resp[2] + resp[6] + resp[10];
+	cols = resp[3] + resp[7] + resp[11];
+
+	status = elants_i2c_execute_command(devContext, get_osr_cmd, sizeof(get_osr_cmd), resp, sizeof(resp), "get osr");
+	if (status != STATUS_SUCCESS) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get osr!\n");
+		return status;
+	}
+
+	osr = resp[3];
+
+	status = elants_i2c_execute_command(devContext, get_physical_scan_cmd, sizeof(get_physical_scan_cmd), resp, sizeof(resp), "get physical scan");
+	if (status != STATUS_SUCCESS) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get physical scan!\n");
+		return status;
+	}
+
+	*phy_x = (resp[2] << 8) | resp[3];
+
+	status = elants_i2c_execute_command(devContext, get_physical_drive_cmd, sizeof(get_physical_drive_cmd), resp, sizeof(resp), "get physical drive");
+	if (status != STATUS_SUCCESS) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get physical drive!\n");
+		return status;
+	}
+
+	*phy_y = (resp[2] << 8) | resp[3];
+
+	ElanTrace(devContext, TRACE_EVENT_BOOT, TRACE_BOOT_QUERY, status, (ULONG)rows << 16 | cols, osr);
+
+	devContext->max_x = ELAN_TS_RESOLUTION(rows, osr);
+	devContext->max_y = ELAN_TS_RESOLUTION(cols, osr);
+
+	return status;
+}
+
+//
+// eKTF parts report their size in millimeters but not their resolution,
+// which is fixed.
+//
+static NTSTATUS elants_i2c_query_ts_info_ektf(PELAN_CONTEXT devContext, uint16_t *phy_x, uint16_t *phy_y) {
+	NTSTATUS status;
+	uint8_t resp[HEADER_SIZE];
+	uint8_t get_xres_cmd[] = {
+		CMD_HEADER_READ, E_ELAN_INFO_X_RES, 0x00, 0x00
+	};
+	uint8_t get_yres_cmd[] = {
+		CMD_HEADER_READ, E_ELAN_INFO_Y_RES, 0x00, 0x00
+	};
+
+	status = elants_i2c_execute_command(devContext, get_xres_cmd, sizeof(get_xres_cmd), resp, sizeof(resp), "get X size");
+	if (status != STATUS_SUCCESS) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get X size!\n");
+		return status;
+	}
+
+	*phy_x = resp[2] | ((resp[3] & 0xF0) << 4);
+
+	status = elants_i2c_execute_command(devContext, get_yres_cmd, sizeof(get_yres_cmd), resp, sizeof(resp), "get Y size");
+	if (status != STATUS_SUCCESS) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get Y size!\n");
+		return status;
+	}
+
+	*phy_y = resp[2] | ((resp[3] & 0xF0) << 4);
+
+	devContext->max_x = ELAN_EKTF_MAX_X;
+	devContext->max_y = ELAN_EKTF_MAX_Y;
+
+	return status;
+}
+
+static uint16_t elants_i2c_parse_version(uint8_t *buf) {
+	return ((buf[1] & 0x0F) << 12) | (buf[2] << 4) | (buf[3] >> 4);
+}
+
+//
+// Boot query sequence, specialized per chip below. chip is a constant in
+// each specialization so only that chip's queries are compiled in. The
+// versions are informational, as in Linux only the geometry is required.
+//
+static FORCEINLINE NTSTATUS elants_i2c_query(PELAN_CONTEXT devContext, uint16_t *phy_x, uint16_t *phy_y, const UCHAR chip) {
+	NTSTATUS status;
+	uint8_t resp[HEADER_SIZE];
+	uint8_t get_fw_ver_cmd[] = {
+		CMD_HEADER_READ, E_ELAN_INFO_FW_VER, 0x00, 0x01
+	};
+	uint8_t get_test_ver_cmd[] = {
+		CMD_HEADER_READ, E_ELAN_INFO_TEST_VER, 0x00, 0x01
+	};
+	uint8_t get_bc_ver_cmd[] = {
+		CMD_HEADER_READ, E_ELAN_INFO_BC_VER, 0x00, 0x01
+	};
+
+	status = elants_i2c_execute_command(devContext, get_fw_ver_cmd, sizeof(get_fw_ver_cmd), resp, sizeof(resp), "read fw version");
+	devContext->FwVersion = NT_SUCCESS(status) ? elants_i2c_parse_version(resp) : 0;
+
+	status = elants_i2c_execute_command(devContext, get_test_ver_cmd, sizeof(get_test_ver_cmd), resp, sizeof(resp), "read test version");
+	devContext->TestVersion = NT_SUCCESS(status) ? elants_i2c_parse_version(resp) : 0;
+
+	status = elants_i2c_execute_command(devContext, get_bc_ver_cmd, sizeof(get_bc_ver_cmd), resp, sizeof(resp), "read bc version");
+	devContext->BcVersion = NT_SUCCESS(status) ? (resp[2] << 8) | resp[3] : 0;
+
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_INIT, "fw version: 0x%04x, test version: 0x%04x, bc version: 0x%04x\n",
+		devContext->FwVersion, devContext->TestVersion, devContext->BcVersion);
+	ElanTrace(devContext, TRACE_EVENT_BOOT, TRACE_BOOT_VERSION, status, devContext->FwVersion,
+		(ULONG)devContext->TestVersion << 16 | devContext->BcVersion);
+
+	if (devContext->Quirk->Flags & ELAN_QUIRK_GEOMETRY) {
+		devContext->max_x = devContext->Quirk->MaxX;
+		devContext->max_y = devContext->Quirk->MaxY;
+		*phy_x = devContext->Quirk->PhyX;
+		*phy_y = devContext->Quirk->PhyY;
+		return STATUS_SUCCESS;
+	}
+
+	if (chip == EKTF3624)
+		return elants_i2c_query_ts_info_ektf(devContext, phy_x, phy_y);
+
+	return elants_i2c_query_ts_info_ekth(devContext, phy_x, phy_y);
+}
+
+static NTSTATUS elants_i2c_query_ekth3500(PELAN_CONTEXT devContext, uint16_t *phy_x, uint16_t *phy_y) {
+	return elants_i2c_query(devContext, phy_x, phy_y, EKTH3500);
+}
+
+static NTSTATUS elants_i2c_query_ektf3624(PELAN_CONTEXT devContext, uint16_t *phy_x, uint16_t *phy_y) {
+	return elants_i2c_query(devContext, phy_x, phy_y, EKTF3624);
+}
+
+//
+// Indexed by elants_chip_id
+//
+static const ELAN_CHIP_OPS ElanChips[] = {
+	{ "EKTH3500", elants_i2c_query_ekth3500, elants_i2c_frame_ekth3500 },
+	{ "EKTF3624", elants_i2c_query_ektf3624, elants_i2c_frame_ektf3624 }
+};
+C_ASSERT(ARRAYSIZE(ElanChips) == EKTF3624 + 1);
+
+static const ELAN_QUIRK ElanQuirks[] = {
+	{ "EKTH3500", L"ACPI\\ELAN0001", 0, EKTH3500, 0, 0, ELAN_QUEUE_MAX_READS },
+
+	// Fallback, must stay last
+	{ "generic", NULL, 0, EKTH3500, 0, 0, ELAN_QUEUE_MAX_READS }
+};
+
+static const ELAN_QUIRK* ElanFindQuirk(PCWSTR hardwareId, USHORT fwId) {
+	for (int i = 0; i < ARRAYSIZE(ElanQuirks); i++) {
+		const ELAN_QUIRK* quirk = &ElanQuirks[i];
+
+		if (quirk->HardwareId && (!hardwareId || wcscmp(quirk->HardwareId, hardwareId)))
+			continue;
+		if (quirk->FwId && quirk->FwId != fwId)
+			continue;
+
+		return quirk;
+	}
+
+	return &ElanQuirks[ARRAYSIZE(ElanQuirks) - 1];
+}
+
+static PCWSTR ElanMatchHardwareId(WDFDEVICE Device) {
+	WCHAR hardwareIds[256];
+	ULONG length;
+
+	PAGED_CODE();
+
+	NTSTATUS status = WdfDeviceQueryProperty(Device, DevicePropertyHardwareID,
+		sizeof(hardwareIds) - 2 * sizeof(WCHAR), hardwareIds, &length);
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Unable to query hardware IDs 0x%x\n", status);
+		return NULL;
+	}
+
+	//
+	// REG_MULTI_SZ, make sure it is terminated even if truncated
+	//
+	length /= sizeof(WCHAR);
+	hardwareIds[length] = L'\0';
+	hardwareIds[length + 1] = L'\0';
+
+	for (PWSTR id = hardwareIds; *id; id += wcslen(id) + 1) {
+		for (int i = 0; i < ARRAYSIZE(ElanQuirks); i++) {
+			if (ElanQuirks[i].HardwareId && !_wcsicmp(ElanQuirks[i].HardwareId, id))
+				return ElanQuirks[i].HardwareId;
+		}
+	}
+
+	return NULL;
+}
+
+static void ElanApplyQuirk(PELAN_CONTEXT pDevice, const ELAN_QUIRK* quirk) {
+	pDevice->Quirk = quirk;
+	pDevice->Chip = &ElanChips[pDevice->Config.Chip ? pDevice->Config.Chip - 1 : quirk->ChipId];
+	pDevice->QueueReads = quirk->QueueReads ? quirk->QueueReads : 1;
+}
+
+//
+// Describes the panel geometry in max_x and max_y and the physical size in
+// millimeters (0 when unknown) to HIDclass and builds the report descriptor
+//
+static NTSTATUS ElanSetGeometry(PELAN_CONTEXT devContext, uint16_t phy_x, uint16_t phy_y) {
+	//
+	// Reports carry transformed coordinates, describe their range
+	//
+	ElanTransformInit(&devContext->Transform, &devContext->Config.Transform,
+		devContext->max_x, devContext->max_y);
+
+	devContext->max_x_hid[0] = (uint8_t)devContext->Transform.MaxX;
+	devContext->max_x_hid[1] = devContext->Transform.MaxX >> 8;
+
+	devContext->max_y_hid[0] = (uint8_t)devContext->Transform.MaxY;
+	devContext->max_y_hid[1] = devContext->Transform.MaxY >> 8;
+
+	//
+	// phy_x and phy_y are the panel size in millimeters. Describe the
+	// reported axes in centimeters with exponent -2, that is 0.1mm.
+	//
+	if (phy_x == 0 || phy_y == 0) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Invalid physical dimension %d x %d\n", phy_x, phy_y);
+		phy_x = phy_y = 0;
+	}
+
+	uint32_t phy_out_x = (devContext->Config.Transform.SwapXY ? phy_y : phy_x) * 10;
+	uint32_t phy_out_y = (devContext->Config.Transform.SwapXY ? phy_x : phy_y) * 10;
+	if (phy_out_x > 0x7FFF)
+		phy_out_x = 0x7FFF;
+	if (phy_out_y > 0x7FFF)
+		phy_out_y = 0x7FFF;
+
+	devContext->unit_hid[0] = phy_x ? 0x0E : 0x00;	// -2 or 0
+	devContext->unit_hid[1] = phy_x ? 0x11 : 0x00;	// SI Linear centimeters or None
+
+	devContext->phy_x_hid[0] = (uint8_t)phy_out_x;
+	devContext->phy_x_hid[1] = (uint8_t)(phy_out_x >> 8);
+
+	devContext->phy_y_hid[0] = (uint8_t)phy_out_y;
+	devContext->phy_y_hid[1] = (uint8_t)(phy_out_y >> 8);
+
+	//
+	// Contact size is reported in millimeters, 0..255
+	//
+	uint16_t phy_size = phy_x ? 2550 : 0;
+
+	devContext->phy_size_hid[0] = (uint8_t)phy_size;
+	devContext->phy_size_hid[1] = (uint8_t)(phy_size >> 8);
+
+	return ElanBuildReportDescriptor(devContext);
+}
+
 NTSTATUS BOOTTOUCHSCREEN(
 	_In_  PELAN_CONTEXT  devContext
 )
@@ -92,8 +540,10 @@ NTSTATUS BOOTTOUCHSCREEN(
 
 	LARGE_INTEGER delay;
 	if (!devContext->TouchScreenBooted) {
-#define MAX_RETRIES 3
-		for (int retries = 0; retries < MAX_RETRIES; retries++) {
+		devContext->IapMode = ELAN_IAP_OPERATIONAL;
+
+		const ULONG maxRetries = devContext->Config.BootRetries;
+		for (ULONG retries = 0; retries < maxRetries; retries++) {
 			ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Initializing... (attempt %d)\n", retries);
 			uint8_t soft_rst_cmd[] = { 0x77, 0x77, 0x77, 0x77 };
 			status = elants_i2c_send(devContext, soft_rst_cmd, sizeof(soft_rst_cmd));
@@ -103,7 +553,7 @@ NTSTATUS BOOTTOUCHSCREEN(
 
 			if (!NT_SUCCESS(status)) {
 				ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to send soft reset\n");
-				if (retries < MAX_RETRIES - 1) {
+				if (retries < maxRetries - 1) {
 					continue;
 				}
 				else {
@@ -111,17 +561,17 @@ NTSTATUS BOOTTOUCHSCREEN(
 				}
 			}
 
-			for (int bootretries = 0; bootretries < MAX_RETRIES; bootretries++){
+			for (ULONG bootretries = 0; bootretries < maxRetries; bootretries++){
 				ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Booting... (attempt %d)\n", bootretries);
 				uint8_t boot_cmd[] = { 0x4D, 0x61, 0x69, 0x6E };
 				status = elants_i2c_send(devContext, boot_cmd, sizeof(boot_cmd));
 
-				delay.QuadPart = -1 * BOOT_TIME_DELAY_MS * 10;
+				delay.QuadPart = -1 * (LONGLONG)max(devContext->Config.BootDelayMs, devContext->Quirk->BootDelayMs) * 10000;
 				KeDelayExecutionThread(KernelMode, FALSE, &delay);
 
 				if (!NT_SUCCESS(status)) {
 					ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to send boot cmd\n");
-					if (bootretries < MAX_RETRIES - 1) {
+					if (bootretries < maxRetries - 1) {
 						continue;
 					}
 					else {
@@ -131,12 +581,15 @@ NTSTATUS BOOTTOUCHSCREEN(
 
 				//Get Hello Packet
 				uint8_t hello_packet[] = { 0x55, 0x55, 0x55, 0x55 };
+				uint8_t recov_packet[] = { 0x55, 0x55, 0x80, 0x80 };
 
 				uint8_t buf[HEADER_SIZE];
 				status = elants_i2c_read(devContext, buf, sizeof(buf));
+				ElanTrace(devContext, TRACE_EVENT_BOOT, TRACE_BOOT_HELLO, status,
+					NT_SUCCESS(status) ? ElanTraceBytes(buf, sizeof(buf)) : 0, bootretries);
 				if (status != STATUS_SUCCESS) {
 					ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to read hello packet!\n");
-					if (bootretries < MAX_RETRIES - 1) {
+					if (bootretries < maxRetries - 1) {
 						continue;
 					}
 					else {
@@ -144,9 +597,27 @@ NTSTATUS BOOTTOUCHSCREEN(
 					}
 				}
 
+				if (!memcmp(buf, recov_packet, sizeof(recov_packet))) {
+					//
+					// Boot code is running without a valid firmware. Leave the
+					// controller unbooted so only the IAP engine talks to it.
+					//
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Controller is in IAP recovery mode\n");
+					devContext->IapMode = ELAN_IAP_RECOVERY;
+
+					//
+					// HIDclass still needs a report descriptor to start the
+					// stack the update runs under. Describe a panel of unknown
+					// size, the stack is restarted once the update boots it.
+					//
+					devContext->max_x = 0;
+					devContext->max_y = 0;
+					return ElanSetGeometry(devContext, 0, 0);
+				}
+
 				if (memcmp(buf, hello_packet, sizeof(hello_packet))) {
 					ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Failed to get hello packet! Got: 0x%x 0x%x 0x%x 0x%x\n", buf[0], buf[1], buf[2], buf[3]);
-					if (bootretries < MAX_RETRIES - 1) {
+					if (bootretries < maxRetries - 1) {
 						continue;
 					}
 					else {
@@ -160,63 +631,38 @@ NTSTATUS BOOTTOUCHSCREEN(
 			return status;
 		}
 
-		//Begin EKTH3500 query
-		uint8_t resp[17];
-		uint16_t phy_x, phy_y, rows, cols, osr;
-		uint8_t get_resolution_cmd[] = {
-			CMD_HEADER_6B_READ, 0x00, 0x00, 0x00, 0x00, 0x00
-		};
-		uint8_t get_osr_cmd[] = {
-			CMD_HEADER_READ, E_INFO_OSR, 0x00, 0x01
-		};
-		uint8_t get_physical_scan_cmd[] = {
-			CMD_HEADER_READ, E_INFO_PHY_SCAN, 0x00, 0x01
-		};
-		uint8_t get_physical_drive_cmd[] = {
-			CMD_HEADER_READ, E_INFO_PHY_DRIVER, 0x00, 0x01
-		};
-		status = elants_i2c_execute_command(devContext, get_resolution_cmd, sizeof(get_resolution_cmd), resp, sizeof(resp), "get resolution");
-		if (status != STATUS_SUCCESS) {
-			ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get resolution!\n");
-			return status;
+		//
+		// The firmware ID picks the final quirks table entry
+		//
+		uint8_t get_fw_id_cmd[] = { CMD_HEADER_READ, E_ELAN_INFO_FW_ID, 0x00, 0x01 };
+		uint8_t fw_id_resp[HEADER_SIZE];
+		status = elants_i2c_execute_command(devContext, get_fw_id_cmd, sizeof(get_fw_id_cmd), fw_id_resp, sizeof(fw_id_resp), "read fw id");
+		if (NT_SUCCESS(status)) {
+			devContext->FwId = elants_i2c_parse_version(fw_id_resp);
 		}
-		rows = resp[2] + resp[6] + resp[10];
-		cols = resp[3] + resp[7] + resp[11];
-
-		status = elants_i2c_execute_command(devContext, get_osr_cmd, sizeof(get_osr_cmd), resp, sizeof(resp), "get osr");
-		if (status != STATUS_SUCCESS) {
-			ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get osr!\n");
-			return status;
+		else {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to read fw id!\n");
+			devContext->FwId = 0;
 		}
 
-		osr = resp[3];
+		ElanTrace(devContext, TRACE_EVENT_BOOT, TRACE_BOOT_FW_ID, status, devContext->FwId, 0);
+		ElanApplyQuirk(devContext, ElanFindQuirk(devContext->HardwareId, devContext->FwId));
+		ElanPrint(DEBUG_LEVEL_INFO, DBG_INIT, "fw id: 0x%04x, quirks: %s, chip: %s\n", devContext->FwId, devContext->Quirk->Name, devContext->Chip->Name);
 
-		status = elants_i2c_execute_command(devContext, get_physical_scan_cmd, sizeof(get_physical_scan_cmd), resp, sizeof(resp), "get physical scan");
-		if (status != STATUS_SUCCESS) {
-			ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get physical scan!\n");
+		uint16_t phy_x, phy_y;
+		status = devContext->Chip->Query(devContext, &phy_x, &phy_y);
+		if (!NT_SUCCESS(status)) {
 			return status;
 		}
 
-		phy_x = (resp[2] << 8) | resp[3];
-
-		status = elants_i2c_execute_command(devContext, get_physical_drive_cmd, sizeof(get_physical_drive_cmd), resp, sizeof(resp), "get physical drive");
-		if (status != STATUS_SUCCESS) {
-			ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT, "Unable to get physical drive!\n");
+		status = ElanSetGeometry(devContext, phy_x, phy_y);
+		if (!NT_SUCCESS(status)) {
 			return status;
 		}
 
-		phy_y = (resp[2] << 8) | resp[3];
-
-		devContext->max_x = ELAN_TS_RESOLUTION(rows, osr);
-		devContext->max_y = ELAN_TS_RESOLUTION(cols, osr);
-
-		devContext->max_x_hid[0] = devContext->max_x;
-		devContext->max_x_hid[1] = devContext->max_x >> 8;
-
-		devContext->max_y_hid[0] = devContext->max_y;
-		devContext->max_y_hid[1] = devContext->max_y >> 8;
-
 		ElanPrint(DEBUG_LEVEL_INFO, DBG_INIT, "max x: %d, max y: %d, phy x: %d, phy y: %d\n", devContext->max_x, devContext->max_y, phy_x, phy_y);
+		ElanTrace(devContext, TRACE_EVENT_BOOT, TRACE_BOOT_GEOMETRY, status,
+			(ULONG)devContext->max_x << 16 | devContext->max_y, (ULONG)phy_x << 16 | phy_y);
 
 		uint8_t soft_rst_cmd[] = { 0x77, 0x77, 0x77, 0x77 };
 		status = elants_i2c_send(devContext, soft_rst_cmd, sizeof(soft_rst_cmd));
@@ -226,6 +672,7 @@ NTSTATUS BOOTTOUCHSCREEN(
 		}
 
 		devContext->TouchScreenBooted = true;
+		ElanTrace(devContext, TRACE_EVENT_BOOT, TRACE_BOOT_DONE, status, 0, 0);
 	}
 	return status;
 }
@@ -360,6 +807,12 @@ Status
 
 	UNREFERENCED_PARAMETER(FxResourcesTranslated);
 
+	//
+	// Normally drained at power down already, an update must never see
+	// the bus go away under it
+	//
+	WdfWorkItemFlush(pDevice->FwUpdateWorkItem);
+
 	SpbTargetDeinitialize(FxDevice, &pDevice->I2CContext);
 
 	return status;
@@ -387,45 +840,68 @@ Status
 
 --*/
 {
-	UNREFERENCED_PARAMETER(FxPreviousState);
-
 	PELAN_CONTEXT pDevice = GetDeviceContext(FxDevice);
 	NTSTATUS status = STATUS_SUCCESS;
 
 	if (!pDevice->TouchScreenBooted) {
 		status = BOOTTOUCHSCREEN(pDevice);
+		ElanTrace(pDevice, TRACE_EVENT_POWER, true, status, FxPreviousState, 0);
 		if (status != STATUS_SUCCESS) {
 			return status;
 		}
 	}
-
-	for (int i = 0; i < 20; i++) {
-		pDevice->Flags[i] = 0;
+	else {
+		ElanTrace(pDevice, TRACE_EVENT_POWER, true, status, FxPreviousState, 0);
 	}
 
+	ElanClearContacts(pDevice);
+
+	pDevice->LowPowerActive = false;
+	pDevice->PowerStats.StateTimestamp = KeQueryInterruptTime();
+
+	pDevice->HealthRecovering = false;
+	ElanHealthReset(pDevice, KeQueryInterruptTime());
+
 	pDevice->RegsSet = false;
 	pDevice->ConnectInterrupt = true;
+	pDevice->ExitingD0 = false;
+
+	//
+	// A panel that is not touched after resume raises no interrupt to
+	// start the inactivity countdown, start it here
+	//
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	ElanArmIdleTimer(pDevice);
+	WdfInterruptReleaseLock(pDevice->Interrupt);
 
 	ElanCompleteIdleIrp(pDevice);
 
+	if (pDevice->IapMode == ELAN_IAP_RECOVERY &&
+		pDevice->FwUpdateState != FWUPDATE_STATE_RUNNING) {
+		ElanStartFwUpdate(pDevice);
+	}
+
 	return status;
 }
 
 NTSTATUS
-OnD0Exit(
+OnD0ExitPreInterruptsDisabled(
 	_In_  WDFDEVICE               FxDevice,
-	_In_  WDF_POWER_DEVICE_STATE  FxPreviousState
+	_In_  WDF_POWER_DEVICE_STATE  FxTargetState
 )
 /*++
 
 Routine Description:
 
-This routine destroys objects needed by the driver.
+This routine waits for background work that masks and unmasks the
+interrupt line, while the line still belongs to the driver. A firmware
+update in progress is allowed to finish, stopping it midway would leave
+the controller in recovery mode.
 
 Arguments:
 
 FxDevice - a handle to the framework device object
-FxPreviousState - previous power state
+FxTargetState - power state being entered
 
 Return Value:
 
@@ -433,118 +909,498 @@ Status
 
 --*/
 {
-	UNREFERENCED_PARAMETER(FxPreviousState);
+	UNREFERENCED_PARAMETER(FxTargetState);
 
 	PELAN_CONTEXT pDevice = GetDeviceContext(FxDevice);
 
-	pDevice->ConnectInterrupt = false;
-	pDevice->TouchScreenBooted = false;
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	pDevice->ExitingD0 = true;
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	//
+	// Polling can still trip the health monitor, stop it before waiting
+	// for a recovery in progress
+	//
+	ElanStopPolling(pDevice);
+	WdfWorkItemFlush(pDevice->HealthWorkItem);
+	WdfWorkItemFlush(pDevice->FwUpdateWorkItem);
 
 	return STATUS_SUCCESS;
 }
 
-void ElanProcessInput(PELAN_CONTEXT pDevice) {
-	struct _ELAN_MULTITOUCH_REPORT report;
-	report.ReportID = REPORTID_MTOUCH;
-
-	int count = 0, i = 0;
-	while (count < 10 && i < 20) {
-		if (pDevice->Flags[i] != 0) {
-			report.Touch[count].ContactID = i;
-			report.Touch[count].Height = pDevice->AREA[i];
-			report.Touch[count].Width = pDevice->AREA[i];
-
-			report.Touch[count].XValue = pDevice->XValue[i];
-			report.Touch[count].YValue = pDevice->YValue[i];
-
-			uint8_t flags = pDevice->Flags[i];
-			if (flags & MXT_T9_DETECT) {
-				report.Touch[count].Status = MULTI_CONFIDENCE_BIT | MULTI_TIPSWITCH_BIT;
-			}
-			else if (flags & MXT_T9_PRESS) {
-				report.Touch[count].Status = MULTI_CONFIDENCE_BIT | MULTI_TIPSWITCH_BIT;
-			}
-			else if (flags & MXT_T9_RELEASE) {
-				report.Touch[count].Status = MULTI_CONFIDENCE_BIT;
-				pDevice->Flags[i] = 0;
+NTSTATUS
+OnD0Exit(
+	_In_  WDFDEVICE               FxDevice,
+	_In_  WDF_POWER_DEVICE_STATE  FxPreviousState
+)
+/*++
+
+Routine Description:
+
+This routine destroys objects needed by the driver.
+
+Arguments:
+
+FxDevice - a handle to the framework device object
+FxPreviousState - previous power state
+
+Return Value:
+
+Status
+
+--*/
+{
+	UNREFERENCED_PARAMETER(FxPreviousState);
+
+	PELAN_CONTEXT pDevice = GetDeviceContext(FxDevice);
+
+	WdfTimerStop(pDevice->IdleTimer, TRUE);
+	WdfTimerStop(pDevice->CmdTimer, TRUE);
+	WdfTimerStop(pDevice->SweepTimer, TRUE);
+	pDevice->SweepArmed = false;
+	ElanAccountPowerState(pDevice, KeQueryInterruptTime());
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	ElanCancelCommands(pDevice);
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+	pDevice->LowPowerActive = false;
+
+	pDevice->ConnectInterrupt = false;
+	pDevice->TouchScreenBooted = false;
+
+	ElanSaveCounters(FxDevice);
+
+	return STATUS_SUCCESS;
+}
+
+VOID ElanArmSweepTimer(PELAN_CONTEXT pDevice) {
+	ULONGLONG timeout = (ULONGLONG)pDevice->Config.ReleaseTimeoutUs * 10;
+	ULONGLONG now = KeQueryInterruptTime();
+	ULONGLONG due = 0;
+	BOOLEAN found = false;
+
+	if (pDevice->SweepArmed || !(pDevice->Config.Flags & ELAN_CONFIG_SWEEP))
+		return;
+
+	for (int n = 0; n < pDevice->LiveCount; n++) {
+		int i = pDevice->LiveSlots[n];
+		ULONGLONG expiry;
+		if (pDevice->Flags[i] == MXT_T9_DETECT)
+			expiry = pDevice->ContactTime[i] + timeout;
+		else if (pDevice->Flags[i] == MXT_T9_RELEASE)
+			expiry = now + timeout;
+		else
+			continue;
+
+		if (!found || expiry < due)
+			due = expiry;
+		found = true;
+	}
+
+	if (!found)
+		return;
+
+	pDevice->SweepArmed = true;
+	WdfTimerStart(pDevice->SweepTimer, -(LONGLONG)(due > now ? due - now : 1));
+}
+
+VOID
+ElanSweepTimerFunc(
+	_In_ WDFTIMER hTimer
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
+	PELAN_CONTEXT pDevice = GetDeviceContext(Device);
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	pDevice->SweepArmed = false;
+
+	if (pDevice->ConnectInterrupt && pDevice->TouchScreenBooted) {
+		ULONGLONG timeout = (ULONGLONG)pDevice->Config.ReleaseTimeoutUs * 10;
+		ULONGLONG now = KeQueryInterruptTime();
+		BOOLEAN pending = false;
+
+		for (int n = 0; n < pDevice->LiveCount; n++) {
+			int i = pDevice->LiveSlots[n];
+			if (pDevice->Flags[i] == MXT_T9_DETECT && now - pDevice->ContactTime[i] >= timeout) {
+				ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Releasing stuck contact %d\n", i);
+				pDevice->Flags[i] = MXT_T9_RELEASE;
+				pDevice->HealthStats.StuckReleases++;
 			}
-			else
-				report.Touch[count].Status = 0;
 
-			count++;
+			if (pDevice->Flags[i] == MXT_T9_RELEASE)
+				pending = true;
 		}
-		i++;
+
+		if (pending)
+			ElanProcessInput(pDevice);
+
+		ElanArmSweepTimer(pDevice);
 	}
 
-	report.ActualCount = count;
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+}
+
+static BOOLEAN ElanHealthCheck(PELAN_CONTEXT pDevice) {
+	ULONG interrupts = 0, frames = 0, badFrames = 0;
+
+	if (pDevice->HealthRecovering)
+		return true;
+
+	//
+	// Power down has already waited for the health workitem
+	//
+	if (pDevice->ExitingD0)
+		return false;
 
-	if (count > 0) {
-		size_t bytesWritten;
-		ElanProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
+	for (int i = 0; i < ELAN_HEALTH_BUCKETS; i++) {
+		interrupts += pDevice->HealthBuckets[i].Interrupts;
+		frames += pDevice->HealthBuckets[i].Frames;
+		badFrames += pDevice->HealthBuckets[i].BadFrames;
 	}
+
+	if (interrupts <= ELAN_HEALTH_MAX_INTERRUPTS &&
+		(frames < ELAN_HEALTH_MIN_FRAMES || badFrames * 100 < frames * ELAN_HEALTH_BAD_PERCENT))
+		return false;
+
+	ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Controller unhealthy: %d interrupts, %d of %d frames bad\n",
+		interrupts, badFrames, frames);
+
+	pDevice->HealthRecovering = true;
+	pDevice->HealthStats.Trips++;
+
+	WdfWorkItemEnqueue(pDevice->HealthWorkItem);
+
+	return true;
 }
 
-static void elants_i2c_mt_event(PELAN_CONTEXT pDevice, uint8_t *buf) {
-	unsigned int n_fingers;
-	uint16_t finger_state;
+static void ElanReleaseContacts(PELAN_CONTEXT pDevice) {
+	for (int n = 0; n < pDevice->LiveCount; n++) {
+		pDevice->Flags[pDevice->LiveSlots[n]] = MXT_T9_RELEASE;
+	}
 
-	n_fingers = buf[FW_POS_STATE + 1] & 0x0f;
-	finger_state = ((buf[FW_POS_STATE + 1] & 0x30) << 4) |
-		buf[FW_POS_STATE];
+	ElanProcessInput(pDevice);
+}
 
-	for (int i = 0; i < MAX_CONTACT_NUM; i++) {
-		if (finger_state & 1) {
-			unsigned int x, y, p, w;
+VOID
+ElanHealthWorkItem(
+	IN WDFWORKITEM HealthWorkItem
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(HealthWorkItem);
+	PELAN_CONTEXT pDevice = GetDeviceContext(Device);
+	LARGE_INTEGER delay;
 
-			uint8_t *pos;
+	//
+	// A queued or running firmware update owns the line: its workitem
+	// masks the interrupt and unmasks it when done, and
+	// WdfInterruptDisable and WdfInterruptEnable do not nest. An update
+	// cannot start while HealthRecovering is set, so what is decided here
+	// under the lock holds until it is cleared.
+	//
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	BOOLEAN updating = pDevice->FwUpdateState == FWUPDATE_STATE_RUNNING;
+	if (updating) {
+		ElanHealthReset(pDevice, KeQueryInterruptTime());
+		pDevice->HealthRecovering = false;
+	}
+	WdfInterruptReleaseLock(pDevice->Interrupt);
 
-			pos = &buf[FW_POS_XY + i * 3];
-			x = (((uint16_t)pos[0] & 0xf0) << 4) | pos[1];
-			y = (((uint16_t)pos[0] & 0x0f) << 8) | pos[2];
-			p = buf[FW_POS_PRESSURE + i];
-			w = buf[FW_POS_WIDTH + i];
+	if (updating) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Firmware update in progress, leaving the controller to it\n");
+		return;
+	}
 
-			ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL, "i=%d x=%d y=%d p=%d w=%d\n",
-				i, x, y, p, w);
+	//
+	// Mask the line first so a storming controller stops costing CPU time
+	// while it is backed off or reset.
+	//
+	ElanStopPolling(pDevice);
+	WdfTimerStop(pDevice->IdleTimer, TRUE);
+	WdfInterruptDisable(pDevice->Interrupt);
+
+	ULONGLONG now = KeQueryInterruptTime();
+	if (pDevice->HealthStrikes > 0 &&
+		now - pDevice->HealthLastTrip < (ULONGLONG)ELAN_HEALTH_STRIKE_MS * 10000) {
+		pDevice->HealthStrikes++;
+	}
+	else {
+		pDevice->HealthStrikes = 1;
+	}
+	pDevice->HealthLastTrip = now;
 
-			pDevice->Flags[i] = MXT_T9_DETECT;
-			pDevice->XValue[i] = x;
-			pDevice->YValue[i] = y;
-			pDevice->AREA[i] = w;
+	if (pDevice->HealthStrikes < ELAN_HEALTH_RESET_STRIKES) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Rate limiting interrupt for %dms\n", ELAN_HEALTH_BACKOFF_MS);
+		pDevice->HealthStats.RateLimits++;
+		ElanTrace(pDevice, TRACE_EVENT_HEALTH, pDevice->HealthStrikes, TRACE_HEALTH_RATE_LIMIT, STATUS_SUCCESS, 0);
 
-			n_fingers--;
+		delay.QuadPart = -(LONGLONG)ELAN_HEALTH_BACKOFF_MS * 10000;
+		KeDelayExecutionThread(KernelMode, FALSE, &delay);
+	}
+	else {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Resetting controller\n");
+		pDevice->HealthStats.Resets++;
+		pDevice->HealthStrikes = 0;
+
+		WdfInterruptAcquireLock(pDevice->Interrupt);
+		ElanReleaseContacts(pDevice);
+		pDevice->TouchScreenBooted = false;
+		ElanCancelCommands(pDevice);
+		WdfInterruptReleaseLock(pDevice->Interrupt);
+		WdfTimerStop(pDevice->CmdTimer, TRUE);
+
+		NTSTATUS status = BOOTTOUCHSCREEN(pDevice);
+		ElanTrace(pDevice, TRACE_EVENT_HEALTH, ELAN_HEALTH_RESET_STRIKES, TRACE_HEALTH_RESET, status, 0);
+		if (!NT_SUCCESS(status)) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Controller reset failed 0x%x\n", status);
+			pDevice->HealthStats.ResetFailures++;
 		}
-		else if (pDevice->Flags[i] == MXT_T9_DETECT) {
-			pDevice->Flags[i] = MXT_T9_RELEASE;
+
+		//
+		// The boot sequence leaves the controller at full power
+		//
+		ElanAccountPowerState(pDevice, KeQueryInterruptTime());
+		pDevice->LowPowerActive = false;
+	}
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	ElanHealthReset(pDevice, KeQueryInterruptTime());
+	ElanArmIdleTimer(pDevice);
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	WdfInterruptEnable(pDevice->Interrupt);
+
+	//
+	// Cleared only once the line is unmasked, so an update cannot start
+	// and mask it in between
+	//
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	pDevice->HealthRecovering = false;
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+}
+
+static void ElanCostFrame(PELAN_CONTEXT pDevice, ULONGLONG readCycles, ULONGLONG frameCycles) {
+	PELAN_COST_WINDOW window = &pDevice->CostWindow;
+	ULONGLONG now = KeQueryInterruptTime();
+	ULONGLONG tsc = ReadTimeStampCounter();
+
+	//
+	// Validation is what the frame parser spent outside of decoding and
+	// reporting
+	//
+	ULONGLONG nested = pDevice->CostFrame[COST_STAGE_DECODE] + pDevice->CostFrame[COST_STAGE_REPORT];
+	pDevice->CostFrame[COST_STAGE_READ] = readCycles;
+	pDevice->CostFrame[COST_STAGE_VALIDATE] = frameCycles > nested ? frameCycles - nested : 0;
+
+	if (now - pDevice->CostWindowStart >= (ULONGLONG)ELAN_COST_WINDOW_MS * 10000) {
+		if (window->Frames > 0) {
+			window->ElapsedCycles = tsc - pDevice->CostWindowTsc;
+			pDevice->CostPublished = *window;
 		}
-		finger_state >>= 1;
+		RtlZeroMemory(window, sizeof(*window));
+		pDevice->CostWindowStart = now;
+		pDevice->CostWindowTsc = tsc;
 	}
 
-	ElanProcessInput(pDevice);
+	window->Frames++;
+	for (int stage = 0; stage < COST_STAGES; stage++) {
+		window->Cycles[stage] += pDevice->CostFrame[stage];
+		if (pDevice->CostFrame[stage] > window->MaxCycles[stage])
+			window->MaxCycles[stage] = pDevice->CostFrame[stage];
+	}
 }
 
-static uint8_t elants_i2c_calculate_checksum(uint8_t *buf)
-{
-	uint8_t checksum = 0;
-	uint8_t i;
+static BOOLEAN ElanQueueHeader(uint8_t header) {
+	switch (header) {
+	case QUEUE_HEADER_SINGLE:
+	case QUEUE_HEADER_NORMAL:
+	case QUEUE_HEADER_WAIT:
+	case QUEUE_HEADER_NORMAL2:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static BOOLEAN ElanAcquireFrames(PELAN_CONTEXT pDevice, ULONGLONG triggerTime, int mode) {
+	PELAN_ACQUISITION_STATS stats = &pDevice->AcqStats;
+	BOOLEAN claimed = false;
+	BOOLEAN queued = true;
+
+	//
+	// In buffer mode the controller answers with a wait packet while it
+	// is still queueing frames. Read the queued data right away instead
+	// of waiting for another interrupt, within a bounded number of reads.
+	//
+	uint8_t buf[MAX_PACKET_SIZE];
+	C_ASSERT(HEADER_SIZE + ELAN_MAX_REPORT_COUNT * PACKET_SIZE <= sizeof(buf));
+	for (int reads = 0; queued && reads < pDevice->QueueReads; reads++) {
+		if (reads > 0) {
+			KeStallExecutionProcessor(ELAN_QUEUE_WAIT_DELAY_US);
+		}
+
+		RtlZeroMemory(pDevice->CostFrame, sizeof(pDevice->CostFrame));
+		ULONGLONG readStart = ReadTimeStampCounter();
+
+		NTSTATUS status = elants_i2c_read(pDevice, buf, sizeof(buf));
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		ULONGLONG frameStart = ReadTimeStampCounter();
+
+		//
+		// Polled reads do not wait for INT, so a scan without new data
+		// reads back whatever the controller has latched. Only hand frames
+		// with a queue header to the parser so these reads are not taken
+		// for corrupted frames by the health monitor.
+		//
+		if (mode == ELAN_ACQ_POLLING && !pDevice->CmdInFlight &&
+			!ElanQueueHeader(buf[FW_HDR_TYPE])) {
+			break;
+		}
+
+		if (!claimed) {
+			ULONGLONG latency = KeQueryInterruptTime() - triggerTime;
+			stats->Frames[mode]++;
+			stats->LatencyTotal[mode] += latency;
+			if (latency > stats->LatencyMax[mode])
+				stats->LatencyMax[mode] = latency;
+		}
+
+		ElanCount(pDevice, Frames);
+		claimed = true;
+		pDevice->FrameTime = reads == 0 ? triggerTime : KeQueryInterruptTime();
+		queued = pDevice->Chip->Frame(pDevice, buf);
+
+		ElanCostFrame(pDevice, frameStart - readStart, ReadTimeStampCounter() - frameStart);
+	}
+
+	return claimed;
+}
+
+static void ElanSchedulePoll(PELAN_CONTEXT pDevice, ULONGLONG now) {
+	ULONGLONG period = (ULONGLONG)pDevice->Config.PollPeriodUs * 10;
+
+	//
+	// Stay on the scan grid anchored at the interrupt that started this
+	// polling run, skipping any ticks that have already passed.
+	//
+	ULONGLONG next = pDevice->PollAnchor + period * ((now - pDevice->PollAnchor) / period + 1);
+
+	pDevice->PollDueTime = next;
+	WdfTimerStart(pDevice->PollTimer, -(LONGLONG)(next - now));
+}
+
+static void ElanStartPolling(PELAN_CONTEXT pDevice, ULONGLONG interruptTime) {
+	if (!(pDevice->Config.Flags & ELAN_CONFIG_POLLING) || pDevice->Polling)
+		return;
+
+	if (!ElanContactsActive(pDevice))
+		return;
+
+	pDevice->Polling = true;
+	pDevice->PollAnchor = interruptTime;
+	pDevice->PollLastContact = interruptTime;
+	pDevice->AcqStats.ModeSwitches++;
+	ElanTrace(pDevice, TRACE_EVENT_POLL, true, pDevice->Config.PollPeriodUs, 0, 0);
 
-	for (i = 0; i < FW_POS_CHECKSUM; i++)
-		checksum += buf[i];
+	ElanSchedulePoll(pDevice, KeQueryInterruptTime());
+}
+
+VOID
+ElanPollTimerFunc(
+	_In_ WDFTIMER hTimer
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
+	PELAN_CONTEXT pDevice = GetDeviceContext(Device);
 
-	return checksum;
+	//
+	// High resolution timers run at dispatch level, bus transfers need
+	// passive level
+	//
+	WdfWorkItemEnqueue(pDevice->PollWorkItem);
 }
 
-static void elants_i2c_event(PELAN_CONTEXT pDevice, uint8_t *buf) {
-	uint8_t checksum = elants_i2c_calculate_checksum(buf);
+VOID
+ElanPollWorkItem(
+	IN WDFWORKITEM PollWorkItem
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(PollWorkItem);
+	PELAN_CONTEXT pDevice = GetDeviceContext(Device);
+	BOOLEAN idle = false;
+
+	if (!pDevice->Polling)
+		return;
+
+	//
+	// Frames are read here while polling, keep the line masked so the
+	// controller does not also raise one interrupt per frame.
+	//
+	if (!pDevice->InterruptMasked) {
+		WdfInterruptDisable(pDevice->Interrupt);
+		pDevice->InterruptMasked = true;
+	}
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	if (pDevice->Polling && pDevice->TouchScreenBooted) {
+		ElanHealthAdvance(pDevice, KeQueryInterruptTime());
+		ElanAcquireFrames(pDevice, pDevice->PollDueTime, ELAN_ACQ_POLLING);
+
+		ULONGLONG now = KeQueryInterruptTime();
+		if (ElanContactsActive(pDevice)) {
+			pDevice->PollLastContact = now;
+		}
+
+		//
+		// An unhealthy controller is left to the health workitem, which
+		// owns the line from here on.
+		//
+		if (ElanHealthCheck(pDevice)) {
+			pDevice->Polling = false;
+		}
+		else if (now - pDevice->PollLastContact < (ULONGLONG)pDevice->Config.PollIdleMs * 10000) {
+			ElanSchedulePoll(pDevice, now);
+		}
+		else {
+			pDevice->Polling = false;
+			pDevice->AcqStats.ModeSwitches++;
+			ElanTrace(pDevice, TRACE_EVENT_POLL, false, pDevice->Config.PollPeriodUs, 0, 0);
+			idle = true;
 
-	if (buf[FW_POS_CHECKSUM] != checksum) {
-		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "invalid checksum for packet 0x02x: %02x vs. %02x\n", buf[FW_POS_HEADER], checksum, buf[FW_POS_CHECKSUM]);
+			ElanArmIdleTimer(pDevice);
+		}
 	}
-	else if (buf[FW_POS_HEADER] != HEADER_REPORT_10_FINGER) {
-		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "unknown packet type: %02x\n", buf[FW_POS_HEADER]);
+
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	//
+	// Only hand the line back when polling ended on its own. When
+	// ElanStopPolling cleared Polling the caller owns the interrupt state.
+	//
+	if (idle) {
+		pDevice->InterruptMasked = false;
+		WdfInterruptEnable(pDevice->Interrupt);
 	}
-	else
-		elants_i2c_mt_event(pDevice, buf);
+}
+
+VOID
+ElanStopPolling(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	pDevice->Polling = false;
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	WdfTimerStop(pDevice->PollTimer, TRUE);
+	WdfWorkItemFlush(pDevice->PollWorkItem);
+
+	pDevice->InterruptMasked = false;
 }
 
 BOOLEAN OnInterruptIsr(
@@ -561,38 +1417,214 @@ BOOLEAN OnInterruptIsr(
 	if (!pDevice->TouchScreenBooted)
 		return false;
 
-	uint8_t buf[MAX_PACKET_SIZE];
-	NTSTATUS status = elants_i2c_read(pDevice, buf, sizeof(buf));
-	if (!NT_SUCCESS(status)) {
+	//
+	// The health workitem is about to mask the line. Read the frame so a
+	// level triggered INT deasserts until then, but do not parse it.
+	//
+	if (pDevice->HealthRecovering) {
+		uint8_t buf[MAX_PACKET_SIZE];
+		elants_i2c_read(pDevice, buf, sizeof(buf));
+		return true;
+	}
+
+	ULONGLONG interruptTime = KeQueryInterruptTime();
+
+	ElanHealthAdvance(pDevice, interruptTime);
+	pDevice->HealthBuckets[pDevice->HealthBucket].Interrupts++;
+	pDevice->HealthStats.Interrupts++;
+
+	BOOLEAN claimed = ElanAcquireFrames(pDevice, interruptTime, ELAN_ACQ_INTERRUPT);
+	ElanTrace(pDevice, TRACE_EVENT_ISR, claimed, pDevice->LowPowerActive, pDevice->Polling, 0);
+	if (!claimed) {
+		pDevice->HealthStats.SpuriousInterrupts++;
+		ElanBadFrame(pDevice, TRACE_FRAME_NO_DATA, NULL);
+	}
+
+	if (ElanHealthCheck(pDevice))
+		return true;
+
+	//
+	// Any interrupt while in the low power state means the panel was
+	// touched. The frame above has already been reported, so resuming
+	// full rate here adds no latency to the first touch.
+	//
+	if (pDevice->LowPowerActive) {
+		ElanWakeFromIdle(pDevice, interruptTime);
+	}
+
+	if (!claimed)
 		return false;
+
+	ElanStartPolling(pDevice, interruptTime);
+
+	ElanArmIdleTimer(pDevice);
+
+	return true;
+}
+
+static NTSTATUS
+ElanCreatePassiveTimer(
+	IN WDFDEVICE Device,
+	IN PFN_WDF_TIMER TimerFunc,
+	OUT WDFTIMER* Timer
+)
+{
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	//
+	// Passive level timers are serialized against OnInterruptIsr with the
+	// interrupt lock instead of automatic serialization.
+	//
+	WDF_TIMER_CONFIG_INIT(&timerConfig, TimerFunc);
+	timerConfig.AutomaticSerialization = FALSE;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = Device;
+	attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+	return WdfTimerCreate(&timerConfig, &attributes, Timer);
+}
+
+typedef struct _ELAN_CONFIG_VALUE
+{
+	PCWSTR Name;
+
+	ULONG Offset;
+
+	ULONG Size;
+
+	ULONG Minimum;
+
+	ULONG Maximum;
+} ELAN_CONFIG_VALUE;
+
+#define ELAN_CONFIG_ENTRY(name, field, minimum, maximum) \
+	{ name, FIELD_OFFSET(ELAN_CONFIG, field), RTL_FIELD_SIZE(ELAN_CONFIG, field), minimum, maximum }
+
+static const ELAN_CONFIG_VALUE ElanConfigValues[] = {
+	ELAN_CONFIG_ENTRY(L"PollPeriodUs", PollPeriodUs, 0, 100000),
+	ELAN_CONFIG_ENTRY(L"PollIdleMs", PollIdleMs, 1, 10000),
+	ELAN_CONFIG_ENTRY(L"DuplicateMax", DuplicateMax, 0, 255),
+	ELAN_CONFIG_ENTRY(L"ReportPressure", ReportPressure, 0, 1),
+	ELAN_CONFIG_ENTRY(L"PredictHorizonUs", Predict.HorizonUs, 0, 50000),
+	ELAN_CONFIG_ENTRY(L"PredictAlpha", Predict.Alpha, 0, 256),
+	ELAN_CONFIG_ENTRY(L"PredictBeta", Predict.Beta, 0, 256),
+	ELAN_CONFIG_ENTRY(L"JitterHoldThreshold", Jitter.HoldThreshold, 0, 0xFFFF),
+	ELAN_CONFIG_ENTRY(L"JitterMoveThreshold", Jitter.MoveThreshold, 0, 0xFFFF),
+	ELAN_CONFIG_ENTRY(L"JitterSettleFrames", Jitter.SettleFrames, 0, 0xFF),
+	ELAN_CONFIG_ENTRY(L"SwapXY", Transform.SwapXY, 0, 1),
+	ELAN_CONFIG_ENTRY(L"InvertX", Transform.InvertX, 0, 1),
+	ELAN_CONFIG_ENTRY(L"InvertY", Transform.InvertY, 0, 1),
+	ELAN_CONFIG_ENTRY(L"LogicalMaxX", Transform.LogicalMaxX, 0, ELAN_TRANSFORM_MAX_LOGICAL),
+	ELAN_CONFIG_ENTRY(L"LogicalMaxY", Transform.LogicalMaxY, 0, ELAN_TRANSFORM_MAX_LOGICAL),
+	ELAN_CONFIG_ENTRY(L"ReleaseTimeoutUs", ReleaseTimeoutUs, 0, 10000000),
+	ELAN_CONFIG_ENTRY(L"IdleTimeoutMs", IdleTimeoutMs, 0, 600000),
+	ELAN_CONFIG_ENTRY(L"BootDelayMs", BootDelayMs, 1, 1000),
+	ELAN_CONFIG_ENTRY(L"BootRetries", BootRetries, 1, 10),
+	ELAN_CONFIG_ENTRY(L"Chip", Chip, 0, EKTF3624 + 1)
+};
+
+static VOID
+ElanLoadConfig(
+	IN WDFDEVICE Device,
+	OUT PELAN_CONFIG Config
+)
+/*++
+
+Routine Description:
+
+Fills the tuning profile with the built in defaults and overrides them
+with the values found under the Settings subkey of the device's hardware
+key. Values outside their range are ignored.
+
+Arguments:
+
+Device - a handle to the framework device object
+Config - tuning profile to fill
+
+Return Value:
+
+None
+
+--*/
+{
+	DECLARE_CONST_UNICODE_STRING(settingsKeyName, L"Settings");
+	WDFKEY deviceKey;
+	WDFKEY settingsKey;
+
+	PAGED_CODE();
+
+	RtlZeroMemory(Config, sizeof(*Config));
+	Config->PollPeriodUs = ELAN_POLL_PERIOD_US;
+	Config->PollIdleMs = ELAN_POLL_IDLE_MS;
+	Config->DuplicateMax = ELAN_DUPLICATE_MAX;
+	Config->ReportPressure = ELAN_REPORT_PRESSURE;
+	Config->Predict.HorizonUs = ELAN_PREDICT_HORIZON_US;
+	Config->Predict.Alpha = ELAN_PREDICT_ALPHA;
+	Config->Predict.Beta = ELAN_PREDICT_BETA;
+	Config->Jitter.HoldThreshold = ELAN_JITTER_HOLD_THRESHOLD;
+	Config->Jitter.MoveThreshold = ELAN_JITTER_MOVE_THRESHOLD;
+	Config->Jitter.SettleFrames = ELAN_JITTER_SETTLE_FRAMES;
+	Config->ReleaseTimeoutUs = ELAN_RELEASE_TIMEOUT_SCANS * ELAN_SCAN_PERIOD_US;
+	Config->IdleTimeoutMs = ELAN_IDLE_TIMEOUT_MS;
+	Config->BootDelayMs = BOOT_TIME_DELAY_MS;
+	Config->BootRetries = MAX_RETRIES;
+
+	NTSTATUS status = WdfDeviceOpenRegistryKey(Device, PLUGPLAY_REGKEY_DEVICE, KEY_READ,
+		WDF_NO_OBJECT_ATTRIBUTES, &deviceKey);
+	if (NT_SUCCESS(status)) {
+		status = WdfRegistryOpenKey(deviceKey, &settingsKeyName, KEY_READ,
+			WDF_NO_OBJECT_ATTRIBUTES, &settingsKey);
+		WdfRegistryClose(deviceKey);
 	}
-	
-	switch (buf[FW_HDR_TYPE]) {
-	case QUEUE_HEADER_SINGLE:
-		elants_i2c_event(pDevice, &buf[HEADER_SIZE]);
-		break;
-	case QUEUE_HEADER_NORMAL:
-		int report_count = buf[FW_HDR_COUNT];
-		if (report_count == 0 || report_count > 3) {
-			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "bad report count: %d\n", report_count);
-			break;
-		}
 
-		int report_len = buf[FW_HDR_LENGTH] / report_count;
-		if (report_len != PACKET_SIZE) {
-			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "mismatching report length: %d\n", report_len);
-			break;
-		}
+	if (NT_SUCCESS(status)) {
+		for (int i = 0; i < ARRAYSIZE(ElanConfigValues); i++) {
+			const ELAN_CONFIG_VALUE* entry = &ElanConfigValues[i];
+			UNICODE_STRING valueName;
+			ULONG value;
+
+			RtlInitUnicodeString(&valueName, entry->Name);
+			if (!NT_SUCCESS(WdfRegistryQueryULong(settingsKey, &valueName, &value)))
+				continue;
+
+			if (value < entry->Minimum || value > entry->Maximum) {
+				ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Ignoring out of range setting %ws = %d\n", entry->Name, value);
+				continue;
+			}
 
-		for (int i = 0; i < report_count; i++) {
-			uint8_t *newbuf = buf + HEADER_SIZE + i * PACKET_SIZE;
-			elants_i2c_event(pDevice, newbuf);
+			PUCHAR field = (PUCHAR)Config + entry->Offset;
+			switch (entry->Size) {
+			case sizeof(UCHAR):
+				*field = (UCHAR)value;
+				break;
+			case sizeof(USHORT):
+				*(PUSHORT)field = (USHORT)value;
+				break;
+			default:
+				*(PULONG)field = value;
+				break;
+			}
 		}
 
-		break;
+		WdfRegistryClose(settingsKey);
 	}
 
-	return true;
+	if (Config->PollPeriodUs != 0)
+		Config->Flags |= ELAN_CONFIG_POLLING;
+	if (Config->DuplicateMax != 0)
+		Config->Flags |= ELAN_CONFIG_COALESCE;
+	if (Config->ReportPressure)
+		Config->Flags |= ELAN_CONFIG_PRESSURE;
+	if (Config->Predict.HorizonUs != 0)
+		Config->Flags |= ELAN_CONFIG_PREDICT;
+	if (Config->Jitter.HoldThreshold != 0)
+		Config->Flags |= ELAN_CONFIG_JITTER;
+	if (Config->ReleaseTimeoutUs != 0)
+		Config->Flags |= ELAN_CONFIG_SWEEP;
+	if (Config->IdleTimeoutMs != 0)
+		Config->Flags |= ELAN_CONFIG_IDLE;
 }
 
 NTSTATUS
@@ -632,6 +1664,7 @@ ElanEvtDeviceAdd(
 		pnpCallbacks.EvtDevicePrepareHardware = OnPrepareHardware;
 		pnpCallbacks.EvtDeviceReleaseHardware = OnReleaseHardware;
 		pnpCallbacks.EvtDeviceD0Entry = OnD0Entry;
+		pnpCallbacks.EvtDeviceD0ExitPreInterruptsDisabled = OnD0ExitPreInterruptsDisabled;
 		pnpCallbacks.EvtDeviceD0Exit = OnD0Exit;
 
 		WdfDeviceInitSetPnpPowerEventCallbacks(DeviceInit, &pnpCallbacks);
@@ -752,12 +1785,126 @@ ElanEvtDeviceAdd(
 	}
 
 	//
-	// Initialize DeviceMode
+	// Create passive level timers for the inactivity governor, the
+	// command channel timeout and the stuck contact sweeper
 	//
+	status = ElanCreatePassiveTimer(device, ElanIdleTimerFunc, &devContext->IdleTimer);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error creating idle timer - %!STATUS!",
+			status);
 
-	devContext->DeviceMode = DEVICE_MODE_MOUSE;
+		return status;
+	}
 
-	return status;
+	status = ElanCreatePassiveTimer(device, ElanCmdTimerFunc, &devContext->CmdTimer);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error creating command timer - %!STATUS!",
+			status);
+
+		return status;
+	}
+
+	status = ElanCreatePassiveTimer(device, ElanSweepTimerFunc, &devContext->SweepTimer);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error creating sweep timer - %!STATUS!",
+			status);
+
+		return status;
+	}
+
+	//
+	// Create the high resolution timer and the workitem used for polled
+	// acquisition
+	//
+	WDF_TIMER_CONFIG pollTimerConfig;
+	WDF_TIMER_CONFIG_INIT(&pollTimerConfig, ElanPollTimerFunc);
+	pollTimerConfig.AutomaticSerialization = FALSE;
+	pollTimerConfig.UseHighResolutionTimer = WdfTrue;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = device;
+
+	status = WdfTimerCreate(&pollTimerConfig, &attributes, &devContext->PollTimer);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error creating poll timer - %!STATUS!",
+			status);
+
+		return status;
+	}
+
+	WDF_WORKITEM_CONFIG pollWorkItemConfig;
+	WDF_WORKITEM_CONFIG_INIT(&pollWorkItemConfig, ElanPollWorkItem);
+	pollWorkItemConfig.AutomaticSerialization = FALSE;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = device;
+
+	status = WdfWorkItemCreate(&pollWorkItemConfig, &attributes, &devContext->PollWorkItem);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error creating poll workitem - %!STATUS!",
+			status);
+
+		return status;
+	}
+
+	WDF_WORKITEM_CONFIG healthWorkItemConfig;
+	WDF_WORKITEM_CONFIG_INIT(&healthWorkItemConfig, ElanHealthWorkItem);
+	healthWorkItemConfig.AutomaticSerialization = FALSE;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = device;
+
+	status = WdfWorkItemCreate(&healthWorkItemConfig, &attributes, &devContext->HealthWorkItem);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error creating health workitem - %!STATUS!",
+			status);
+
+		return status;
+	}
+
+	WDF_WORKITEM_CONFIG fwUpdateWorkItemConfig;
+	WDF_WORKITEM_CONFIG_INIT(&fwUpdateWorkItemConfig, ElanFwUpdateWorkItem);
+	fwUpdateWorkItemConfig.AutomaticSerialization = FALSE;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = device;
+
+	status = WdfWorkItemCreate(&fwUpdateWorkItemConfig, &attributes, &devContext->FwUpdateWorkItem);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error creating firmware update workitem - %!STATUS!",
+			status);
+
+		return status;
+	}
+
+	ElanLoadConfig(device, &devContext->Config);
+
+	devContext->HardwareId = ElanMatchHardwareId(device);
+	ElanApplyQuirk(devContext, ElanFindQuirk(devContext->HardwareId, 0));
+
+	devContext->State = ELAN_STATE_NORMAL;
+
+	//
+	// Initialize DeviceMode
+	//
+
+	devContext->DeviceMode = DEVICE_MODE_MOUSE;
+
+	return status;
 }
 
 void
@@ -1123,6 +2270,8 @@ ElanEvtInternalDeviceControl(
 		break;
 	}
 
+	ElanTrace(devContext, TRACE_EVENT_IOCTL, IoControlCode, status, completeRequest, 0);
+
 	if (completeRequest)
 	{
 		WdfRequestComplete(Request, status);
@@ -1147,6 +2296,118 @@ ElanEvtInternalDeviceControl(
 	return;
 }
 
+static void
+ElanAppendDescriptor(
+	IN PELAN_CONTEXT pDevice,
+	IN OUT size_t* Length,
+	IN const HID_REPORT_DESCRIPTOR* Items,
+	IN size_t Size
+)
+{
+	if (*Length + Size <= sizeof(pDevice->ReportDescriptor))
+	{
+		RtlCopyMemory(&pDevice->ReportDescriptor[*Length], Items, Size);
+	}
+
+	*Length += Size;
+}
+
+NTSTATUS
+ElanBuildReportDescriptor(
+	IN PELAN_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Builds the report descriptor into the device context from the current
+panel geometry. Called from ElanSetGeometry at boot, also in recovery
+mode, so descriptor requests are a single copy.
+
+Arguments:
+
+pDevice - device context with max_x_hid, max_y_hid, unit_hid and the
+physical maxima filled in
+
+Return Value:
+
+NT status code.
+
+--*/
+{
+	static const HID_REPORT_DESCRIPTOR touchHeader[] = {
+		//
+		// Multitouch report starts here
+		//
+		0x05, 0x0d,                         // USAGE_PAGE (Digitizers)
+		0x09, 0x04,                         // USAGE (Touch Screen)
+		0xa1, 0x01,                         // COLLECTION (Application)
+		0x85, REPORTID_MTOUCH,              //   REPORT_ID (Touch)
+		0x09, 0x22,                         //   USAGE (Finger)
+	};
+	static const HID_REPORT_DESCRIPTOR touchCollection0[] = { MT_TOUCH_COLLECTION0 };
+	static const HID_REPORT_DESCRIPTOR touchCollection1[] = { MT_TOUCH_COLLECTION1 };
+	static const HID_REPORT_DESCRIPTOR touchCollection2[] = { MT_TOUCH_COLLECTION2 };
+	static const HID_REPORT_DESCRIPTOR touchCollection3[] = { MT_TOUCH_COLLECTION3 };
+	static const HID_REPORT_DESCRIPTOR touchUnitReset[] = { MT_TOUCH_UNIT_RESET };
+	static const HID_REPORT_DESCRIPTOR touchPressure[] = { MT_TOUCH_PRESSURE };
+	static const HID_REPORT_DESCRIPTOR touchCollectionEnd[] = { MT_TOUCH_COLLECTION_END };
+	static const HID_REPORT_DESCRIPTOR touchFooter[] = {
+		USAGE_PAGE
+		0xc0,                               // END_COLLECTION
+		VENDOR_COLLECTION
+	};
+
+	const HID_REPORT_DESCRIPTOR xItems[] = {
+		0x55, pDevice->unit_hid[0],                         //       UNIT_EXPONENT
+		0x65, pDevice->unit_hid[1],                         //       UNIT
+		0x46, pDevice->phy_x_hid[0], pDevice->phy_x_hid[1], //       PHYSICAL_MAXIMUM (WIDTH)
+		0x26, pDevice->max_x_hid[0], pDevice->max_x_hid[1], //       LOGICAL_MAXIMUM (WIDTH)
+	};
+	const HID_REPORT_DESCRIPTOR yItems[] = {
+		0x46, pDevice->phy_y_hid[0], pDevice->phy_y_hid[1], //       PHYSICAL_MAXIMUM (HEIGHT)
+		0x26, pDevice->max_y_hid[0], pDevice->max_y_hid[1], //       LOGICAL_MAXIMUM (HEIGHT)
+	};
+	const HID_REPORT_DESCRIPTOR sizeItems[] = {
+		0x46, pDevice->phy_size_hid[0], pDevice->phy_size_hid[1], //   PHYSICAL_MAXIMUM (CONTACT SIZE)
+		0x26, 0xff, 0x00,                                     //       LOGICAL_MAXIMUM (255)
+	};
+
+	size_t length = 0;
+
+	ElanAppendDescriptor(pDevice, &length, touchHeader, sizeof(touchHeader));
+	for (int i = 0; i < MULTI_MAX_COUNT; i++)
+	{
+		ElanAppendDescriptor(pDevice, &length, touchCollection0, sizeof(touchCollection0));
+		ElanAppendDescriptor(pDevice, &length, xItems, sizeof(xItems));
+		ElanAppendDescriptor(pDevice, &length, touchCollection1, sizeof(touchCollection1));
+		ElanAppendDescriptor(pDevice, &length, yItems, sizeof(yItems));
+		ElanAppendDescriptor(pDevice, &length, touchCollection2, sizeof(touchCollection2));
+		ElanAppendDescriptor(pDevice, &length, sizeItems, sizeof(sizeItems));
+		ElanAppendDescriptor(pDevice, &length, touchCollection3, sizeof(touchCollection3));
+		ElanAppendDescriptor(pDevice, &length, touchUnitReset, sizeof(touchUnitReset));
+		if (pDevice->Config.Flags & ELAN_CONFIG_PRESSURE)
+		{
+			ElanAppendDescriptor(pDevice, &length, touchPressure, sizeof(touchPressure));
+		}
+		ElanAppendDescriptor(pDevice, &length, touchCollectionEnd, sizeof(touchCollectionEnd));
+	}
+	ElanAppendDescriptor(pDevice, &length, touchFooter, sizeof(touchFooter));
+
+	if (length > sizeof(pDevice->ReportDescriptor))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_INIT,
+			"Report descriptor too large (%d bytes)\n", length);
+
+		pDevice->ReportDescriptorLength = 0;
+		return STATUS_BUFFER_OVERFLOW;
+	}
+
+	pDevice->ReportDescriptorLength = (USHORT)length;
+
+	return STATUS_SUCCESS;
+}
+
 NTSTATUS
 ElanGetHidDescriptor(
 	IN WDFDEVICE Device,
@@ -1156,8 +2417,9 @@ ElanGetHidDescriptor(
 	NTSTATUS            status = STATUS_SUCCESS;
 	size_t              bytesToCopy = 0;
 	WDFMEMORY           memory;
+	HID_DESCRIPTOR      hidDescriptor;
 
-	UNREFERENCED_PARAMETER(Device);
+	PELAN_CONTEXT devContext = GetDeviceContext(Device);
 
 	ElanPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
 		"ElanGetHidDescriptor Entry\n");
@@ -1196,9 +2458,12 @@ ElanGetHidDescriptor(
 		return status;
 	}
 
+	hidDescriptor = DefaultHidDescriptor;
+	hidDescriptor.DescriptorList[0].wReportLength = devContext->ReportDescriptorLength;
+
 	status = WdfMemoryCopyFromBuffer(memory,
 		0, // Offset
-		(PVOID)&DefaultHidDescriptor,
+		(PVOID)&hidDescriptor,
 		bytesToCopy);
 
 	if (!NT_SUCCESS(status))
@@ -1237,36 +2502,6 @@ ElanGetReportDescriptor(
 	ElanPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
 		"ElanGetReportDescriptor Entry\n");
 
-#define MT_TOUCH_COLLECTION												\
-			MT_TOUCH_COLLECTION0 \
-			0x26, devContext->max_x_hid[0], devContext->max_x_hid[1],                   /*       LOGICAL_MAXIMUM (WIDTH)    */ \
-			MT_TOUCH_COLLECTION1 \
-			0x26, devContext->max_y_hid[0], devContext->max_y_hid[1],                   /*       LOGICAL_MAXIMUM (HEIGHT)    */ \
-			MT_TOUCH_COLLECTION2 \
-
-	HID_REPORT_DESCRIPTOR ReportDescriptor[] = {
-		//
-		// Multitouch report starts here
-		//
-		0x05, 0x0d,                         // USAGE_PAGE (Digitizers)
-		0x09, 0x04,                         // USAGE (Touch Screen)
-		0xa1, 0x01,                         // COLLECTION (Application)
-		0x85, REPORTID_MTOUCH,              //   REPORT_ID (Touch)
-		0x09, 0x22,                         //   USAGE (Finger)
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		MT_TOUCH_COLLECTION
-		USAGE_PAGE
-		0xc0,                               // END_COLLECTION
-	};
-
 	//
 	// This IOCTL is METHOD_NEITHER so WdfRequestRetrieveOutputMemory
 	// will correctly retrieve buffer from Irp->UserBuffer. 
@@ -1286,23 +2521,23 @@ ElanGetReportDescriptor(
 	}
 
 	//
-	// Use hardcoded Report descriptor
+	// Use the Report descriptor built at boot
 	//
-	bytesToCopy = DefaultHidDescriptor.DescriptorList[0].wReportLength;
+	bytesToCopy = devContext->ReportDescriptorLength;
 
 	if (bytesToCopy == 0)
 	{
 		status = STATUS_INVALID_DEVICE_STATE;
 
 		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
-			"DefaultHidDescriptor's reportLength is zero, 0x%x\n", status);
+			"ReportDescriptorLength is zero, 0x%x\n", status);
 
 		return status;
 	}
 
 	status = WdfMemoryCopyFromBuffer(memory,
 		0,
-		(PVOID)ReportDescriptor,
+		(PVOID)devContext->ReportDescriptor,
 		bytesToCopy);
 	if (!NT_SUCCESS(status))
 	{
@@ -1570,6 +2805,8 @@ ElanProcessVendorReport(
 
 			*BytesWritten = bytesReturned;
 
+			ElanCount(DevContext, ReportsDelivered);
+
 			ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
 				"%s completed, Queue:0x%p, Request:0x%p\n",
 				DbgHidInternalIoctlString(IOCTL_HID_READ_REPORT),
@@ -1580,12 +2817,21 @@ ElanProcessVendorReport(
 		{
 			ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
 				"WdfRequestRetrieveOutputBuffer failed Status 0x%x\n", status);
+
+			ElanCount(DevContext, ReportErrors);
+
+			//
+			// The request has left the queue, fail it rather than leak it
+			//
+			WdfRequestComplete(reqRead, status);
 		}
 	}
 	else
 	{
 		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
 			"WdfIoQueueRetrieveNextRequest failed Status 0x%x\n", status);
+
+		ElanCount(DevContext, QueueMisses);
 	}
 
 	ElanPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
@@ -1631,6 +2877,239 @@ ElanReadReport(
 	return status;
 }
 
+static VOID
+ElanFillCountersReport(
+	IN PELAN_CONTEXT pDevice,
+	OUT ElanCountersReport* pReport
+)
+/*++
+
+Routine Description:
+
+Snapshots the runtime counters. Each counter is read atomically; the set
+as a whole is not, as the ISR keeps updating it.
+
+Arguments:
+
+pDevice - device context
+pReport - counters report to fill
+
+Return Value:
+
+None
+
+--*/
+{
+	C_ASSERT(sizeof(ELAN_COUNTERS) == sizeof(ElanCountersReport) - FIELD_OFFSET(ElanCountersReport, Frames));
+
+	volatile LONG64* counters = (volatile LONG64*)&pDevice->Counters;
+	PUCHAR values = (PUCHAR)&pReport->Frames;
+
+	for (int i = 0; i < sizeof(ELAN_COUNTERS) / sizeof(LONG64); i++) {
+		ULONGLONG value = (ULONGLONG)InterlockedExchangeAdd64(&counters[i], 0);
+		RtlCopyMemory(values + i * sizeof(value), &value, sizeof(value));
+	}
+}
+
+VOID
+ElanSaveCounters(
+	IN WDFDEVICE FxDevice
+)
+/*++
+
+Routine Description:
+
+Writes a summary of the runtime counters as REG_QWORD values under the
+Counters subkey of the device's hardware key, so it can be inspected
+after the device has powered down.
+
+Arguments:
+
+FxDevice - a handle to the framework device object
+
+Return Value:
+
+None
+
+--*/
+{
+	static const PCWSTR counterNames[] = {
+		L"Frames",
+		L"Packets",
+		L"ReportsDelivered",
+		L"QueueMisses",
+		L"ReportErrors",
+		L"SpbReadErrors",
+		L"SpbWriteErrors",
+		L"EmptyInterrupts",
+		L"BadChecksums",
+		L"UnknownPackets",
+		L"BadWaitPackets",
+		L"BadReportCounts",
+		L"BadReportLengths",
+		L"UnknownHeaders"
+	};
+	C_ASSERT(ARRAYSIZE(counterNames) == sizeof(ELAN_COUNTERS) / sizeof(LONG64));
+
+	PELAN_CONTEXT pDevice = GetDeviceContext(FxDevice);
+	DECLARE_CONST_UNICODE_STRING(countersKeyName, L"Counters");
+	WDFKEY deviceKey;
+	WDFKEY countersKey;
+	ElanCountersReport report;
+
+	NTSTATUS status = WdfDeviceOpenRegistryKey(FxDevice, PLUGPLAY_REGKEY_DEVICE, KEY_WRITE,
+		WDF_NO_OBJECT_ATTRIBUTES, &deviceKey);
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Unable to open device key 0x%x\n", status);
+		return;
+	}
+
+	status = WdfRegistryCreateKey(deviceKey, &countersKeyName, KEY_WRITE, REG_OPTION_NON_VOLATILE,
+		NULL, WDF_NO_OBJECT_ATTRIBUTES, &countersKey);
+	WdfRegistryClose(deviceKey);
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Unable to create counters key 0x%x\n", status);
+		return;
+	}
+
+	ElanFillCountersReport(pDevice, &report);
+
+	PUCHAR values = (PUCHAR)&report.Frames;
+	for (int i = 0; i < ARRAYSIZE(counterNames); i++) {
+		UNICODE_STRING valueName;
+		ULONGLONG value;
+
+		RtlInitUnicodeString(&valueName, counterNames[i]);
+		RtlCopyMemory(&value, values + i * sizeof(value), sizeof(value));
+
+		status = WdfRegistryAssignValue(countersKey, &valueName, REG_QWORD, sizeof(value), &value);
+		if (!NT_SUCCESS(status)) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Unable to write counter 0x%x\n", status);
+			break;
+		}
+	}
+
+	WdfRegistryClose(countersKey);
+}
+
+static VOID
+ElanFillCostReport(
+	IN PELAN_CONTEXT pDevice,
+	OUT ElanCostReport* pReport
+)
+/*++
+
+Routine Description:
+
+Copies the last published cost window and the acquisition latency of
+each mode into the report.
+
+Arguments:
+
+pDevice - device context
+pReport - cost report to fill
+
+Return Value:
+
+None
+
+--*/
+{
+	ELAN_COST_WINDOW window;
+	ELAN_ACQUISITION_STATS acq;
+
+	C_ASSERT(COST_ACQ_INTERRUPT == ELAN_ACQ_INTERRUPT && COST_ACQ_POLLING == ELAN_ACQ_POLLING &&
+		COST_ACQ_MODES == ELAN_ACQ_MODES);
+
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+	window = pDevice->CostPublished;
+	acq = pDevice->AcqStats;
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	RtlZeroMemory(pReport->Reserved, sizeof(pReport->Reserved));
+	pReport->Frames = window.Frames;
+	pReport->ElapsedCycles = window.ElapsedCycles;
+
+	for (int stage = 0; stage < COST_STAGES; stage++) {
+		ULONGLONG average = window.Frames ? window.Cycles[stage] / window.Frames : 0;
+
+		pReport->Total[stage] = window.Cycles[stage];
+		pReport->Average[stage] = (ULONG)min(average, MAXULONG);
+		pReport->Max[stage] = (ULONG)min(window.MaxCycles[stage], MAXULONG);
+	}
+
+	for (int mode = 0; mode < ELAN_ACQ_MODES; mode++) {
+		ULONGLONG average = acq.Frames[mode] ? acq.LatencyTotal[mode] / acq.Frames[mode] : 0;
+
+		pReport->AcqFrames[mode] = acq.Frames[mode];
+		pReport->AcqLatencyAverageUs[mode] = (ULONG)min(average / 10, MAXULONG);
+		pReport->AcqLatencyMaxUs[mode] = (ULONG)min(acq.LatencyMax[mode] / 10, MAXULONG);
+	}
+	pReport->AcqModeSwitches = acq.ModeSwitches;
+}
+
+static VOID
+ElanFillTraceReport(
+	IN PELAN_CONTEXT pDevice,
+	OUT ElanTraceReport* pReport
+)
+/*++
+
+Routine Description:
+
+Copies the records following the read cursor out of the trace ring.
+Records that were overwritten since the cursor was set are skipped; a
+record that is still being written ends the batch and is returned by the
+next request. The cursor is read and advanced under the interrupt lock so
+concurrent requests on the parallel queue each get their own records.
+
+Arguments:
+
+pDevice - device context
+pReport - trace report to fill
+
+Return Value:
+
+None
+
+--*/
+{
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	ULONG head = (ULONG)pDevice->TraceHead;
+	ULONG oldest = head > ELAN_TRACE_ENTRIES ? head - ELAN_TRACE_ENTRIES + 1 : 1;
+	ULONG cursor = pDevice->TraceCursor;
+
+	if (cursor < oldest)
+		cursor = oldest;
+
+	pReport->Count = 0;
+	pReport->Capacity = ELAN_TRACE_ENTRIES;
+	pReport->Head = head;
+
+	while (pReport->Count < TRACE_REPORT_RECORDS && cursor <= head) {
+		PELAN_TRACE_RECORD record = &pDevice->TraceRing[(cursor - 1) & (ELAN_TRACE_ENTRIES - 1)];
+		PELAN_TRACE_RECORD out = &pReport->Records[pReport->Count];
+
+		*out = *record;
+		KeMemoryBarrierWithoutFence();
+
+		ULONG sequence = *(volatile ULONG*)&record->Sequence;
+		if (out->Sequence != sequence || sequence < cursor)
+			break;
+
+		if (sequence == cursor)
+			pReport->Count++;
+
+		cursor++;
+	}
+
+	pDevice->TraceCursor = cursor;
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	pReport->Cursor = cursor;
+}
+
 NTSTATUS
 ElanSetFeature(
 	IN PELAN_CONTEXT DevContext,
@@ -1699,6 +3178,124 @@ ElanSetFeature(
 
 				break;
 
+			case REPORTID_FWUPDATE:
+			{
+
+				ElanFwUpdateReport* pFwReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanFwUpdateReport))
+				{
+					pFwReport = (ElanFwUpdateReport*)transferPacket->reportBuffer;
+
+					if (pFwReport->Command == FWUPDATE_CMD_START)
+					{
+						status = ElanStartFwUpdate(DevContext);
+					}
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanSetFeature FwUpdate Command = 0x%x\n", pFwReport->Command);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanSetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanFwUpdateReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanFwUpdateReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_RECALIBRATE:
+			{
+
+				ElanRecalibrateReport* pRecalReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanRecalibrateReport))
+				{
+					pRecalReport = (ElanRecalibrateReport*)transferPacket->reportBuffer;
+
+					if (pRecalReport->Command == RECALIBRATE_CMD_START)
+					{
+						status = ElanStartRecalibration(DevContext);
+					}
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanSetFeature Recalibrate Command = 0x%x\n", pRecalReport->Command);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanSetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanRecalibrateReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanRecalibrateReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_DIAG:
+			{
+
+				ElanDiagReport* pDiagReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanDiagReport))
+				{
+					pDiagReport = (ElanDiagReport*)transferPacket->reportBuffer;
+
+					status = ElanStartDiagRead(DevContext, pDiagReport->Command);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanSetFeature Diag Command = %02x %02x %02x %02x\n",
+						pDiagReport->Command[0], pDiagReport->Command[1],
+						pDiagReport->Command[2], pDiagReport->Command[3]);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanSetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanDiagReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanDiagReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_TRACE:
+			{
+
+				ElanTraceReport* pTraceReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanTraceReport))
+				{
+					pTraceReport = (ElanTraceReport*)transferPacket->reportBuffer;
+
+					WdfInterruptAcquireLock(DevContext->Interrupt);
+					DevContext->TraceCursor = pTraceReport->Cursor;
+					WdfInterruptReleaseLock(DevContext->Interrupt);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanSetFeature Trace Cursor = %d\n", pTraceReport->Cursor);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanSetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanTraceReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanTraceReport));
+				}
+
+				break;
+			}
+
 			default:
 
 				ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
@@ -1817,6 +3414,210 @@ ElanGetFeature(
 				break;
 			}
 
+			case REPORTID_FWUPDATE:
+			{
+
+				ElanFwUpdateReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanFwUpdateReport))
+				{
+					pReport = (ElanFwUpdateReport*)transferPacket->reportBuffer;
+
+					ElanFillFwUpdateReport(DevContext, pReport);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanGetFeature FwUpdate State = 0x%x\n", pReport->State);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanFwUpdateReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanFwUpdateReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_RECALIBRATE:
+			{
+
+				ElanRecalibrateReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanRecalibrateReport))
+				{
+					pReport = (ElanRecalibrateReport*)transferPacket->reportBuffer;
+
+					pReport->Command = RECALIBRATE_CMD_NONE;
+					pReport->State = DevContext->RecalState;
+					pReport->Reserved = 0;
+					pReport->Status = DevContext->RecalStatus;
+					pReport->ElapsedMs = (ULONG)(DevContext->RecalElapsed / 10000);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanGetFeature Recalibrate State = 0x%x\n", pReport->State);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanRecalibrateReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanRecalibrateReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_HEALTH:
+			{
+
+				ElanHealthReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanHealthReport))
+				{
+					pReport = (ElanHealthReport*)transferPacket->reportBuffer;
+
+					pReport->Recovering = DevContext->HealthRecovering;
+					pReport->Strikes = (BYTE)DevContext->HealthStrikes;
+					pReport->Reserved = 0;
+					pReport->Interrupts = DevContext->HealthStats.Interrupts;
+					pReport->SpuriousInterrupts = DevContext->HealthStats.SpuriousInterrupts;
+					pReport->BadFrames = DevContext->HealthStats.BadFrames;
+					pReport->Trips = DevContext->HealthStats.Trips;
+					pReport->RateLimits = DevContext->HealthStats.RateLimits;
+					pReport->Resets = DevContext->HealthStats.Resets;
+					pReport->ResetFailures = DevContext->HealthStats.ResetFailures;
+					pReport->StuckReleases = DevContext->HealthStats.StuckReleases;
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanGetFeature Health Trips = %d\n", pReport->Trips);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanHealthReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanHealthReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_COST:
+			{
+
+				ElanCostReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanCostReport))
+				{
+					pReport = (ElanCostReport*)transferPacket->reportBuffer;
+
+					ElanFillCostReport(DevContext, pReport);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanGetFeature Cost Frames = %d, latency %dus interrupt, %dus polling\n", pReport->Frames,
+						pReport->AcqLatencyAverageUs[COST_ACQ_INTERRUPT], pReport->AcqLatencyAverageUs[COST_ACQ_POLLING]);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanCostReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanCostReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_DIAG:
+			{
+
+				ElanDiagReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanDiagReport))
+				{
+					pReport = (ElanDiagReport*)transferPacket->reportBuffer;
+
+					ElanFillDiagReport(DevContext, pReport);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanGetFeature Diag State = 0x%x\n", pReport->State);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanDiagReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanDiagReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_COUNTERS:
+			{
+
+				ElanCountersReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanCountersReport))
+				{
+					pReport = (ElanCountersReport*)transferPacket->reportBuffer;
+
+					ElanFillCountersReport(DevContext, pReport);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanGetFeature Counters Frames = %lld\n", pReport->Frames);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanCountersReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanCountersReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_TRACE:
+			{
+
+				ElanTraceReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(ElanTraceReport))
+				{
+					pReport = (ElanTraceReport*)transferPacket->reportBuffer;
+
+					ElanFillTraceReport(DevContext, pReport);
+
+					ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"ElanGetFeature Trace Count = %d\n", pReport->Count);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"ElanGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(ElanTraceReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(ElanTraceReport));
+				}
+
+				break;
+			}
+
 			default:
 
 				ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
@@ -20,6 +20,7 @@
 #include "spb.h"
 
 #include "elants.h"
+#include "filter.h"
 
 //
 // String definitions
@@ -44,15 +45,13 @@
     0x95, 0x06,                         /*       REPORT_COUNT (6)           */ \
     0x81, 0x03,                         /*       INPUT (Cnst,Ary,Abs)       */ \
     0x75, 0x08,                         /*       REPORT_SIZE (8)            */ \
+    0x25, MULTI_MAX_COUNT - 1,          /*       LOGICAL_MAXIMUM (9)        */ \
     0x09, 0x51,                         /*       USAGE (Contact Identifier) */ \
     0x95, 0x01,                         /*       REPORT_COUNT (1)           */ \
     0x81, 0x02,                         /*       INPUT (Data,Var,Abs)       */ \
     0x05, 0x01,                         /*       USAGE_PAGE (Generic Desk.. */ \
     0x75, 0x10,                         /*       REPORT_SIZE (16)           */ \
-    0x55, 0x00,                         /*       UNIT_EXPONENT (0)          */ \
-    0x65, 0x00,                         /*       UNIT (None)                */ \
-    0x35, 0x00,                         /*       PHYSICAL_MINIMUM (0)       */ \
-    0x46, 0x00, 0x00,                   /*       PHYSICAL_MAXIMUM (0)       */ 
+    0x35, 0x00,                         /*       PHYSICAL_MINIMUM (0)       */ 
 
 
 //0x26, 0x56, 0x05,                   /*       LOGICAL_MAXIMUM (1366)    */
@@ -66,11 +65,28 @@
 #define MT_TOUCH_COLLECTION2												\
     0x09, 0x31,                         /*       USAGE (Y)                  */ \
     0x81, 0x02,                         /*       INPUT (Data,Var,Abs)       */ \
-    0x05, 0x0d,                         /*       USAGE PAGE (Digitizers)    */ \
+    0x05, 0x0d,                         /*       USAGE PAGE (Digitizers)    */ 
+
+#define MT_TOUCH_COLLECTION3												\
     0x09, 0x48,                         /*       USAGE (Width)              */ \
     0x81, 0x02,                         /*       INPUT (Data,Var,Abs)       */ \
     0x09, 0x49,                         /*       USAGE (Height)             */ \
-    0x81, 0x02,                         /*       INPUT (Data,Var,Abs)       */ \
+    0x81, 0x02,                         /*       INPUT (Data,Var,Abs)       */ 
+
+//
+// Units are global items, clear the ones set for the contact size so they
+// do not carry into Tip Pressure or the next contact's switches
+//
+#define MT_TOUCH_UNIT_RESET												\
+    0x55, 0x00,                         /*       UNIT_EXPONENT (0)          */ \
+    0x65, 0x00,                         /*       UNIT (None)                */ \
+    0x46, 0x00, 0x00,                   /*       PHYSICAL_MAXIMUM (0)       */ 
+
+#define MT_TOUCH_PRESSURE													\
+    0x09, 0x30,                         /*       USAGE (Tip Pressure)       */ \
+    0x81, 0x02,                         /*       INPUT (Data,Var,Abs)       */ 
+
+#define MT_TOUCH_COLLECTION_END											\
     0xc0,                               /*    END_COLLECTION                */
 
 #if 0
@@ -78,60 +94,68 @@
 0x26, 0x00, 0x03,                   /*       LOGICAL_MAXIMUM (768)    */
 #endif
 
-#define MT_REF_TOUCH_COLLECTION												\
-	MT_TOUCH_COLLECTION0 \
-	0x26, 0x00, 0x00,                   /*       LOGICAL_MAXIMUM (1366)    */ \
-	MT_TOUCH_COLLECTION1 \
-	0x26, 0x00, 0x00,                   /*       LOGICAL_MAXIMUM (768)    */ \
-	MT_TOUCH_COLLECTION2 \
-
 #define USAGE_PAGE \
 	0x05, 0x0d,                         /*    USAGE_PAGE (Digitizers) */  \
 	0x09, 0x54,                         /*    USAGE (Contact Count) */  \
 	0x95, 0x01,                         /*    REPORT_COUNT (1) */  \
 	0x75, 0x08,                         /*    REPORT_SIZE (8) */  \
 	0x15, 0x00,                         /*    LOGICAL_MINIMUM (0) */  \
-	0x25, 0x08,                         /*    LOGICAL_MAXIMUM (8) */  \
+	0x25, MULTI_MAX_COUNT,              /*    LOGICAL_MAXIMUM (10) */  \
 	0x81, 0x02,                         /*    INPUT (Data,Var,Abs) */  \
 	0x09, 0x55,                         /*    USAGE(Contact Count Maximum) */  \
 	0xb1, 0x02,                         /*    FEATURE (Data,Var,Abs) */  \
 
-									//
-									// This is the default report descriptor for the Hid device provided
-									// by the mini driver in response to IOCTL_HID_GET_REPORT_DESCRIPTOR.
-									// 
+#define VENDOR_COLLECTION \
+	0x06, 0x00, 0xff,                   /* USAGE_PAGE (Vendor Defined Page 1) */ \
+	0x09, 0x01,                         /* USAGE (Vendor Usage 1) */ \
+	0xa1, 0x01,                         /* COLLECTION (Application) */ \
+	0x15, 0x00,                         /*   LOGICAL_MINIMUM (0) */ \
+	0x26, 0xff, 0x00,                   /*   LOGICAL_MAXIMUM (255) */ \
+	0x75, 0x08,                         /*   REPORT_SIZE (8) */ \
+	0x85, REPORTID_FWUPDATE,            /*   REPORT_ID (Firmware Update) */ \
+	0x09, 0x02,                         /*   USAGE (Vendor Usage 2) */ \
+	0x95, sizeof(ElanFwUpdateReport) - 1, /*   REPORT_COUNT */ \
+	0xb1, 0x02,                         /*   FEATURE (Data,Var,Abs) */ \
+	0x85, REPORTID_RECALIBRATE,         /*   REPORT_ID (Recalibrate) */ \
+	0x09, 0x03,                         /*   USAGE (Vendor Usage 3) */ \
+	0x95, sizeof(ElanRecalibrateReport) - 1, /*   REPORT_COUNT */ \
+	0xb1, 0x02,                         /*   FEATURE (Data,Var,Abs) */ \
+	0x85, REPORTID_HEALTH,              /*   REPORT_ID (Health) */ \
+	0x09, 0x04,                         /*   USAGE (Vendor Usage 4) */ \
+	0x95, sizeof(ElanHealthReport) - 1, /*   REPORT_COUNT */ \
+	0xb1, 0x02,                         /*   FEATURE (Data,Var,Abs) */ \
+	0x85, REPORTID_TRACE,               /*   REPORT_ID (Trace) */ \
+	0x09, 0x05,                         /*   USAGE (Vendor Usage 5) */ \
+	0x95, sizeof(ElanTraceReport) - 1,  /*   REPORT_COUNT */ \
+	0xb1, 0x02,                         /*   FEATURE (Data,Var,Abs) */ \
+	0x85, REPORTID_COUNTERS,            /*   REPORT_ID (Counters) */ \
+	0x09, 0x06,                         /*   USAGE (Vendor Usage 6) */ \
+	0x95, sizeof(ElanCountersReport) - 1, /*   REPORT_COUNT */ \
+	0xb1, 0x02,                         /*   FEATURE (Data,Var,Abs) */ \
+	0x85, REPORTID_COST,                /*   REPORT_ID (CPU Cost) */ \
+	0x09, 0x07,                         /*   USAGE (Vendor Usage 7) */ \
+	0x95, sizeof(ElanCostReport) - 1,   /*   REPORT_COUNT */ \
+	0xb1, 0x02,                         /*   FEATURE (Data,Var,Abs) */ \
+	0x85, REPORTID_DIAG,                /*   REPORT_ID (Diagnostic Read) */ \
+	0x09, 0x08,                         /*   USAGE (Vendor Usage 8) */ \
+	0x95, sizeof(ElanDiagReport) - 1,   /*   REPORT_COUNT */ \
+	0xb1, 0x02,                         /*   FEATURE (Data,Var,Abs) */ \
+	0xc0,                               /* END_COLLECTION */
 
-	typedef UCHAR HID_REPORT_DESCRIPTOR, *PHID_REPORT_DESCRIPTOR;
+//
+// The report descriptor is built from the pieces above once the panel
+// geometry is known and is served from the device context afterwards.
+//
 
-#ifdef DESCRIPTOR_DEF
-HID_REPORT_DESCRIPTOR DefaultReportDescriptor[] = {
-	//
-	// Multitouch report starts here
-	//
-	0x05, 0x0d,                         // USAGE_PAGE (Digitizers)
-	0x09, 0x04,                         // USAGE (Touch Screen)
-	0xa1, 0x01,                         // COLLECTION (Application)
-	0x85, REPORTID_MTOUCH,              //   REPORT_ID (Touch)
-	0x09, 0x22,                         //   USAGE (Finger)
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	MT_REF_TOUCH_COLLECTION
-	USAGE_PAGE
-	0xc0,                               // END_COLLECTION
-};
+typedef UCHAR HID_REPORT_DESCRIPTOR, *PHID_REPORT_DESCRIPTOR;
 
+#define ELAN_REPORT_DESCRIPTOR_MAX	1024
 
+#ifdef DESCRIPTOR_DEF
 //
 // This is the default HID descriptor returned by the mini driver
-// in response to IOCTL_HID_GET_DEVICE_DESCRIPTOR. The size
-// of report descriptor is currently the size of DefaultReportDescriptor.
+// in response to IOCTL_HID_GET_DEVICE_DESCRIPTOR. The size of the
+// report descriptor is filled in from ReportDescriptorLength.
 //
 
 CONST HID_DESCRIPTOR DefaultHidDescriptor = {
@@ -141,18 +165,424 @@ CONST HID_DESCRIPTOR DefaultHidDescriptor = {
 	0x00,   // country code == Not Specified
 	0x01,   // number of HID class descriptors
 	{ 0x22,   // descriptor type 
-	sizeof(DefaultReportDescriptor) }  // total length of report descriptor
+	0 }     // total length of report descriptor
 };
 #endif
 
 #define true 1
 #define false 0
 
+//
+// Inactivity governor. After IdleTimeoutMs without any contact the
+// controller is put into its sleep scan state and is brought back to full
+// rate by the next interrupt. The firmware already scans slower on its
+// own when idle, and not every part raises INT on touch while asleep, so
+// this is off unless the profile enables it for a part known to wake.
+//
+
+#define ELAN_IDLE_TIMEOUT_MS	0
+
+//
+// Reads per interrupt while the controller reports queued data with
+// QUEUE_HEADER_WAIT, and the settle time between them.
+//
+
+#define ELAN_QUEUE_MAX_READS	4
+#define ELAN_QUEUE_WAIT_DELAY_US	30
+
+//
+// The EKTH panels scan at roughly 120Hz
+//
+
+#define ELAN_SCAN_PERIOD_US	8333
+
+//
+// Hybrid acquisition. While contacts are down frames can be read on a
+// high resolution timer aligned to the scan period instead of taking one
+// passive interrupt per frame; after ELAN_POLL_IDLE_MS without contacts the
+// driver goes back to interrupts. A poll period of 0 keeps interrupt mode,
+// ELAN_SCAN_PERIOD_US is the natural choice otherwise.
+//
+
+#define ELAN_POLL_PERIOD_US	0
+#define ELAN_POLL_IDLE_MS	50
+
+enum elan_acquisition_mode {
+	ELAN_ACQ_INTERRUPT,
+	ELAN_ACQ_POLLING,
+	ELAN_ACQ_MODES
+};
+
+typedef struct _ELAN_ACQUISITION_STATS
+{
+	ULONG Frames[ELAN_ACQ_MODES];
+
+	ULONGLONG LatencyTotal[ELAN_ACQ_MODES];	// 100ns units, trigger to read complete
+
+	ULONGLONG LatencyMax[ELAN_ACQ_MODES];
+
+	ULONG ModeSwitches;
+
+	ULONG Reports;
+
+	ULONG DuplicatesSuppressed;
+} ELAN_ACQUISITION_STATS, *PELAN_ACQUISITION_STATS;
+
+typedef struct _ELAN_POWER_STATS
+{
+	ULONGLONG StateTimestamp;	// interrupt time of the last transition
+
+	ULONGLONG TimeInFullPower;	// 100ns units
+
+	ULONGLONG TimeInLowPower;	// 100ns units
+
+	ULONG SleepCount;
+
+	ULONG WakeCount;
+
+	ULONGLONG WakeLatencyTotal;	// 100ns units, interrupt to resume complete
+
+	ULONGLONG WakeLatencyMax;
+} ELAN_POWER_STATS, *PELAN_POWER_STATS;
+
+//
+// Firmware image loaded by the IAP engine. The controller's I2C address
+// is not exposed through SPB, so the IAP handshake uses the default one.
+//
+
+#define ELAN_FW_FILE_PATH	L"\\SystemRoot\\System32\\drivers\\elants_i2c.bin"
+#define ELAN_FW_MAX_SIZE	(ELAN_FW_PAGESIZE * 2048)
+#define ELAN_IAP_SEND_ID	0x10
+
+//
+// As in Linux elants_i2c the image ends with the remark ID of the panel it
+// was built for, little endian, 4 bytes from the end. Boot code from IAP
+// version 0x60 on reports the controller's own remark ID, and an update
+// outside recovery mode is refused unless the two match.
+//
+
+#define ELAN_FW_REMARK_ID_OFFSET	4
+#define ELAN_IAP_REMARK_ID_VERSION	0x60
+
+typedef struct _ELAN_FW_UPDATE_STATS
+{
+	NTSTATUS Status;
+
+	ULONG PageCount;
+
+	ULONG PagesWritten;
+
+	ULONGLONG ElapsedTime;	// 100ns units
+
+	ULONG RetryTotal;
+
+	ULONG RetryMax;
+
+	ULONG RetryMaxPage;
+
+	ULONG PagesRetried;
+} ELAN_FW_UPDATE_STATS, *PELAN_FW_UPDATE_STATS;
+
+//
+// Motion prediction defaults, the horizon is measured from the interrupt
+// that delivered the frame. A horizon of 0 reports raw positions.
+//
+
+#define ELAN_PREDICT_HORIZON_US	0
+#define ELAN_PREDICT_ALPHA	192
+#define ELAN_PREDICT_BETA	32
+
+//
+// Jitter filter defaults in controller counts, roughly 0.5mm to leave a
+// hold on the EKTH panels
+//
+
+#define ELAN_JITTER_HOLD_THRESHOLD	6
+#define ELAN_JITTER_MOVE_THRESHOLD	2
+#define ELAN_JITTER_SETTLE_FRAMES	4
+
+//
+// Identical consecutive reports are dropped, but at most this many in a
+// row so held contacts are still refreshed
+//
+
+#define ELAN_DUPLICATE_MAX	8
+
+//
+// Report Tip Pressure for every contact. The controller sends pressure
+// and contact size in every packet, so this only changes the HID layout.
+//
+
+#define ELAN_REPORT_PRESSURE	1
+
+//
+// Contacts that are not refreshed for this many scans are released by the
+// sweeper timer. The controller reports held contacts every scan. 0 disables
+// the sweeper.
+//
+
+#define ELAN_RELEASE_TIMEOUT_SCANS	12
+
+//
+// Tuning profile. Read once from the Settings subkey of the device's
+// hardware key when the device is added, with the defaults above for any
+// value that is missing or out of range, and never changed afterwards.
+// Flags are derived from the values so hot paths test a single bit.
+//
+
+#define ELAN_CONFIG_POLLING	0x01
+#define ELAN_CONFIG_COALESCE	0x02
+#define ELAN_CONFIG_PRESSURE	0x04
+#define ELAN_CONFIG_PREDICT	0x08
+#define ELAN_CONFIG_JITTER	0x10
+#define ELAN_CONFIG_SWEEP	0x20
+#define ELAN_CONFIG_IDLE	0x40
+
+typedef struct _ELAN_CONFIG
+{
+	ULONG Flags;
+
+	ULONG PollPeriodUs;	// acquisition
+
+	ULONG PollIdleMs;
+
+	ULONG DuplicateMax;	// coalescing
+
+	BOOLEAN ReportPressure;	// report shape
+
+	ELAN_PREDICTOR_CONFIG Predict;	// filtering
+
+	ELAN_JITTER_CONFIG Jitter;
+
+	ELAN_TRANSFORM_CONFIG Transform;
+
+	ULONG ReleaseTimeoutUs;
+
+	ULONG IdleTimeoutMs;	// power
+
+	ULONG BootDelayMs;	// boot
+
+	ULONG BootRetries;
+
+	ULONG Chip;	// 0 to use the quirks table, else elants_chip_id + 1
+} ELAN_CONFIG, *PELAN_CONFIG;
+
+//
+// Chip specializations. Each supported chip provides its boot query
+// sequence, run once the controller has said hello and which fills in the
+// panel geometry, and the frame decoder the ISR dispatches to.
+//
+
+#define ELAN_EKTF_MAX_X	(2240 - 1)
+#define ELAN_EKTF_MAX_Y	(1408 - 1)
+
+typedef struct _ELAN_CHIP_OPS
+{
+	const char* Name;
+
+	NTSTATUS (*Query)(struct _ELAN_CONTEXT* pDevice, uint16_t* phy_x, uint16_t* phy_y);
+
+	BOOLEAN (*Frame)(struct _ELAN_CONTEXT* pDevice, uint8_t* buf);
+} ELAN_CHIP_OPS, *PELAN_CHIP_OPS;
+
+//
+// Per part quirks. An entry is matched by ACPI hardware ID when the device
+// is added and refined by firmware ID at boot; a NULL hardware ID or a
+// firmware ID of 0 matches any part. The first match in ElanQuirks wins.
+//
+
+#define ELAN_QUIRK_GEOMETRY	0x01	// use the geometry below instead of querying it
+
+typedef struct _ELAN_QUIRK
+{
+	const char* Name;
+
+	PCWSTR HardwareId;
+
+	USHORT FwId;
+
+	UCHAR ChipId;	// elants_chip_id, selects the packet format
+
+	UCHAR Flags;
+
+	USHORT BootDelayMs;	// minimum, the profile may ask for longer
+
+	UCHAR QueueReads;	// reads per interrupt in buffer mode, 1 disables read ahead
+
+	USHORT MaxX;	// known good geometry, controller counts and millimeters
+
+	USHORT MaxY;
+
+	USHORT PhyX;
+
+	USHORT PhyY;
+} ELAN_QUIRK, *PELAN_QUIRK;
+
+//
+// Health monitor. Interrupts and frames are counted over a sliding window
+// of ELAN_HEALTH_BUCKETS buckets. Crossing the interrupt rate or bad frame
+// ratio threshold masks the line for ELAN_HEALTH_BACKOFF_MS; tripping again
+// within ELAN_HEALTH_STRIKE_MS resets and re-boots the controller.
+//
+
+#define ELAN_HEALTH_BUCKETS	8
+#define ELAN_HEALTH_BUCKET_MS	125
+#define ELAN_HEALTH_MAX_INTERRUPTS	1000	// per window
+#define ELAN_HEALTH_MIN_FRAMES	32
+#define ELAN_HEALTH_BAD_PERCENT	50
+#define ELAN_HEALTH_BACKOFF_MS	100
+#define ELAN_HEALTH_STRIKE_MS	5000
+#define ELAN_HEALTH_RESET_STRIKES	2
+
+typedef struct _ELAN_HEALTH_BUCKET
+{
+	ULONG Interrupts;
+
+	ULONG Frames;
+
+	ULONG BadFrames;
+} ELAN_HEALTH_BUCKET, *PELAN_HEALTH_BUCKET;
+
+typedef struct _ELAN_HEALTH_STATS
+{
+	ULONG Interrupts;
+
+	ULONG SpuriousInterrupts;	// nothing could be read
+
+	ULONG BadFrames;
+
+	ULONG Trips;
+
+	ULONG RateLimits;
+
+	ULONG Resets;
+
+	ULONG ResetFailures;
+
+	ULONG StuckReleases;	// contacts released by the sweeper
+} ELAN_HEALTH_STATS, *PELAN_HEALTH_STATS;
+
+//
+// Runtime counters. Updated with interlocked increments from any path;
+// the field order matches ElanCountersReport.
+//
+
+typedef struct _ELAN_COUNTERS
+{
+	volatile LONG64 Frames;	// frames read from the controller
+
+	volatile LONG64 Packets;	// touch packets decoded
+
+	volatile LONG64 ReportsDelivered;
+
+	volatile LONG64 QueueMisses;	// no read request pending from HIDclass
+
+	volatile LONG64 ReportErrors;	// read request buffer could not be used
+
+	volatile LONG64 SpbReadErrors;
+
+	volatile LONG64 SpbWriteErrors;
+
+	volatile LONG64 EmptyInterrupts;
+
+	volatile LONG64 BadChecksums;
+
+	volatile LONG64 UnknownPackets;
+
+	volatile LONG64 BadWaitPackets;
+
+	volatile LONG64 BadReportCounts;
+
+	volatile LONG64 BadReportLengths;
+
+	volatile LONG64 UnknownHeaders;
+} ELAN_COUNTERS, *PELAN_COUNTERS;
+
+#define ElanCount(pDevice, Counter) InterlockedIncrement64(&(pDevice)->Counters.Counter)
+
+//
+// CPU cost accounting. Frames are timed per stage with the time stamp
+// counter and summed over windows of ELAN_COST_WINDOW_MS; the last
+// complete window is published. Updated under the interrupt lock.
+//
+
+#define ELAN_COST_WINDOW_MS	1000
+
+typedef struct _ELAN_COST_WINDOW
+{
+	ULONG Frames;
+
+	ULONGLONG Cycles[COST_STAGES];
+
+	ULONGLONG MaxCycles[COST_STAGES];
+
+	ULONGLONG ElapsedCycles;
+} ELAN_COST_WINDOW, *PELAN_COST_WINDOW;
+
+//
+// Binary trace ring. Must be a power of two.
+//
+
+#define ELAN_TRACE_ENTRIES	1024
+
+//
+// Asynchronous command channel
+//
+
+#define ELAN_CMD_QUEUE_DEPTH	8
+#define ELAN_CMD_MAX_SIZE	6
+#define ELAN_CMD_TIMEOUT_MS	100
+
+struct _ELAN_CONTEXT;
+
+typedef VOID ELAN_COMMAND_CALLBACK(
+	struct _ELAN_CONTEXT* pDevice,
+	NTSTATUS Status,
+	uint8_t* Response,	// frame holding the response, NULL on failure
+	PVOID Context
+);
+typedef ELAN_COMMAND_CALLBACK *PELAN_COMMAND_CALLBACK;
+
+typedef struct _ELAN_COMMAND
+{
+	uint8_t Cmd[ELAN_CMD_MAX_SIZE];
+
+	uint8_t CmdSize;
+
+	uint8_t Expect[HEADER_SIZE];	// leading response bytes, none for writes
+
+	uint8_t ExpectSize;
+
+	ULONG TimeoutMs;
+
+	PELAN_COMMAND_CALLBACK Callback;
+
+	PVOID Context;
+} ELAN_COMMAND, *PELAN_COMMAND;
+
 typedef struct _ELAN_CONTEXT
 {
 
 	WDFDEVICE FxDevice;
 
+	ELAN_CONFIG Config;	// written by ElanLoadConfig at device add only
+
+	PCWSTR HardwareId;	// matched quirks table ID
+
+	const ELAN_QUIRK* Quirk;
+
+	const ELAN_CHIP_OPS* Chip;
+
+	USHORT FwId;
+
+	USHORT FwVersion;
+
+	USHORT TestVersion;
+
+	USHORT BcVersion;
+
+	UCHAR QueueReads;
+
 	WDFQUEUE ReportQueue;
 
 	WDFQUEUE IdleQueue;
@@ -165,6 +595,8 @@ typedef struct _ELAN_CONTEXT
 
 	BOOLEAN ConnectInterrupt;
 
+	BOOLEAN ExitingD0;	// no new background work may take the line
+
 	BOOLEAN TouchScreenBooted;
 
 	BOOLEAN RegsSet;
@@ -179,15 +611,204 @@ typedef struct _ELAN_CONTEXT
 
 	USHORT    AREA[20];
 
+	USHORT    Pressure[20];
+
+	//
+	// Contacts with a non-zero Flags entry, in no particular order, and
+	// the lowest-free contact ID given to each slot while it is live
+	//
+	uint8_t   LiveSlots[MAX_CONTACT_NUM];
+
+	uint8_t   LiveCount;
+
+	uint8_t   ContactIds[MAX_CONTACT_NUM];
+
+	USHORT    ContactIdsInUse;
+
+	ULONGLONG ContactTime[MAX_CONTACT_NUM];	// last report of each slot
+
+	ULONGLONG FrameTime;	// trigger time of the frame being parsed
+
+	ELAN_PREDICTOR Predictors[MAX_CONTACT_NUM];
+
+	ELAN_JITTER_FILTER JitterFilters[MAX_CONTACT_NUM];
+
+	ELAN_TRANSFORM Transform;
+
+	struct _ELAN_MULTITOUCH_REPORT LastReport;
+
+	UCHAR DuplicateCount;
+
 	uint16_t max_x;
 	uint16_t max_y;
 
 	uint8_t max_x_hid[2];
 	uint8_t max_y_hid[2];
 
+	uint8_t unit_hid[2];	// UNIT_EXPONENT, UNIT
+	uint8_t phy_x_hid[2];
+	uint8_t phy_y_hid[2];
+	uint8_t phy_size_hid[2];
+
+	HID_REPORT_DESCRIPTOR ReportDescriptor[ELAN_REPORT_DESCRIPTOR_MAX];
+
+	USHORT ReportDescriptorLength;
+
+	WDFTIMER IdleTimer;
+
+	BOOLEAN LowPowerActive;
+
+	ELAN_POWER_STATS PowerStats;
+
+	uint8_t IapMode;
+
+	volatile LONG FwUpdateState;
+
+	ELAN_FW_UPDATE_STATS FwUpdateStats;
+
+	WDFWORKITEM FwUpdateWorkItem;
+
+	uint8_t State;	// enum elants_state
+
+	ELAN_COMMAND CmdQueue[ELAN_CMD_QUEUE_DEPTH];
+
+	uint8_t CmdHead;
+
+	uint8_t CmdCount;
+
+	BOOLEAN CmdInFlight;
+
+	ULONGLONG CmdDeadline;
+
+	WDFTIMER CmdTimer;
+
+	uint8_t DiagState;
+
+	NTSTATUS DiagStatus;
+
+	uint8_t DiagCommand[DIAG_COMMAND_SIZE];
+
+	uint8_t DiagResponse[DIAG_RESPONSE_SIZE];
+
+	BOOLEAN Polling;
+
+	BOOLEAN InterruptMasked;
+
+	ULONGLONG PollAnchor;
+
+	ULONGLONG PollDueTime;
+
+	ULONGLONG PollLastContact;
+
+	WDFTIMER PollTimer;
+
+	WDFWORKITEM PollWorkItem;
+
+	ELAN_ACQUISITION_STATS AcqStats;
+
+	ELAN_HEALTH_BUCKET HealthBuckets[ELAN_HEALTH_BUCKETS];
+
+	ULONG HealthBucket;
+
+	ULONGLONG HealthBucketStart;
+
+	BOOLEAN HealthRecovering;
+
+	ULONG HealthStrikes;
+
+	ULONGLONG HealthLastTrip;
+
+	WDFWORKITEM HealthWorkItem;
+
+	ELAN_HEALTH_STATS HealthStats;
+
+	BOOLEAN SweepArmed;
+
+	WDFTIMER SweepTimer;
+
+	ELAN_COUNTERS Counters;
+
+	ULONGLONG CostFrame[COST_STAGES];	// current frame
+
+	ELAN_COST_WINDOW CostWindow;
+
+	ELAN_COST_WINDOW CostPublished;
+
+	ULONGLONG CostWindowStart;
+
+	ULONGLONG CostWindowTsc;
+
+	volatile LONG TraceHead;
+
+	ULONG TraceCursor;
+
+	ELAN_TRACE_RECORD TraceRing[ELAN_TRACE_ENTRIES];
+
+	uint8_t RecalState;
+
+	NTSTATUS RecalStatus;
+
+	ULONGLONG RecalStartTime;
+
+	ULONGLONG RecalElapsed;
+
 } ELAN_CONTEXT, *PELAN_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(ELAN_CONTEXT, GetDeviceContext)
+
+C_ASSERT((ELAN_TRACE_ENTRIES & (ELAN_TRACE_ENTRIES - 1)) == 0);
+
+//
+// Records an event in the trace ring. Writers claim a slot with a single
+// interlocked increment and never wait, so this is safe from the ISR, the
+// SPB path and arbitrary IRQLs; when the ring wraps the oldest records
+// are overwritten.
+//
+FORCEINLINE
+VOID
+ElanTrace(
+	IN PELAN_CONTEXT pDevice,
+	IN USHORT EventId,
+	IN ULONG Arg0,
+	IN ULONG Arg1,
+	IN ULONG Arg2,
+	IN ULONG Arg3
+)
+{
+	ULONG sequence = (ULONG)InterlockedIncrement(&pDevice->TraceHead);
+	PELAN_TRACE_RECORD record = &pDevice->TraceRing[(sequence - 1) & (ELAN_TRACE_ENTRIES - 1)];
+
+	record->Sequence = 0;
+	KeMemoryBarrierWithoutFence();
+	record->Timestamp = KeQueryInterruptTime();
+	record->EventId = EventId;
+	record->Reserved = 0;
+	record->Args[0] = Arg0;
+	record->Args[1] = Arg1;
+	record->Args[2] = Arg2;
+	record->Args[3] = Arg3;
+	KeMemoryBarrierWithoutFence();
+	record->Sequence = sequence;
+}
+
+//
+// Packs the leading bytes of a transfer into a trace argument
+//
+FORCEINLINE
+ULONG
+ElanTraceBytes(
+	IN uint8_t* data,
+	IN size_t size
+)
+{
+	ULONG bytes = 0;
+
+	for (size_t i = 0; i < size && i < sizeof(bytes); i++)
+		bytes |= (ULONG)data[i] << (i * 8);
+
+	return bytes;
+}
+
 //
 // Power Idle Workitem context
 // 
@@ -218,6 +839,176 @@ EVT_WDFDEVICE_WDM_IRP_PREPROCESS ElanEvtWdmPreprocessMnQueryId;
 
 EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL ElanEvtInternalDeviceControl;
 
+EVT_WDF_TIMER ElanIdleTimerFunc;
+
+EVT_WDF_TIMER ElanCmdTimerFunc;
+
+EVT_WDF_TIMER ElanPollTimerFunc;
+
+EVT_WDF_TIMER ElanSweepTimerFunc;
+
+EVT_WDF_WORKITEM ElanPollWorkItem;
+
+EVT_WDF_WORKITEM ElanHealthWorkItem;
+
+EVT_WDF_WORKITEM ElanFwUpdateWorkItem;
+
+NTSTATUS
+BOOTTOUCHSCREEN(
+	_In_  PELAN_CONTEXT  devContext
+);
+
+NTSTATUS
+elants_i2c_send(
+	PELAN_CONTEXT pDevice,
+	uint8_t *data,
+	size_t size
+);
+
+NTSTATUS
+elants_i2c_read(
+	PELAN_CONTEXT pDevice,
+	uint8_t *data,
+	size_t size
+);
+
+NTSTATUS
+ElanStartFwUpdate(
+	IN PELAN_CONTEXT pDevice
+);
+
+VOID
+ElanClearContacts(
+	IN PELAN_CONTEXT pDevice
+);
+
+//
+// Command channel, command.cpp. The Locked routines and
+// ElanCommandResponse are called with the interrupt lock held.
+//
+
+uint8_t
+elants_i2c_expected_response(
+	IN uint8_t cmd
+);
+
+NTSTATUS
+ElanQueueCommandLocked(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* cmd,
+	IN size_t cmd_size,
+	IN const uint8_t* expect,
+	IN size_t expect_size,
+	IN ULONG timeoutMs,
+	IN PELAN_COMMAND_CALLBACK Callback,
+	IN PVOID Context
+);
+
+VOID
+ElanIssueCommands(
+	IN PELAN_CONTEXT pDevice
+);
+
+BOOLEAN
+ElanCommandResponse(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* buf
+);
+
+VOID
+ElanCancelCommands(
+	IN PELAN_CONTEXT pDevice
+);
+
+NTSTATUS
+ElanSubmitCommand(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* cmd,
+	IN size_t cmd_size,
+	IN PELAN_COMMAND_CALLBACK Callback,
+	IN PVOID Context
+);
+
+VOID
+ElanCommandTimeout(
+	IN PELAN_CONTEXT pDevice
+);
+
+NTSTATUS
+ElanStartDiagRead(
+	IN PELAN_CONTEXT pDevice,
+	IN const uint8_t* cmd
+);
+
+VOID
+ElanFillDiagReport(
+	IN PELAN_CONTEXT pDevice,
+	OUT ElanDiagReport* pReport
+);
+
+//
+// Frame decoder, decode.cpp. Called with the interrupt lock held.
+//
+
+BOOLEAN
+elants_i2c_frame_ekth3500(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* buf
+);
+
+BOOLEAN
+elants_i2c_frame_ektf3624(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* buf
+);
+
+VOID
+ElanBadFrame(
+	IN PELAN_CONTEXT pDevice,
+	IN ULONG reason,
+	IN uint8_t* buf
+);
+
+VOID
+ElanProcessInput(
+	IN PELAN_CONTEXT pDevice
+);
+
+//
+// Driver side of the decoder, elan.cpp
+//
+
+VOID
+ElanArmSweepTimer(
+	IN PELAN_CONTEXT pDevice
+);
+
+VOID
+ElanStopPolling(
+	IN PELAN_CONTEXT pDevice
+);
+
+NTSTATUS
+ElanStartRecalibration(
+	IN PELAN_CONTEXT pDevice
+);
+
+VOID
+ElanFillFwUpdateReport(
+	IN PELAN_CONTEXT pDevice,
+	OUT ElanFwUpdateReport* pReport
+);
+
+VOID
+ElanSaveCounters(
+	IN WDFDEVICE FxDevice
+);
+
+NTSTATUS
+ElanBuildReportDescriptor(
+	IN PELAN_CONTEXT pDevice
+);
+
 NTSTATUS
 ElanGetHidDescriptor(
 	IN WDFDEVICE Device,
@@ -300,7 +1091,7 @@ ElanCompleteIdleIrp(
 #if 0
 #define ElanPrint(dbglevel, dbgcatagory, fmt, ...) {          \
     if (ElanDebugLevel >= dbglevel &&                         \
-        (ElanDebugCatagories && dbgcatagory))                 \
+        (ElanDebugCatagories & dbgcatagory))                  \
 	    {                                                           \
         DbgPrint(DRIVERNAME);                                   \
         DbgPrint(fmt, __VA_ARGS__);                             \
@@ -2,6 +2,33 @@
 
 #define ELAN_TS_RESOLUTION(n, m)   (((n) - 1) * (m))
 
+/*
+ * Frame wire format, as read in one transfer by the interrupt handler:
+ *
+ *   QUEUE_HEADER_SINGLE   header with the packet length in FW_HDR_LENGTH,
+ *                         then one touch packet
+ *   QUEUE_HEADER_NORMAL*  header with FW_HDR_COUNT packets (1 to
+ *                         ELAN_MAX_REPORT_COUNT) totalling FW_HDR_LENGTH
+ *                         bytes, each PACKET_SIZE (or PACKET_SIZE_OLD on
+ *                         old eKTF firmware)
+ *   QUEUE_HEADER_WAIT     four QUEUE_HEADER_WAIT bytes, packets follow in
+ *                         the next read
+ *
+ * Touch packet (HEADER_REPORT_10_FINGER):
+ *
+ *   FW_POS_STATE       contact slot bits 0-7
+ *   FW_POS_STATE + 1   contact count in bits 0-3, slot bits 8-9 in bits 4-5
+ *   FW_POS_XY          3 bytes per slot: x[11:8] << 4 | y[11:8], x[7:0],
+ *                      y[7:0]
+ *   FW_POS_CHECKSUM    8-bit sum of bytes 0 to FW_POS_CHECKSUM - 1
+ *   FW_POS_WIDTH       1 byte per slot (a nibble per slot, even slots in
+ *                      the high nibble, on old eKTF firmware)
+ *   FW_POS_PRESSURE    1 byte per slot, absent on old eKTF firmware
+ *
+ * A slot whose bit is clear is a lifted contact; there is no separate
+ * release event. tools/gesture generates streams of such frames.
+ */
+
 /* FW header data */
 #define HEADER_SIZE		4
 #define FW_HDR_TYPE		0
@@ -42,6 +69,7 @@
 
 /* Header (4 bytes) plus 3 fill 10-finger packets */
 #define MAX_PACKET_SIZE		169
+#define ELAN_MAX_REPORT_COUNT	3
 
 #define BOOT_TIME_DELAY_MS	50
 
@@ -74,7 +102,7 @@
 
 enum elants_chip_id {
 	EKTH3500,
-	EKTF3624, //not supported
+	EKTF3624,
 };
 
 enum elants_state {
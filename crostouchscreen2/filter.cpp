@@ -0,0 +1,211 @@
+/*++
+
+Module Name:
+
+filter.cpp
+
+Abstract:
+
+Fixed point motion filters applied per contact before reports are
+assembled.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "filter.h"
+
+static int32_t ElanClamp(int64_t value, int64_t min, int64_t max) {
+	if (value < min)
+		return (int32_t)min;
+	if (value > max)
+		return (int32_t)max;
+	return (int32_t)value;
+}
+
+void
+ElanPredictorReset(
+	PELAN_PREDICTOR Predictor
+)
+{
+	Predictor->X = 0;
+	Predictor->Y = 0;
+	Predictor->VelX = 0;
+	Predictor->VelY = 0;
+	Predictor->Time = 0;
+	Predictor->Samples = 0;
+}
+
+static void ElanPredictorAxis(int32_t *pos, int32_t *vel, uint16_t measured, int64_t dtUs,
+	const ELAN_PREDICTOR_CONFIG* Config) {
+	int64_t predicted = *pos + (((int64_t)*vel * dtUs) >> 8);
+	int64_t residual = ((int64_t)measured << 8) - predicted;
+
+	*pos = (int32_t)(predicted + ((Config->Alpha * residual) >> 8));
+
+	if (dtUs > 0) {
+		*vel = ElanClamp(*vel + (Config->Beta * residual) / dtUs,
+			-ELAN_PREDICT_MAX_VELOCITY, ELAN_PREDICT_MAX_VELOCITY);
+	}
+}
+
+void
+ElanPredictorUpdate(
+	PELAN_PREDICTOR Predictor,
+	const ELAN_PREDICTOR_CONFIG* Config,
+	uint16_t x,
+	uint16_t y,
+	uint64_t time
+)
+{
+	int64_t dtUs = (int64_t)(time - Predictor->Time) / 10;
+
+	if (Predictor->Samples == 0 || dtUs > ELAN_PREDICT_MAX_GAP_US) {
+		Predictor->X = (int32_t)x << 8;
+		Predictor->Y = (int32_t)y << 8;
+		Predictor->VelX = 0;
+		Predictor->VelY = 0;
+		Predictor->Time = time;
+		Predictor->Samples = 1;
+		return;
+	}
+
+	//
+	// Packets drained from one buffer mode frame share a timestamp, those
+	// only correct the position.
+	//
+	ElanPredictorAxis(&Predictor->X, &Predictor->VelX, x, dtUs, Config);
+	ElanPredictorAxis(&Predictor->Y, &Predictor->VelY, y, dtUs, Config);
+
+	Predictor->Time = time;
+	if (Predictor->Samples < ELAN_PREDICT_MIN_SAMPLES)
+		Predictor->Samples++;
+}
+
+void
+ElanPredictorPredict(
+	const ELAN_PREDICTOR* Predictor,
+	const ELAN_PREDICTOR_CONFIG* Config,
+	uint16_t max_x,
+	uint16_t max_y,
+	uint16_t* x,
+	uint16_t* y
+)
+{
+	if (Config->HorizonUs == 0 || Predictor->Samples < ELAN_PREDICT_MIN_SAMPLES)
+		return;
+
+	int64_t px = Predictor->X + (((int64_t)Predictor->VelX * Config->HorizonUs) >> 8);
+	int64_t py = Predictor->Y + (((int64_t)Predictor->VelY * Config->HorizonUs) >> 8);
+
+	*x = (uint16_t)ElanClamp((px + 128) >> 8, 0, max_x);
+	*y = (uint16_t)ElanClamp((py + 128) >> 8, 0, max_y);
+}
+
+void
+ElanJitterReset(
+	PELAN_JITTER_FILTER Filter
+)
+{
+	Filter->X = 0;
+	Filter->Y = 0;
+	Filter->Valid = 0;
+	Filter->Moving = 0;
+	Filter->Still = 0;
+}
+
+void
+ElanJitterFilter(
+	PELAN_JITTER_FILTER Filter,
+	const ELAN_JITTER_CONFIG* Config,
+	uint16_t* x,
+	uint16_t* y
+)
+{
+	if (Config->HoldThreshold == 0)
+		return;
+
+	if (!Filter->Valid) {
+		Filter->X = *x;
+		Filter->Y = *y;
+		Filter->Valid = 1;
+		Filter->Moving = 0;
+		Filter->Still = 0;
+		return;
+	}
+
+	int32_t dx = (int32_t)*x - Filter->X;
+	int32_t dy = (int32_t)*y - Filter->Y;
+	if (dx < 0)
+		dx = -dx;
+	if (dy < 0)
+		dy = -dy;
+
+	int32_t distance = dx > dy ? dx : dy;
+	int32_t threshold = Filter->Moving ? Config->MoveThreshold : Config->HoldThreshold;
+
+	if (distance >= threshold && distance > 0) {
+		Filter->X = *x;
+		Filter->Y = *y;
+		Filter->Moving = 1;
+		Filter->Still = 0;
+		return;
+	}
+
+	if (Filter->Moving && ++Filter->Still >= Config->SettleFrames) {
+		Filter->Moving = 0;
+	}
+
+	*x = Filter->X;
+	*y = Filter->Y;
+}
+
+static uint16_t ElanTransformRow(int32_t *row, int column, uint16_t srcMax,
+	uint16_t logicalMax, uint8_t invert) {
+	uint16_t outMax = logicalMax ? logicalMax : srcMax;
+	if (outMax > ELAN_TRANSFORM_MAX_LOGICAL)
+		outMax = ELAN_TRANSFORM_MAX_LOGICAL;
+
+	int32_t scale = srcMax ? (int32_t)(((int64_t)outMax << 16) / srcMax) : (1 << 16);
+
+	row[0] = 0;
+	row[1] = 0;
+	row[column] = invert ? -scale : scale;
+	row[2] = (invert ? ((int32_t)outMax << 16) : 0) + (1 << 15);
+
+	return outMax;
+}
+
+void
+ElanTransformInit(
+	PELAN_TRANSFORM Transform,
+	const ELAN_TRANSFORM_CONFIG* Config,
+	uint16_t max_x,
+	uint16_t max_y
+)
+{
+	int xColumn = Config->SwapXY ? 1 : 0;
+	int yColumn = Config->SwapXY ? 0 : 1;
+
+	Transform->MaxX = ElanTransformRow(Transform->Matrix[0], xColumn,
+		Config->SwapXY ? max_y : max_x, Config->LogicalMaxX, Config->InvertX);
+	Transform->MaxY = ElanTransformRow(Transform->Matrix[1], yColumn,
+		Config->SwapXY ? max_x : max_y, Config->LogicalMaxY, Config->InvertY);
+}
+
+void
+ElanTransformApply(
+	const ELAN_TRANSFORM* Transform,
+	uint16_t* x,
+	uint16_t* y
+)
+{
+	const int32_t (*m)[3] = Transform->Matrix;
+	int64_t tx = ((int64_t)m[0][0] * *x + (int64_t)m[0][1] * *y + m[0][2]) >> 16;
+	int64_t ty = ((int64_t)m[1][0] * *x + (int64_t)m[1][1] * *y + m[1][2]) >> 16;
+
+	*x = (uint16_t)ElanClamp(tx, 0, Transform->MaxX);
+	*y = (uint16_t)ElanClamp(ty, 0, Transform->MaxY);
+}
@@ -0,0 +1,167 @@
+/*++
+
+Module Name:
+
+filter.h
+
+Abstract:
+
+Per contact motion filters used in the report path. They use fixed
+point arithmetic only and have no framework dependencies, so the same
+code can be built into an offline tool and run against recorded traces.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#pragma once
+
+#include "stdint.h"
+
+//
+// Alpha-beta motion predictor. Positions are kept in Q8 counts and
+// velocities in Q16 counts per microsecond. A contact is only predicted
+// once it has ELAN_PREDICT_MIN_SAMPLES reports, and gaps longer than
+// ELAN_PREDICT_MAX_GAP_US restart the estimate.
+//
+
+#define ELAN_PREDICT_MIN_SAMPLES	3
+#define ELAN_PREDICT_MAX_GAP_US	50000
+#define ELAN_PREDICT_MAX_VELOCITY	(4 << 16)
+
+typedef struct _ELAN_PREDICTOR_CONFIG
+{
+	uint32_t HorizonUs;	// 0 disables prediction
+
+	uint16_t Alpha;	// Q8 position gain
+
+	uint16_t Beta;	// Q8 velocity gain
+} ELAN_PREDICTOR_CONFIG, *PELAN_PREDICTOR_CONFIG;
+
+typedef struct _ELAN_PREDICTOR
+{
+	int32_t X;
+
+	int32_t Y;
+
+	int32_t VelX;
+
+	int32_t VelY;
+
+	uint64_t Time;	// 100ns units
+
+	uint8_t Samples;
+} ELAN_PREDICTOR, *PELAN_PREDICTOR;
+
+//
+// Jitter filter. A resting contact holds its position until it moves at
+// least HoldThreshold counts; a moving contact follows every move of
+// MoveThreshold counts or more and drops back into the hold after
+// SettleFrames reports below that.
+//
+
+typedef struct _ELAN_JITTER_CONFIG
+{
+	uint16_t HoldThreshold;	// 0 disables the filter
+
+	uint16_t MoveThreshold;
+
+	uint8_t SettleFrames;
+} ELAN_JITTER_CONFIG, *PELAN_JITTER_CONFIG;
+
+typedef struct _ELAN_JITTER_FILTER
+{
+	uint16_t X;
+
+	uint16_t Y;
+
+	uint8_t Valid;
+
+	uint8_t Moving;
+
+	uint8_t Still;
+} ELAN_JITTER_FILTER, *PELAN_JITTER_FILTER;
+
+//
+// Coordinate transform from controller axes to reported axes, kept as a
+// Q16 2x3 matrix. Flips apply to the reported axes after the swap, and a
+// logical maximum of 0 keeps the range of the source axis.
+//
+
+#define ELAN_TRANSFORM_MAX_LOGICAL	0x7FFF
+
+typedef struct _ELAN_TRANSFORM_CONFIG
+{
+	uint8_t SwapXY;
+
+	uint8_t InvertX;
+
+	uint8_t InvertY;
+
+	uint16_t LogicalMaxX;
+
+	uint16_t LogicalMaxY;
+} ELAN_TRANSFORM_CONFIG, *PELAN_TRANSFORM_CONFIG;
+
+typedef struct _ELAN_TRANSFORM
+{
+	int32_t Matrix[2][3];
+
+	uint16_t MaxX;	// reported logical maximum
+
+	uint16_t MaxY;
+} ELAN_TRANSFORM, *PELAN_TRANSFORM;
+
+void
+ElanPredictorReset(
+	PELAN_PREDICTOR Predictor
+);
+
+void
+ElanPredictorUpdate(
+	PELAN_PREDICTOR Predictor,
+	const ELAN_PREDICTOR_CONFIG* Config,
+	uint16_t x,
+	uint16_t y,
+	uint64_t time
+);
+
+void
+ElanPredictorPredict(
+	const ELAN_PREDICTOR* Predictor,
+	const ELAN_PREDICTOR_CONFIG* Config,
+	uint16_t max_x,
+	uint16_t max_y,
+	uint16_t* x,	// in: reported position, out: predicted position
+	uint16_t* y
+);
+
+void
+ElanJitterReset(
+	PELAN_JITTER_FILTER Filter
+);
+
+void
+ElanJitterFilter(
+	PELAN_JITTER_FILTER Filter,
+	const ELAN_JITTER_CONFIG* Config,
+	uint16_t* x,	// in: raw position, out: filtered position
+	uint16_t* y
+);
+
+void
+ElanTransformInit(
+	PELAN_TRANSFORM Transform,
+	const ELAN_TRANSFORM_CONFIG* Config,
+	uint16_t max_x,
+	uint16_t max_y
+);
+
+void
+ElanTransformApply(
+	const ELAN_TRANSFORM* Transform,
+	uint16_t* x,	// in: controller position, out: reported position
+	uint16_t* y
+);
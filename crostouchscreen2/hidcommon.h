@@ -16,6 +16,13 @@
 
 #define REPORTID_MTOUCH         0x01
 #define REPORTID_FEATURE        0x02
+#define REPORTID_FWUPDATE       0x03
+#define REPORTID_RECALIBRATE    0x04
+#define REPORTID_HEALTH         0x05
+#define REPORTID_TRACE          0x06
+#define REPORTID_COUNTERS       0x07
+#define REPORTID_COST           0x08
+#define REPORTID_DIAG           0x09
 
 //
 // Multitouch specific report information
@@ -45,6 +52,8 @@ typedef struct
 
 	USHORT    Height;
 
+	USHORT    Pressure;	// only sent when the descriptor declares it
+
 }
 TOUCH, *PTOUCH;
 
@@ -90,4 +99,328 @@ typedef struct _ELAN_MAXCOUNT_REPORT
 } ElanMaxCountReport;
 #pragma pack()
 
+//
+// Vendor firmware update report information
+//
+
+#define FWUPDATE_CMD_NONE        0x00
+#define FWUPDATE_CMD_START       0x01
+
+#define FWUPDATE_STATE_IDLE      0x00
+#define FWUPDATE_STATE_RUNNING   0x01
+#define FWUPDATE_STATE_DONE      0x02
+#define FWUPDATE_STATE_FAILED    0x03
+
+#pragma pack(1)
+typedef struct _ELAN_FWUPDATE_REPORT
+{
+
+	BYTE      ReportID;
+
+	BYTE      Command;
+
+	BYTE      State;
+
+	BYTE      IapMode;
+
+	ULONG     Status;
+
+	USHORT    PagesWritten;
+
+	USHORT    PageCount;
+
+	ULONG     ElapsedMs;
+
+	USHORT    RetryTotal;
+
+	USHORT    RetryMax;
+
+	USHORT    RetryMaxPage;
+
+	USHORT    PagesRetried;
+
+} ElanFwUpdateReport;
+#pragma pack()
+
+//
+// Vendor recalibration report information
+//
+
+#define RECALIBRATE_CMD_NONE     0x00
+#define RECALIBRATE_CMD_START    0x01
+
+#define RECALIBRATE_STATE_IDLE    0x00
+#define RECALIBRATE_STATE_RUNNING 0x01
+#define RECALIBRATE_STATE_DONE    0x02
+#define RECALIBRATE_STATE_FAILED  0x03
+
+#pragma pack(1)
+typedef struct _ELAN_RECALIBRATE_REPORT
+{
+
+	BYTE      ReportID;
+
+	BYTE      Command;
+
+	BYTE      State;
+
+	BYTE      Reserved;
+
+	ULONG     Status;
+
+	ULONG     ElapsedMs;
+
+} ElanRecalibrateReport;
+#pragma pack()
+
+//
+// Vendor health monitor report information
+//
+
+#pragma pack(1)
+typedef struct _ELAN_HEALTH_REPORT
+{
+
+	BYTE      ReportID;
+
+	BYTE      Recovering;
+
+	BYTE      Strikes;
+
+	BYTE      Reserved;
+
+	ULONG     Interrupts;
+
+	ULONG     SpuriousInterrupts;
+
+	ULONG     BadFrames;
+
+	ULONG     Trips;
+
+	ULONG     RateLimits;
+
+	ULONG     Resets;
+
+	ULONG     ResetFailures;
+
+	ULONG     StuckReleases;
+
+} ElanHealthReport;
+#pragma pack()
+
+//
+// Vendor trace report information
+//
+// Records are fixed size and little endian so a dumped ring can be decoded
+// off the device. Sequence is the 1-based position of the record in the
+// ring's history and is written last; a record whose Sequence does not
+// match the one the reader asked for was overwritten or torn and should
+// be dropped. Timestamp is interrupt time in 100ns units.
+// tools/trace/decode_trace formats dumped reports or rings on a host.
+//
+
+#define TRACE_EVENT_NONE         0x0000
+#define TRACE_EVENT_ISR          0x0001	// claimed, low power, polling, recovering
+#define TRACE_EVENT_SPB_WRITE    0x0002	// length, status, first four bytes
+#define TRACE_EVENT_SPB_READ     0x0003	// length, status, first four bytes
+#define TRACE_EVENT_BOOT         0x0004	// stage, status, stage data
+#define TRACE_EVENT_IOCTL        0x0005	// control code, status
+#define TRACE_EVENT_BAD_FRAME    0x0006	// reason, first four bytes
+#define TRACE_EVENT_REPORT       0x0007	// contacts, status
+#define TRACE_EVENT_HEALTH       0x0008	// strikes, action, status
+#define TRACE_EVENT_POLL         0x0009	// polling, period in us
+#define TRACE_EVENT_POWER        0x000A	// entering D0, status
+
+#define TRACE_BOOT_HELLO         0x01
+#define TRACE_BOOT_QUERY         0x02
+#define TRACE_BOOT_GEOMETRY      0x03	// max x << 16 | max y, phy x << 16 | phy y
+#define TRACE_BOOT_DONE          0x04
+#define TRACE_BOOT_FW_ID         0x05	// firmware ID
+#define TRACE_BOOT_VERSION       0x06	// firmware version, test << 16 | boot code version
+
+#define TRACE_FRAME_CHECKSUM     0x01
+#define TRACE_FRAME_PACKET_TYPE  0x02
+#define TRACE_FRAME_WAIT         0x03
+#define TRACE_FRAME_COUNT        0x04
+#define TRACE_FRAME_LENGTH       0x05
+#define TRACE_FRAME_HEADER       0x06
+#define TRACE_FRAME_NO_DATA      0x07
+
+#define TRACE_HEALTH_RATE_LIMIT  0x01
+#define TRACE_HEALTH_RESET       0x02
+
+#define TRACE_REPORT_RECORDS     7
+
+#pragma pack(1)
+typedef struct _ELAN_TRACE_RECORD
+{
+
+	ULONGLONG Timestamp;
+
+	ULONG     Sequence;
+
+	USHORT    EventId;
+
+	USHORT    Reserved;
+
+	ULONG     Args[4];
+
+} ELAN_TRACE_RECORD, *PELAN_TRACE_RECORD;
+
+//
+// Setting the report moves the read cursor to Cursor (0 rewinds to the
+// oldest record still held); each get returns up to TRACE_REPORT_RECORDS
+// records from the cursor and advances it.
+//
+
+typedef struct _ELAN_TRACE_REPORT
+{
+
+	BYTE      ReportID;
+
+	BYTE      Count;
+
+	USHORT    Capacity;
+
+	ULONG     Head;
+
+	ULONG     Cursor;
+
+	ELAN_TRACE_RECORD Records[TRACE_REPORT_RECORDS];
+
+} ElanTraceReport;
+#pragma pack()
+
+//
+// Vendor counters report information
+//
+// Counters run from driver load and are never reset.
+//
+
+#pragma pack(1)
+typedef struct _ELAN_COUNTERS_REPORT
+{
+
+	BYTE      ReportID;
+
+	ULONGLONG Frames;
+
+	ULONGLONG Packets;
+
+	ULONGLONG ReportsDelivered;
+
+	ULONGLONG QueueMisses;
+
+	ULONGLONG ReportErrors;
+
+	ULONGLONG SpbReadErrors;
+
+	ULONGLONG SpbWriteErrors;
+
+	ULONGLONG EmptyInterrupts;
+
+	ULONGLONG BadChecksums;
+
+	ULONGLONG UnknownPackets;
+
+	ULONGLONG BadWaitPackets;
+
+	ULONGLONG BadReportCounts;
+
+	ULONGLONG BadReportLengths;
+
+	ULONGLONG UnknownHeaders;
+
+} ElanCountersReport;
+#pragma pack()
+
+//
+// Vendor CPU cost report information
+//
+// Cycle counts are time stamp counter ticks for the last completed one
+// second window that saw input. ElapsedCycles is the length of that
+// window in the same ticks, so Total / ElapsedCycles is the CPU share of
+// each stage. Averages and maxima are per frame.
+//
+// The acquisition fields run from driver load and are split by how the
+// frame was triggered, by the interrupt or by the polling timer. Latency
+// is from the trigger to the completed read of the first frame, in
+// microseconds.
+//
+
+#define COST_STAGE_READ          0
+#define COST_STAGE_VALIDATE      1
+#define COST_STAGE_DECODE        2
+#define COST_STAGE_REPORT        3
+#define COST_STAGES              4
+
+#define COST_ACQ_INTERRUPT       0
+#define COST_ACQ_POLLING         1
+#define COST_ACQ_MODES           2
+
+#pragma pack(1)
+typedef struct _ELAN_COST_REPORT
+{
+
+	BYTE      ReportID;
+
+	BYTE      Reserved[3];
+
+	ULONG     Frames;
+
+	ULONGLONG ElapsedCycles;
+
+	ULONGLONG Total[COST_STAGES];
+
+	ULONG     Average[COST_STAGES];
+
+	ULONG     Max[COST_STAGES];
+
+	ULONG     AcqFrames[COST_ACQ_MODES];
+
+	ULONG     AcqLatencyAverageUs[COST_ACQ_MODES];
+
+	ULONG     AcqLatencyMaxUs[COST_ACQ_MODES];
+
+	ULONG     AcqModeSwitches;
+
+} ElanCostReport;
+#pragma pack()
+
+//
+// Vendor diagnostic read report information
+//
+// Setting the report sends Command, a register read with header 0x53,
+// to the controller while touch reporting goes on. Getting it returns the
+// state of the last read and the leading bytes of the controller's
+// response.
+//
+
+#define DIAG_STATE_IDLE          0x00
+#define DIAG_STATE_RUNNING       0x01
+#define DIAG_STATE_DONE          0x02
+#define DIAG_STATE_FAILED        0x03
+
+#define DIAG_COMMAND_SIZE        4
+#define DIAG_RESPONSE_SIZE       4
+
+#pragma pack(1)
+typedef struct _ELAN_DIAG_REPORT
+{
+
+	BYTE      ReportID;
+
+	BYTE      State;
+
+	BYTE      Reserved[2];
+
+	ULONG     Status;
+
+	BYTE      Command[DIAG_COMMAND_SIZE];
+
+	BYTE      Response[DIAG_RESPONSE_SIZE];
+
+} ElanDiagReport;
+#pragma pack()
+
 #endif
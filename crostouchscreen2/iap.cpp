@@ -0,0 +1,423 @@
+/*++
+
+Module Name:
+
+iap.cpp
+
+Abstract:
+
+In-application programming (IAP) engine used to update the
+controller firmware from an image on disk. Outside recovery mode the
+image's remark ID is checked against the controller's before anything
+is erased.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "elan.h"
+
+static const ULONG ElanDebugLevel = 100;
+static const ULONG ElanDebugCatagories = DBG_INIT | DBG_PNP | DBG_IOCTL;
+
+static void ElanIapDelay(ULONG ms) {
+	LARGE_INTEGER delay;
+	delay.QuadPart = -10 * 1000 * (LONGLONG)ms;
+	KeDelayExecutionThread(KernelMode, FALSE, &delay);
+}
+
+static NTSTATUS ElanFwLoadImage(WDFMEMORY *Memory, uint8_t **Image, ULONG *Size) {
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES attributes;
+	IO_STATUS_BLOCK ioStatus;
+	FILE_STANDARD_INFORMATION info;
+	HANDLE file;
+	NTSTATUS status;
+
+	*Memory = NULL;
+
+	RtlInitUnicodeString(&path, ELAN_FW_FILE_PATH);
+	InitializeObjectAttributes(&attributes, &path,
+		OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+
+	status = ZwCreateFile(&file, GENERIC_READ | SYNCHRONIZE, &attributes, &ioStatus,
+		NULL, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_OPEN,
+		FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT, NULL, 0);
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Unable to open firmware image 0x%x\n", status);
+		return status;
+	}
+
+	status = ZwQueryInformationFile(file, &ioStatus, &info, sizeof(info), FileStandardInformation);
+	if (!NT_SUCCESS(status)) {
+		goto exit;
+	}
+
+	if (info.EndOfFile.QuadPart == 0 ||
+		info.EndOfFile.QuadPart > ELAN_FW_MAX_SIZE ||
+		info.EndOfFile.QuadPart % ELAN_FW_PAGESIZE) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Invalid firmware size %lld\n", info.EndOfFile.QuadPart);
+		status = STATUS_INVALID_IMAGE_FORMAT;
+		goto exit;
+	}
+
+	*Size = info.EndOfFile.LowPart;
+
+	//
+	// The whole image is read up front so that the next page is always
+	// resident while the controller acknowledges the current one.
+	//
+	status = WdfMemoryCreate(WDF_NO_OBJECT_ATTRIBUTES, NonPagedPool, ELAN_POOL_TAG,
+		*Size, Memory, (PVOID *)Image);
+	if (!NT_SUCCESS(status)) {
+		goto exit;
+	}
+
+	status = ZwReadFile(file, NULL, NULL, NULL, &ioStatus, *Image, *Size, NULL, NULL);
+	if (NT_SUCCESS(status) && ioStatus.Information != *Size) {
+		status = STATUS_END_OF_FILE;
+	}
+
+exit:
+	ZwClose(file);
+
+	if (!NT_SUCCESS(status) && *Memory != NULL) {
+		WdfObjectDelete(*Memory);
+		*Memory = NULL;
+	}
+	return status;
+}
+
+static NTSTATUS elants_i2c_fw_write_page(PELAN_CONTEXT pDevice, uint8_t *page, ULONG *retries) {
+	const uint8_t ack_ok[] = { 0xaa, 0xaa };
+	uint8_t buf[2];
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+	for (*retries = 0; *retries < MAX_FW_UPDATE_RETRIES; (*retries)++) {
+		status = elants_i2c_send(pDevice, page, ELAN_FW_PAGESIZE);
+		if (!NT_SUCCESS(status)) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "IAP write page failed 0x%x\n", status);
+			continue;
+		}
+
+		status = elants_i2c_read(pDevice, buf, sizeof(buf));
+		if (!NT_SUCCESS(status)) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "IAP ack read failed 0x%x\n", status);
+			continue;
+		}
+
+		if (!memcmp(buf, ack_ok, sizeof(ack_ok))) {
+			return STATUS_SUCCESS;
+		}
+
+		status = STATUS_DEVICE_DATA_ERROR;
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "IAP ack incorrect: %02x %02x\n", buf[0], buf[1]);
+	}
+
+	return status;
+}
+
+//
+// BcVersion holds the raw answer bytes; Linux derives the IAP version
+// from the same nibbles
+//
+static BOOLEAN elants_i2c_should_check_remark_id(PELAN_CONTEXT pDevice) {
+	UCHAR iap_version = (UCHAR)(pDevice->BcVersion >> 4);
+
+	return iap_version >= ELAN_IAP_REMARK_ID_VERSION;
+}
+
+static NTSTATUS elants_i2c_validate_remark_id(PELAN_CONTEXT pDevice, uint8_t *image, ULONG size) {
+	uint8_t cmd[] = { CMD_HEADER_ROM_READ, 0x80, 0x1F, 0x00, 0x00, 0x21 };
+	uint8_t resp[6];
+	NTSTATUS status;
+
+	status = elants_i2c_send(pDevice, cmd, sizeof(cmd));
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed to send remark ID read 0x%x\n", status);
+		return status;
+	}
+
+	ElanIapDelay(ELAN_RESET_DELAY_MSEC);
+
+	status = elants_i2c_read(pDevice, resp, sizeof(resp));
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed to read remark ID 0x%x\n", status);
+		return status;
+	}
+
+	if (resp[0] != CMD_HEADER_ROM_RESP) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Unexpected remark ID answer: 0x%x 0x%x 0x%x 0x%x\n",
+			resp[0], resp[1], resp[2], resp[3]);
+		return STATUS_DEVICE_DATA_ERROR;
+	}
+
+	USHORT ts_remark_id = (resp[3] << 8) | resp[4];
+	USHORT fw_remark_id = image[size - ELAN_FW_REMARK_ID_OFFSET] |
+		(image[size - ELAN_FW_REMARK_ID_OFFSET + 1] << 8);
+
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "Remark ID: controller 0x%04x, image 0x%04x\n",
+		ts_remark_id, fw_remark_id);
+
+	if (ts_remark_id != fw_remark_id) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Image is not built for this panel\n");
+		return STATUS_REVISION_MISMATCH;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+static NTSTATUS elants_i2c_do_update_firmware(PELAN_CONTEXT pDevice, uint8_t *image, ULONG size, BOOLEAN force) {
+	uint8_t enter_iap[] = { 0x45, 0x49, 0x41, 0x50 };
+	uint8_t enter_iap2[] = { 0x54, 0x00, 0x12, 0x34 };
+	const uint8_t iap_ack[] = { 0x55, 0xaa, 0x33, 0xcc };
+	uint8_t close_idle[] = { 0x54, 0x2c, 0x01, 0x01 };
+	uint8_t soft_rst_cmd[] = { 0x77, 0x77, 0x77, 0x77 };
+	uint8_t send_id = ELAN_IAP_SEND_ID;
+	uint8_t buf[HEADER_SIZE];
+	PELAN_FW_UPDATE_STATS stats = &pDevice->FwUpdateStats;
+	NTSTATUS status;
+
+	if (force) {
+		ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "Recovery mode procedure\n");
+
+		status = elants_i2c_send(pDevice, enter_iap2, sizeof(enter_iap2));
+	}
+	else {
+		ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "Normal IAP procedure\n");
+
+		status = elants_i2c_send(pDevice, close_idle, sizeof(close_idle));
+		if (!NT_SUCCESS(status)) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed close idle 0x%x\n", status);
+		}
+		ElanIapDelay(60);
+
+		elants_i2c_send(pDevice, soft_rst_cmd, sizeof(soft_rst_cmd));
+		ElanIapDelay(ELAN_RESET_DELAY_MSEC);
+
+		//
+		// Nothing is erased yet, a controller refusing the image is
+		// booted back into its own firmware. Recovery mode skips this so
+		// a controller without firmware can always be flashed.
+		//
+		if (elants_i2c_should_check_remark_id(pDevice)) {
+			status = elants_i2c_validate_remark_id(pDevice, image, size);
+			if (!NT_SUCCESS(status)) {
+				return status;
+			}
+		}
+
+		status = elants_i2c_send(pDevice, enter_iap, sizeof(enter_iap));
+	}
+
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed to enter IAP mode 0x%x\n", status);
+		return status;
+	}
+
+	ElanIapDelay(20);
+
+	status = elants_i2c_read(pDevice, buf, sizeof(buf));
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed to read IAP acknowledgement 0x%x\n", status);
+		return status;
+	}
+
+	if (memcmp(buf, iap_ack, sizeof(iap_ack))) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed to enter IAP: 0x%x 0x%x 0x%x 0x%x\n", buf[0], buf[1], buf[2], buf[3]);
+		return STATUS_DEVICE_DATA_ERROR;
+	}
+
+	status = elants_i2c_send(pDevice, &send_id, 1);
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Sending dummy byte failed 0x%x\n", status);
+		return status;
+	}
+
+	//
+	// Clear the last page of Master
+	//
+	status = elants_i2c_send(pDevice, image, ELAN_FW_PAGESIZE);
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Clearing of the last page failed 0x%x\n", status);
+		return status;
+	}
+
+	status = elants_i2c_read(pDevice, buf, 2);
+	if (!NT_SUCCESS(status)) {
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed to read ACK for clearing the last page 0x%x\n", status);
+		return status;
+	}
+
+	stats->PageCount = size / ELAN_FW_PAGESIZE;
+
+	for (ULONG page = 0; page < stats->PageCount; page++) {
+		ULONG retries;
+
+		status = elants_i2c_fw_write_page(pDevice, image + page * ELAN_FW_PAGESIZE, &retries);
+
+		stats->RetryTotal += retries;
+		if (retries > 0) {
+			stats->PagesRetried++;
+		}
+		if (retries > stats->RetryMax) {
+			stats->RetryMax = retries;
+			stats->RetryMaxPage = page;
+		}
+
+		if (!NT_SUCCESS(status)) {
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Failed to write FW page %d: 0x%x\n", page, status);
+			return status;
+		}
+
+		stats->PagesWritten = page + 1;
+	}
+
+	//
+	// Old IAP needs to wait 200ms for WDT and the rest is for hello packets
+	//
+	ElanIapDelay(300);
+
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "Firmware update completed\n");
+	return status;
+}
+
+VOID
+ElanFwUpdateWorkItem(
+	IN WDFWORKITEM FwUpdateWorkItem
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(FwUpdateWorkItem);
+	PELAN_CONTEXT pDevice = GetDeviceContext(Device);
+	WDFMEMORY imageMemory;
+	uint8_t *image;
+	ULONG size;
+	NTSTATUS status;
+
+	ULONGLONG startTime = KeQueryInterruptTime();
+
+	status = ElanFwLoadImage(&imageMemory, &image, &size);
+	if (NT_SUCCESS(status)) {
+		//
+		// Keep the interrupt path and the idle governor off the bus while
+		// the controller is in boot code mode.
+		//
+		ElanStopPolling(pDevice);
+		WdfTimerStop(pDevice->IdleTimer, TRUE);
+		WdfInterruptDisable(pDevice->Interrupt);
+
+		WdfInterruptAcquireLock(pDevice->Interrupt);
+		pDevice->TouchScreenBooted = false;
+		ElanCancelCommands(pDevice);
+		WdfInterruptReleaseLock(pDevice->Interrupt);
+		WdfTimerStop(pDevice->CmdTimer, TRUE);
+
+		BOOLEAN recovery = pDevice->IapMode == ELAN_IAP_RECOVERY;
+
+		status = elants_i2c_do_update_firmware(pDevice, image, size, recovery);
+		if (!NT_SUCCESS(status)) {
+			pDevice->IapMode = ELAN_IAP_RECOVERY;
+		}
+
+		WdfObjectDelete(imageMemory);
+
+		//
+		// Re-query the controller even on failure so that a controller
+		// left in recovery mode is detected for the next attempt.
+		//
+		NTSTATUS bootStatus = BOOTTOUCHSCREEN(pDevice);
+		if (NT_SUCCESS(status)) {
+			status = bootStatus;
+		}
+
+		ElanClearContacts(pDevice);
+		pDevice->LowPowerActive = false;
+
+		WdfInterruptEnable(pDevice->Interrupt);
+
+		//
+		// HIDclass started with the placeholder descriptor served in
+		// recovery mode, restart the stack so it reads the real one
+		//
+		if (recovery && NT_SUCCESS(status) && pDevice->IapMode == ELAN_IAP_OPERATIONAL) {
+			WdfDeviceSetFailed(Device, WdfDeviceFailedAttemptRestart);
+		}
+	}
+
+	pDevice->FwUpdateStats.ElapsedTime = KeQueryInterruptTime() - startTime;
+	pDevice->FwUpdateStats.Status = status;
+
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "Firmware update finished 0x%x, %d pages, %d retries\n",
+		status, pDevice->FwUpdateStats.PagesWritten, pDevice->FwUpdateStats.RetryTotal);
+
+	InterlockedExchange(&pDevice->FwUpdateState,
+		NT_SUCCESS(status) ? FWUPDATE_STATE_DONE : FWUPDATE_STATE_FAILED);
+}
+
+NTSTATUS
+ElanStartFwUpdate(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	LONG previousState;
+
+	//
+	// Power down flushes the workitem after setting ExitingD0 under the
+	// same lock, so an update either starts before the flush or not at all.
+	//
+	WdfInterruptAcquireLock(pDevice->Interrupt);
+
+	if (pDevice->ExitingD0) {
+		status = STATUS_DEVICE_NOT_READY;
+		goto exit;
+	}
+
+	//
+	// The health workitem masks and unmasks the line around its backoff
+	// or reset, which must not overlap the update doing the same
+	//
+	if (pDevice->HealthRecovering) {
+		status = STATUS_DEVICE_BUSY;
+		goto exit;
+	}
+
+	previousState = InterlockedExchange(&pDevice->FwUpdateState, FWUPDATE_STATE_RUNNING);
+	if (previousState == FWUPDATE_STATE_RUNNING) {
+		status = STATUS_DEVICE_BUSY;
+		goto exit;
+	}
+
+	RtlZeroMemory(&pDevice->FwUpdateStats, sizeof(pDevice->FwUpdateStats));
+	pDevice->FwUpdateStats.Status = STATUS_PENDING;
+
+	WdfWorkItemEnqueue(pDevice->FwUpdateWorkItem);
+
+exit:
+	WdfInterruptReleaseLock(pDevice->Interrupt);
+
+	return status;
+}
+
+VOID
+ElanFillFwUpdateReport(
+	IN PELAN_CONTEXT pDevice,
+	OUT ElanFwUpdateReport* pReport
+)
+{
+	PELAN_FW_UPDATE_STATS stats = &pDevice->FwUpdateStats;
+
+	pReport->Command = FWUPDATE_CMD_NONE;
+	pReport->State = (BYTE)pDevice->FwUpdateState;
+	pReport->IapMode = pDevice->IapMode;
+	pReport->Status = stats->Status;
+	pReport->PagesWritten = (USHORT)stats->PagesWritten;
+	pReport->PageCount = (USHORT)stats->PageCount;
+	pReport->ElapsedMs = (ULONG)(stats->ElapsedTime / 10000);
+	pReport->RetryTotal = (USHORT)stats->RetryTotal;
+	pReport->RetryMax = (USHORT)stats->RetryMax;
+	pReport->RetryMaxPage = (USHORT)stats->RetryMaxPage;
+	pReport->PagesRetried = (USHORT)stats->PagesRetried;
+}
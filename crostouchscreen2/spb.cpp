@@ -22,8 +22,8 @@ Revision History:
 #include "spb.h"
 #include <reshub.h>
 
-static ULONG ElanDebugLevel = 100;
-static ULONG ElanDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+static const ULONG ElanDebugLevel = 100;
+static const ULONG ElanDebugCatagories = DBG_INIT | DBG_PNP | DBG_IOCTL;
 
 NTSTATUS
 SpbDoWriteDataSynchronously(
@@ -23,7 +23,11 @@ Revision History:
 #include <wdm.h>
 #include <wdf.h>
 
-#define DEFAULT_SPB_BUFFER_SIZE 64
+//
+// Large enough for a full buffer mode frame (MAX_PACKET_SIZE) and an
+// IAP firmware page (ELAN_FW_PAGESIZE) so neither allocates per transfer.
+//
+#define DEFAULT_SPB_BUFFER_SIZE 256
 #define RESHUB_USE_HELPER_ROUTINES
 
 //
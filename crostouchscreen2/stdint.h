@@ -1,8 +1,14 @@
+#if defined(_MSC_VER)
 typedef signed char       int8_t;
 typedef signed short      int16_t;
 typedef signed int        int32_t;
 typedef unsigned char     uint8_t;
 typedef unsigned short    uint16_t;
 typedef unsigned int      uint32_t;
+typedef signed long long  int64_t;
+typedef unsigned long long uint64_t;
+#else
+#include <stdint.h>	// host tools, see tools/shim
+#endif
 
 #define BIT(nr)                 (1UL << (nr))
\ No newline at end of file
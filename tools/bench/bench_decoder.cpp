@@ -0,0 +1,141 @@
+/*++
+
+Module Name:
+
+bench_decoder.cpp
+
+Abstract:
+
+Benchmark gate for the frame decoder. Runs the same prebuilt workload
+through the driver's decoder and the pre-hardening baseline decoder
+(tools/reference/baseline_decoder.cpp) in the same process, alternating
+between them, and fails when the driver's decoder is slower than the
+baseline by more than the tolerance, which is then the budget for the
+frame parser hardening. Both run on the same machine at the same time,
+so the gate holds on any runner; absolute numbers are printed for
+information only.
+
+The workload is a gesture stream (taps, scrolls, pinches and palm rests
+in random order, see tools/gesture), or the given script.
+
+Usage: bench_decoder [-tolerance=percent] [-rounds=N] [-frames=N]
+                     [-script=taps|scroll|pinch|palm|mix] [-seed=S]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "gesture.h"
+
+static ULONGLONG BenchNow(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ULONGLONG)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Returns nanoseconds per frame
+//
+static double BenchRun(const ELAN_STREAM& stream, BOOLEAN baseline, ULONGLONG* hash) {
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(stream.Options, false);
+	if (!sim) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	if (baseline) {
+		sim->ChipOps.Frame = (stream.Options & ELAN_SIM_OPT_CHIP_EKTF) ?
+			ElanBaselineFrameEktf3624 : ElanBaselineFrameEkth3500;
+	}
+
+	ULONGLONG start = BenchNow();
+	ElanStreamReplay(sim, &stream);
+	ULONGLONG elapsed = BenchNow() - start;
+
+	*hash = sim->ReportHash;
+	ElanSimDestroy(sim);
+	return (double)elapsed / stream.Frames.size();
+}
+
+int main(int argc, char** argv) {
+	double tolerance = 10.0;
+	int rounds = 15;
+	size_t count = 1 << 16;
+	ELAN_GESTURE_KIND kind = ElanGestureMix;
+	ULONGLONG seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 11, "-tolerance=") == 0)
+			tolerance = atof(arg.c_str() + 11);
+		else if (arg.compare(0, 8, "-rounds=") == 0)
+			rounds = atoi(arg.c_str() + 8);
+		else if (arg.compare(0, 8, "-frames=") == 0)
+			count = strtoul(arg.c_str() + 8, NULL, 0);
+		else if (arg.compare(0, 8, "-script=") == 0 &&
+			(kind = ElanGestureKindFromName(arg.c_str() + 8)) != ElanGestureKinds)
+			continue;
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else {
+			fprintf(stderr, "usage: %s [-tolerance=percent] [-rounds=N] [-frames=N]\n"
+				"          [-script=taps|scroll|pinch|palm|mix] [-seed=S]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (rounds < 1 || count < 1) {
+		fprintf(stderr, "rounds and frames must be positive\n");
+		return 2;
+	}
+
+	ELAN_GESTURE_SCRIPT script;
+	ELAN_STREAM stream;
+	ElanGestureDefaults(kind, &script);
+	script.Seed = seed;
+	script.DurationMs = 0;
+	script.Frames = (ULONG)count;
+	ElanGestureGenerate(&script, &stream);
+
+	//
+	// Best of the rounds for each, alternating so frequency changes and
+	// noisy neighbours hit both alike
+	//
+	double best[2] = { 0, 0 };
+	ULONGLONG hash[2] = { 0, 0 };
+	for (int r = 0; r < rounds; r++) {
+		for (int baseline = 0; baseline < 2; baseline++) {
+			double ns = BenchRun(stream, (BOOLEAN)baseline, &hash[baseline]);
+			if (r == 0 || ns < best[baseline])
+				best[baseline] = ns;
+		}
+	}
+
+	if (hash[0] != hash[1]) {
+		fprintf(stderr, "FAIL: the decoder and the baseline disagree on the workload\n");
+		return 1;
+	}
+
+	double ratio = best[0] / best[1];
+	printf("workload   %s, %zu frames over %.1f s\n", ElanGestureKindName(kind),
+		stream.Frames.size(), stream.Frames.back().Time / 1e7);
+	printf("decoder    %8.1f ns/frame  %10.0f frames/s\n", best[0], 1e9 / best[0]);
+	printf("baseline   %8.1f ns/frame  %10.0f frames/s\n", best[1], 1e9 / best[1]);
+	printf("ratio      %8.3f (limit %.3f)\n", ratio, 1.0 + tolerance / 100);
+
+	if (ratio > 1.0 + tolerance / 100) {
+		fprintf(stderr, "FAIL: decoder is %.1f%% slower than the baseline\n", (ratio - 1.0) * 100);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*++
+
+Module Name:
+
+bench_jitter.cpp
+
+Abstract:
+
+Cycles per contact of the jitter filter. Replays each gesture script
+through the simulated controller with the filters off to collect the raw
+contact positions in report order, then runs the driver's jitter filter
+over them the way the decoder does, resetting a slot's filter when its
+contact lands. Every script is timed with the time stamp counter over the
+whole run, best of the rounds, and again with the filter disabled so the
+call overhead is shown apart from the filter's own work.
+
+With -max-cycles the run fails when the filter costs more than that per
+contact on any script.
+
+Usage: bench_jitter [-ms=N] [-rounds=N] [-seed=S] [-max-cycles=N]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "gesture.h"
+
+struct JitterUpdate
+{
+	uint8_t Contact;
+
+	uint8_t Lands;
+
+	uint16_t X;
+
+	uint16_t Y;
+};
+
+typedef std::vector<JitterUpdate> JitterWorkload;
+
+struct JitterCapture
+{
+	JitterWorkload* Workload;
+
+	USHORT Down;	// contact IDs with the tip switch set
+};
+
+static VOID JitterOnReport(PELAN_SIM_DEVICE Sim, const BYTE* Report, ULONG Length) {
+	JitterCapture* capture = (JitterCapture*)Sim->OnReportContext;
+	ULONG touchSize = (Sim->Context.Config.Flags & ELAN_CONFIG_PRESSURE) ?
+		sizeof(TOUCH) : FIELD_OFFSET(TOUCH, Pressure);
+	BYTE count = Report[Length - 1];
+
+	for (int n = 0; n < count && n < MULTI_MAX_COUNT; n++) {
+		TOUCH touch;
+		RtlZeroMemory(&touch, sizeof(touch));
+		RtlCopyMemory(&touch, &Report[1 + n * touchSize], touchSize);
+
+		USHORT bit = 1 << touch.ContactID;
+		if (!(touch.Status & MULTI_TIPSWITCH_BIT)) {
+			capture->Down &= ~bit;
+			continue;
+		}
+
+		JitterUpdate update = { touch.ContactID, !(capture->Down & bit), touch.XValue, touch.YValue };
+		capture->Workload->push_back(update);
+		capture->Down |= bit;
+	}
+}
+
+static void JitterCollect(ELAN_GESTURE_KIND kind, ULONGLONG seed, ULONG ms, JitterWorkload* workload) {
+	ELAN_GESTURE_SCRIPT script;
+	ELAN_STREAM stream;
+
+	ElanGestureDefaults(kind, &script);
+	script.Seed = seed;
+	script.DurationMs = ms;
+	script.Frames = 0;
+	ElanGestureGenerate(&script, &stream);
+
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(
+		ELAN_SIM_OPT_NO_COALESCE | ELAN_SIM_OPT_NO_JITTER, false);
+	if (!sim) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	JitterCapture capture = { workload, 0 };
+	sim->OnReport = JitterOnReport;
+	sim->OnReportContext = &capture;
+	ElanStreamReplay(sim, &stream);
+	ElanSimDestroy(sim);
+}
+
+//
+// Returns the cycles for one pass over the workload, and how many updates
+// the filter held
+//
+static ULONGLONG JitterRun(const JitterWorkload& workload, const ELAN_JITTER_CONFIG* config,
+	ULONGLONG* held, ULONGLONG* sum) {
+	ELAN_JITTER_FILTER filters[MAX_CONTACT_NUM];
+	ULONGLONG count = 0, check = 0;
+
+	for (int i = 0; i < MAX_CONTACT_NUM; i++)
+		ElanJitterReset(&filters[i]);
+
+	ULONGLONG start = ReadTimeStampCounter();
+	for (size_t n = 0; n < workload.size(); n++) {
+		const JitterUpdate& update = workload[n];
+		uint16_t x = update.X, y = update.Y;
+
+		if (update.Lands)
+			ElanJitterReset(&filters[update.Contact]);
+		ElanJitterFilter(&filters[update.Contact], config, &x, &y);
+
+		count += x != update.X || y != update.Y;
+		check += x + y;
+	}
+	ULONGLONG cycles = ReadTimeStampCounter() - start;
+
+	*held = count;
+	*sum += check;
+	return cycles;
+}
+
+int main(int argc, char** argv) {
+	ULONG ms = 10000;
+	int rounds = 15;
+	ULONGLONG seed = 1;
+	double maxCycles = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 4, "-ms=") == 0)
+			ms = strtoul(arg.c_str() + 4, NULL, 0);
+		else if (arg.compare(0, 8, "-rounds=") == 0)
+			rounds = atoi(arg.c_str() + 8);
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else if (arg.compare(0, 12, "-max-cycles=") == 0)
+			maxCycles = atof(arg.c_str() + 12);
+		else {
+			fprintf(stderr, "usage: %s [-ms=N] [-rounds=N] [-seed=S] [-max-cycles=N]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (rounds < 1 || ms < 1) {
+		fprintf(stderr, "rounds and ms must be positive\n");
+		return 2;
+	}
+
+	ELAN_JITTER_CONFIG config, disabled;
+	config.HoldThreshold = ELAN_JITTER_HOLD_THRESHOLD;
+	config.MoveThreshold = ELAN_JITTER_MOVE_THRESHOLD;
+	config.SettleFrames = ELAN_JITTER_SETTLE_FRAMES;
+	disabled = config;
+	disabled.HoldThreshold = 0;
+
+	printf("%-8s %9s %7s %15s %15s\n", "script", "contacts", "held", "cycles/contact", "disabled");
+
+	int status = 0;
+	ULONGLONG sum = 0;
+	for (int kind = 0; kind < ElanGestureKinds; kind++) {
+		JitterWorkload workload;
+		JitterCollect((ELAN_GESTURE_KIND)kind, seed, ms, &workload);
+		if (workload.empty())
+			continue;
+
+		//
+		// Best of the rounds for each, alternating as bench_decoder does
+		//
+		ULONGLONG best[2] = { 0, 0 };
+		ULONGLONG held = 0, unused;
+		for (int r = 0; r < rounds; r++) {
+			ULONGLONG on = JitterRun(workload, &config, &held, &sum);
+			ULONGLONG off = JitterRun(workload, &disabled, &unused, &sum);
+			if (r == 0 || on < best[0])
+				best[0] = on;
+			if (r == 0 || off < best[1])
+				best[1] = off;
+		}
+
+		double perContact = (double)best[0] / workload.size();
+		printf("%-8s %9zu %6.1f%% %15.1f %15.1f\n", ElanGestureKindName((ELAN_GESTURE_KIND)kind),
+			workload.size(), 100.0 * held / workload.size(), perContact,
+			(double)best[1] / workload.size());
+
+		if (maxCycles && perContact > maxCycles) {
+			fprintf(stderr, "FAIL: %s: %.1f cycles per contact, limit %.1f\n",
+				ElanGestureKindName((ELAN_GESTURE_KIND)kind), perContact, maxCycles);
+			status = 1;
+		}
+	}
+
+	//
+	// Keeps the filtered positions live
+	//
+	if (sum == 0)
+		printf("no contacts\n");
+
+	return status;
+}
@@ -0,0 +1,246 @@
+/*++
+
+Module Name:
+
+command_channel.cpp
+
+Abstract:
+
+Test of the asynchronous command channel (command.cpp) against the
+simulated controller. Diagnostic register reads are started with
+ElanStartDiagRead, the way the vendor diagnostic report starts them,
+while a gesture stream is replayed, and the firmware's answers arrive in
+the frame stream between touch frames:
+
+  interleave  reads answered a few touch frames after they are sent; the
+              touch reports must match a replay without any reads
+  timeout     a read that is never answered times out
+  rejected    a command that is not a register read never reaches the bus
+  not-ready   a read while the controller is not booted
+  cancel      a read cancelled as a reset or power down cancels it
+
+Usage: command_channel [-ms=N] [-seed=S] [-every=N] [-lag=N]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "gesture.h"
+
+static int ChannelFailures;
+
+static void ChannelCheck(const char* scenario, bool ok, const char* what) {
+	if (!ok) {
+		fprintf(stderr, "FAIL: %s: %s\n", scenario, what);
+		ChannelFailures++;
+	}
+}
+
+static PELAN_SIM_DEVICE ChannelCreate(uint8_t options) {
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(options, false);
+	if (!sim) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	return sim;
+}
+
+static NTSTATUS ChannelRead(PELAN_SIM_DEVICE sim, uint8_t reg, ULONGLONG now) {
+	const uint8_t cmd[DIAG_COMMAND_SIZE] = { CMD_HEADER_READ, reg, 0x00, 0x01 };
+
+	ElanShimInterruptTime = now;
+	NTSTATUS status = ElanStartDiagRead(&sim->Context, cmd);
+	ElanShimInterruptTime = 0;
+	return status;
+}
+
+static void ChannelPrint(const char* scenario, PELAN_SIM_DEVICE sim, const char* detail) {
+	ElanDiagReport report;
+
+	RtlZeroMemory(&report, sizeof(report));
+	ElanFillDiagReport(&sim->Context, &report);
+
+	static const char* const states[] = { "idle", "running", "done", "failed" };
+	printf("%-10s %-7s 0x%08x  %02x %02x %02x %02x -> %02x %02x %02x %02x  %s\n",
+		scenario, report.State < ARRAYSIZE(states) ? states[report.State] : "?",
+		(unsigned)report.Status,
+		report.Command[0], report.Command[1], report.Command[2], report.Command[3],
+		report.Response[0], report.Response[1], report.Response[2], report.Response[3], detail);
+}
+
+int main(int argc, char** argv) {
+	ULONG ms = 5000;
+	ULONGLONG seed = 1;
+	ULONG every = 10;
+	ULONG lag = 3;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 4, "-ms=") == 0)
+			ms = strtoul(arg.c_str() + 4, NULL, 0);
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else if (arg.compare(0, 7, "-every=") == 0)
+			every = strtoul(arg.c_str() + 7, NULL, 0);
+		else if (arg.compare(0, 5, "-lag=") == 0)
+			lag = strtoul(arg.c_str() + 5, NULL, 0);
+		else {
+			fprintf(stderr, "usage: %s [-ms=N] [-seed=S] [-every=N] [-lag=N]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (ms < 1 || lag < 1 || every <= lag) {
+		fprintf(stderr, "ms and lag must be positive and every larger than lag\n");
+		return 2;
+	}
+
+	ELAN_GESTURE_SCRIPT script;
+	ELAN_STREAM stream;
+
+	ElanGestureDefaults(ElanGestureMix, &script);
+	script.Seed = seed;
+	script.DurationMs = ms;
+	script.Frames = 0;
+	ElanGestureGenerate(&script, &stream);
+
+	PELAN_SIM_DEVICE sim, plain;
+	NTSTATUS status;
+	char detail[128];
+
+	//
+	// A read every Nth frame, answered Lag touch frames later, against the
+	// same stream without any reads
+	//
+	sim = ChannelCreate(stream.Options);
+	plain = ChannelCreate(stream.Options);
+	ElanStreamReplay(plain, &stream);
+
+	ULONG reads = 0, answered = 0;
+	uint8_t reg = 0;
+	size_t pending = 0;
+	for (size_t n = 0; n < stream.Frames.size(); n++) {
+		const ELAN_STREAM_FRAME* frame = &stream.Frames[n];
+
+		if (n % every == 0) {
+			reg = (uint8_t)(reads * 0x10);
+			sim->Boot.Register = (uint16_t)(0x5a00 + reads);
+			status = ChannelRead(sim, reg, frame->Time);
+			ChannelCheck("interleave", status == STATUS_SUCCESS, "read did not start");
+			ChannelCheck("interleave", sim->Context.DiagState == DIAG_STATE_RUNNING, "read is not running");
+
+			status = ChannelRead(sim, reg, frame->Time);
+			ChannelCheck("interleave", status == STATUS_DEVICE_BUSY, "second read was not refused");
+			reads++;
+			pending = n + lag;
+		}
+
+		if (n == pending && ElanSimCommandFrame(sim, frame->Time)) {
+			const uint8_t expect[DIAG_RESPONSE_SIZE] = { CMD_HEADER_RESP, reg,
+				(uint8_t)(sim->Boot.Register >> 8), (uint8_t)sim->Boot.Register };
+
+			ChannelCheck("interleave", sim->Context.DiagState == DIAG_STATE_DONE, "read did not complete");
+			ChannelCheck("interleave", sim->Context.DiagStatus == STATUS_SUCCESS, "read status is not success");
+			ChannelCheck("interleave", !memcmp(sim->Context.DiagResponse, expect, sizeof(expect)),
+				"wrong response");
+			answered++;
+		}
+
+		ElanSimFrame(sim, frame->Data, frame->Length, frame->Time);
+		ChannelCheck("interleave", !sim->Context.CmdInFlight || sim->Context.DiagState == DIAG_STATE_RUNNING,
+			"command in flight without a running read");
+	}
+
+	const char* contacts = ElanSimCheckContacts(sim);
+	snprintf(detail, sizeof(detail), "%u reads, %u answered between %zu frames, %u reports",
+		(unsigned)reads, (unsigned)answered, stream.Frames.size(), (unsigned)sim->Reports);
+	ChannelPrint("interleave", sim, detail);
+	ChannelCheck("interleave", reads > 1 && answered + 1 >= reads, "reads were not answered");
+	ChannelCheck("interleave", sim->Boot.Commands == reads, "wrong number of reads on the bus");
+	ChannelCheck("interleave", sim->Reports == plain->Reports && sim->ReportHash == plain->ReportHash,
+		"touch reports differ from the replay without reads");
+	ChannelCheck("interleave", !contacts, contacts ? contacts : "");
+	ChannelCheck("interleave", !sim->Boot.Error, sim->Boot.Error ? sim->Boot.Error : "");
+	ElanSimDestroy(plain);
+	ElanSimDestroy(sim);
+
+	//
+	// An unanswered read holds the channel until its deadline, touch
+	// frames carry on meanwhile
+	//
+	sim = ChannelCreate(stream.Options);
+	ULONGLONG start = stream.Frames.front().Time;
+	status = ChannelRead(sim, 0x00, start);
+	ChannelCheck("timeout", status == STATUS_SUCCESS, "read did not start");
+	sim->Boot.ResponseLength = 0;
+
+	//
+	// The deadline runs from the end of the command write
+	//
+	ULONGLONG deadline = sim->Context.CmdDeadline;
+	ChannelCheck("timeout", deadline >= start + (ULONGLONG)ELAN_CMD_TIMEOUT_MS * 10000, "deadline too early");
+
+	for (size_t n = 0; n < stream.Frames.size() && stream.Frames[n].Time < deadline; n++)
+		ElanSimFrame(sim, stream.Frames[n].Data, stream.Frames[n].Length, stream.Frames[n].Time);
+
+	ElanShimInterruptTime = deadline - 1;
+	ElanCommandTimeout(&sim->Context);
+	ChannelCheck("timeout", sim->Context.DiagState == DIAG_STATE_RUNNING, "read timed out early");
+	ElanShimInterruptTime = deadline;
+	ElanCommandTimeout(&sim->Context);
+	ElanShimInterruptTime = 0;
+	ChannelPrint("timeout", sim, "");
+	ChannelCheck("timeout", sim->Context.DiagState == DIAG_STATE_FAILED &&
+		sim->Context.DiagStatus == STATUS_IO_TIMEOUT, "read did not time out");
+	ChannelCheck("timeout", !sim->Context.CmdInFlight && sim->Context.CmdCount == 0, "channel not idle");
+	ElanSimDestroy(sim);
+
+	//
+	// Writes are refused before they reach the bus
+	//
+	sim = ChannelCreate(stream.Options);
+	const uint8_t write[DIAG_COMMAND_SIZE] = { 0x54, 0x29, 0x00, 0x01 };
+	status = ElanStartDiagRead(&sim->Context, write);
+	ChannelPrint("rejected", sim, "");
+	ChannelCheck("rejected", status == STATUS_INVALID_PARAMETER, "write was not refused");
+	ChannelCheck("rejected", sim->Context.DiagState == DIAG_STATE_IDLE, "state changed");
+	ChannelCheck("rejected", sim->Boot.Transfers == 0, "controller was touched");
+	ElanSimDestroy(sim);
+
+	sim = ChannelCreate(stream.Options);
+	sim->Context.TouchScreenBooted = false;
+	status = ChannelRead(sim, 0x00, start);
+	ChannelPrint("not-ready", sim, "");
+	ChannelCheck("not-ready", status == STATUS_DEVICE_NOT_READY, "read was not refused");
+	ChannelCheck("not-ready", sim->Context.DiagState == DIAG_STATE_FAILED &&
+		sim->Context.DiagStatus == STATUS_DEVICE_NOT_READY, "failure not reported");
+	ChannelCheck("not-ready", sim->Boot.Transfers == 0, "controller was touched");
+	ElanSimDestroy(sim);
+
+	sim = ChannelCreate(stream.Options);
+	status = ChannelRead(sim, 0x00, start);
+	ChannelCheck("cancel", status == STATUS_SUCCESS, "read did not start");
+	ElanCancelCommands(&sim->Context);
+	ChannelPrint("cancel", sim, "");
+	ChannelCheck("cancel", sim->Context.DiagState == DIAG_STATE_FAILED &&
+		sim->Context.DiagStatus == STATUS_CANCELLED, "cancel not reported");
+	ChannelCheck("cancel", !sim->Context.CmdInFlight && sim->Context.CmdCount == 0, "channel not idle");
+	ElanSimDestroy(sim);
+
+	if (ChannelFailures) {
+		fprintf(stderr, "%d checks failed\n", ChannelFailures);
+		return 1;
+	}
+
+	printf("all scenarios passed\n");
+	return 0;
+}
@@ -0,0 +1,284 @@
+/*++
+
+Module Name:
+
+bench_cost.cpp
+
+Abstract:
+
+Per-stage CPU cost benchmark against the simulated controller. Replays a
+gesture stream, or recorded streams, through the frame decoder timing
+each frame the way ElanAcquireFrames does: the read, then the frame
+parser as a whole, with the decoder charging the decode and report
+stages to CostFrame as it goes and validation taking the rest. Frames are
+summed into windows of ELAN_COST_WINDOW_MS of stream time as ElanCostFrame
+does, and every window is printed as the cost feature report (ID 8) would
+return it, followed by the totals over the run.
+
+There is no bus on the host, so the read stage is the copy of the frame
+out of the stream into the read buffer; on a device it is dominated by
+the I2C transfer. Frames are replayed back to back, so the elapsed cycles
+of a window are its stream time at the measured time stamp counter rate,
+which makes the CPU share that of the input arriving in real time.
+
+Usage: bench_cost [-script=taps|scroll|pinch|palm|mix] [-seed=S] [-ms=N]
+                  [-chip=ekth|ektf] [-options=hex] [-windows] [stream...]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "gesture.h"
+
+static const char* const CostStageNames[COST_STAGES] = {
+	"read", "validate", "decode", "report"
+};
+
+struct CostRun
+{
+	ELAN_COST_WINDOW Window;
+
+	ELAN_COST_WINDOW Total;
+
+	ULONGLONG WindowStart;
+
+	ULONG Windows;
+};
+
+static ULONGLONG CostNow(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ULONGLONG)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Time stamp counter ticks per second, measured against the monotonic
+// clock over a tenth of a second
+//
+static double CostTscRate(void) {
+	ULONGLONG start = CostNow();
+	ULONGLONG tsc = ReadTimeStampCounter();
+	ULONGLONG now;
+
+	while ((now = CostNow()) - start < 100000000)
+		;
+
+	return (double)(ReadTimeStampCounter() - tsc) * 1e9 / (now - start);
+}
+
+static void CostPrint(const char* label, const ELAN_COST_WINDOW* window) {
+	printf("%-8s %6u frames", label, (unsigned)window->Frames);
+	for (int stage = 0; stage < COST_STAGES; stage++) {
+		ULONGLONG average = window->Frames ? window->Cycles[stage] / window->Frames : 0;
+		double share = window->ElapsedCycles ?
+			100.0 * window->Cycles[stage] / window->ElapsedCycles : 0;
+
+		printf("  %s %6llu/%-7llu %6.3f%%", CostStageNames[stage], (unsigned long long)average,
+			(unsigned long long)window->MaxCycles[stage], share);
+	}
+	printf("\n");
+}
+
+//
+// Publishes the window when a frame arrives after it has ended, as
+// ElanCostFrame does
+//
+static void CostPublish(CostRun* run, double tscRate, ULONGLONG end, BOOLEAN windows) {
+	ELAN_COST_WINDOW* window = &run->Window;
+
+	if (window->Frames > 0) {
+		window->ElapsedCycles = (ULONGLONG)((end - run->WindowStart) * tscRate / 1e7);
+
+		run->Windows++;
+		run->Total.Frames += window->Frames;
+		run->Total.ElapsedCycles += window->ElapsedCycles;
+		for (int stage = 0; stage < COST_STAGES; stage++) {
+			run->Total.Cycles[stage] += window->Cycles[stage];
+			if (window->MaxCycles[stage] > run->Total.MaxCycles[stage])
+				run->Total.MaxCycles[stage] = window->MaxCycles[stage];
+		}
+
+		if (windows) {
+			char label[16];
+			snprintf(label, sizeof(label), "%.1fs", run->WindowStart / 1e7);
+			CostPrint(label, window);
+		}
+	}
+
+	RtlZeroMemory(window, sizeof(*window));
+	run->WindowStart = end;
+}
+
+static void CostFrame(PELAN_SIM_DEVICE sim, CostRun* run, double tscRate, BOOLEAN windows,
+	ULONGLONG now, ULONGLONG readCycles, ULONGLONG frameCycles) {
+	PELAN_CONTEXT pDevice = &sim->Context;
+	ELAN_COST_WINDOW* window = &run->Window;
+
+	ULONGLONG nested = pDevice->CostFrame[COST_STAGE_DECODE] + pDevice->CostFrame[COST_STAGE_REPORT];
+	pDevice->CostFrame[COST_STAGE_READ] = readCycles;
+	pDevice->CostFrame[COST_STAGE_VALIDATE] = frameCycles > nested ? frameCycles - nested : 0;
+
+	if (now - run->WindowStart >= (ULONGLONG)ELAN_COST_WINDOW_MS * 10000)
+		CostPublish(run, tscRate, now, windows);
+
+	window->Frames++;
+	for (int stage = 0; stage < COST_STAGES; stage++) {
+		window->Cycles[stage] += pDevice->CostFrame[stage];
+		if (pDevice->CostFrame[stage] > window->MaxCycles[stage])
+			window->MaxCycles[stage] = pDevice->CostFrame[stage];
+	}
+}
+
+static BOOLEAN CostReplay(const ELAN_STREAM& stream, CostRun* run, double tscRate, BOOLEAN windows) {
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(stream.Options, false);
+	if (!sim) {
+		fprintf(stderr, "out of memory\n");
+		return false;
+	}
+
+	RtlZeroMemory(run, sizeof(*run));
+	if (!stream.Frames.empty())
+		run->WindowStart = stream.Frames.front().Time;
+
+	for (size_t n = 0; n < stream.Frames.size(); n++) {
+		const ELAN_STREAM_FRAME* frame = &stream.Frames[n];
+		uint8_t buf[MAX_PACKET_SIZE];
+
+		RtlZeroMemory(sim->Context.CostFrame, sizeof(sim->Context.CostFrame));
+		ULONGLONG readStart = ReadTimeStampCounter();
+
+		RtlCopyMemory(buf, frame->Data, frame->Length);
+
+		ULONGLONG frameStart = ReadTimeStampCounter();
+		ElanSimFrame(sim, buf, frame->Length, frame->Time);
+
+		CostFrame(sim, run, tscRate, windows, frame->Time,
+			frameStart - readStart, ReadTimeStampCounter() - frameStart);
+	}
+
+	//
+	// The last window is published as if one more scan had arrived
+	//
+	if (!stream.Frames.empty())
+		CostPublish(run, tscRate, stream.Frames.back().Time + ELAN_SCAN_PERIOD_US * 10, windows);
+
+	ElanSimDestroy(sim);
+	return true;
+}
+
+static void CostUsage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-script=taps|scroll|pinch|palm|mix] [-seed=S] [-ms=N]\n"
+		"          [-chip=ekth|ektf] [-options=hex] [-windows] [stream...]\n", name);
+}
+
+int main(int argc, char** argv) {
+	ELAN_GESTURE_KIND kind = ElanGestureMix;
+	ULONGLONG seed = 1;
+	ULONG ms = 10000;
+	int options = -1;
+	BOOLEAN ektf = false;
+	BOOLEAN windows = false;
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 8, "-script=") == 0) {
+			kind = ElanGestureKindFromName(arg.c_str() + 8);
+			if (kind == ElanGestureKinds) {
+				fprintf(stderr, "unknown script %s\n", arg.c_str() + 8);
+				return 2;
+			}
+		}
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else if (arg.compare(0, 4, "-ms=") == 0)
+			ms = strtoul(arg.c_str() + 4, NULL, 0);
+		else if (arg == "-chip=ekth")
+			ektf = false;
+		else if (arg == "-chip=ektf")
+			ektf = true;
+		else if (arg.compare(0, 9, "-options=") == 0)
+			options = (int)(strtoul(arg.c_str() + 9, NULL, 16) & 0xff);
+		else if (arg == "-windows")
+			windows = true;
+		else if (arg[0] == '-') {
+			CostUsage(argv[0]);
+			return 2;
+		}
+		else
+			paths.push_back(arg);
+	}
+
+	if (paths.empty() && ms == 0) {
+		CostUsage(argv[0]);
+		return 2;
+	}
+
+	std::vector<ELAN_STREAM> streams;
+	std::vector<std::string> names;
+	if (paths.empty()) {
+		ELAN_GESTURE_SCRIPT script;
+		ElanGestureDefaults(kind, &script);
+		script.Seed = seed;
+		script.DurationMs = ms;
+		script.Frames = 0;
+		if (options >= 0)
+			script.Options = (uint8_t)options;
+		if (ektf)
+			script.Options |= ELAN_SIM_OPT_CHIP_EKTF;
+
+		streams.resize(1);
+		ElanGestureGenerate(&script, &streams[0]);
+		names.push_back(ElanGestureKindName(kind));
+	}
+	else {
+		streams.resize(paths.size());
+		for (size_t i = 0; i < paths.size(); i++) {
+			if (!ElanStreamLoad(paths[i].c_str(), &streams[i])) {
+				fprintf(stderr, "cannot read %s\n", paths[i].c_str());
+				return 1;
+			}
+			if (options >= 0)
+				streams[i].Options = (uint8_t)options;
+			names.push_back(paths[i]);
+		}
+	}
+
+	double tscRate = CostTscRate();
+	printf("time stamp counter %.0f MHz, stages as average/max cycles per frame and CPU share\n",
+		tscRate / 1e6);
+
+	int status = 0;
+	for (size_t i = 0; i < streams.size(); i++) {
+		CostRun run;
+
+		if (!CostReplay(streams[i], &run, tscRate, windows))
+			return 1;
+
+		printf("%s: %zu frames, %u windows\n", names[i].c_str(), streams[i].Frames.size(),
+			(unsigned)run.Windows);
+		CostPrint("total", &run.Total);
+
+		//
+		// A workload that delivered frames but charged nothing to decoding
+		// means the stage timers are not wired up
+		//
+		if (run.Total.Frames && !run.Total.Cycles[COST_STAGE_DECODE]) {
+			fprintf(stderr, "FAIL: %s: no cycles charged to the decode stage\n", names[i].c_str());
+			status = 1;
+		}
+	}
+
+	return status;
+}
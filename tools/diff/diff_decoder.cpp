@@ -0,0 +1,601 @@
+/*++
+
+Module Name:
+
+diff_decoder.cpp
+
+Abstract:
+
+Differential harness for the frame decoder. Every case is run through
+the driver's decoder and the frozen reference decoder side by side, and
+after each frame the return value, the reports delivered for it and the
+decoder's state (contacts, filters, coalescing, counters and trace) are
+compared. Cases are random frame sequences generated from a seed, which
+model fingers touching down, moving, holding and lifting with buffered,
+repeated, wait, corrupted and garbage frames mixed in; gesture streams
+from the workload generator; and recorded sequences given on the command
+line, as stream files or in the simulator's input format. Frames are
+replayed at their stream times.
+
+Cases run on all cores. The first divergence, by case number for random
+cases, is reported with a repro minimized by dropping frames, zeroing
+bytes and clearing options while the decoders still disagree; the repro
+is written as a stream file.
+
+Usage: diff_decoder [-cases=N] [-gestures=N] [-frames=N] [-seed=S]
+                    [-jobs=N] [-repro=path] [file|dir...]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gesture.h"
+
+typedef std::vector<uint8_t> DiffInput;
+typedef std::vector<std::vector<BYTE>> DiffReports;
+
+struct DiffResult
+{
+	bool Diverged;
+
+	size_t Frame;	// index of the frame after which they disagreed
+
+	std::string What;
+};
+
+static std::string DiffFormat(const char* format, ...) {
+	char text[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	return text;
+}
+
+static VOID DiffOnReport(PELAN_SIM_DEVICE Sim, const BYTE* Report, ULONG Length) {
+	DiffReports* reports = (DiffReports*)Sim->OnReportContext;
+	reports->push_back(std::vector<BYTE>(Report, Report + Length));
+}
+
+//
+// Compares everything the decoder owns, returns an empty string when the
+// two contexts agree
+//
+static std::string DiffState(const ELAN_CONTEXT* a, const ELAN_CONTEXT* b) {
+	for (int i = 0; i < MAX_CONTACT_NUM; i++) {
+		if (a->Flags[i] != b->Flags[i])
+			return DiffFormat("slot %d flags %02x vs %02x", i, a->Flags[i], b->Flags[i]);
+		if (a->XValue[i] != b->XValue[i] || a->YValue[i] != b->YValue[i])
+			return DiffFormat("slot %d position %u,%u vs %u,%u", i,
+				a->XValue[i], a->YValue[i], b->XValue[i], b->YValue[i]);
+		if (a->AREA[i] != b->AREA[i] || a->Pressure[i] != b->Pressure[i])
+			return DiffFormat("slot %d size %u/%u vs %u/%u", i,
+				a->AREA[i], a->Pressure[i], b->AREA[i], b->Pressure[i]);
+		if (memcmp(&a->Predictors[i], &b->Predictors[i], sizeof(a->Predictors[i])))
+			return DiffFormat("slot %d predictor state", i);
+		if (memcmp(&a->JitterFilters[i], &b->JitterFilters[i], sizeof(a->JitterFilters[i])))
+			return DiffFormat("slot %d jitter filter state", i);
+	}
+
+	if (a->LiveCount != b->LiveCount)
+		return DiffFormat("live count %u vs %u", a->LiveCount, b->LiveCount);
+
+	for (int n = 0; n < a->LiveCount; n++) {
+		int i = a->LiveSlots[n];
+		if (i != b->LiveSlots[n])
+			return DiffFormat("live list entry %d slot %d vs %d", n, i, b->LiveSlots[n]);
+		if (a->ContactIds[i] != b->ContactIds[i])
+			return DiffFormat("slot %d contact ID %u vs %u", i, a->ContactIds[i], b->ContactIds[i]);
+		if (a->ContactTime[i] != b->ContactTime[i])
+			return DiffFormat("slot %d contact time", i);
+	}
+
+	if (a->ContactIdsInUse != b->ContactIdsInUse)
+		return DiffFormat("contact IDs in use %04x vs %04x", a->ContactIdsInUse, b->ContactIdsInUse);
+	if (memcmp(&a->LastReport, &b->LastReport, sizeof(a->LastReport)))
+		return "last report";
+	if (a->DuplicateCount != b->DuplicateCount)
+		return DiffFormat("duplicate count %u vs %u", a->DuplicateCount, b->DuplicateCount);
+	if (a->AcqStats.Reports != b->AcqStats.Reports ||
+		a->AcqStats.DuplicatesSuppressed != b->AcqStats.DuplicatesSuppressed)
+		return "report statistics";
+	if (a->HealthStats.BadFrames != b->HealthStats.BadFrames ||
+		memcmp(a->HealthBuckets, b->HealthBuckets, sizeof(a->HealthBuckets)))
+		return "health accounting";
+
+	const volatile LONG64* ca = &a->Counters.Frames;
+	const volatile LONG64* cb = &b->Counters.Frames;
+	for (size_t n = 0; n < sizeof(a->Counters) / sizeof(LONG64); n++) {
+		if (ca[n] != cb[n])
+			return DiffFormat("counter %zu: %lld vs %lld", n, (long long)ca[n], (long long)cb[n]);
+	}
+
+	if (a->TraceHead != b->TraceHead)
+		return DiffFormat("trace head %d vs %d", a->TraceHead, b->TraceHead);
+
+	for (int n = 0; n < ELAN_TRACE_ENTRIES; n++) {
+		const ELAN_TRACE_RECORD* ra = &a->TraceRing[n];
+		const ELAN_TRACE_RECORD* rb = &b->TraceRing[n];
+		if (ra->Sequence != rb->Sequence || ra->EventId != rb->EventId ||
+			memcmp(ra->Args, rb->Args, sizeof(ra->Args)))
+			return DiffFormat("trace record %u", ra->Sequence);
+	}
+
+	return "";
+}
+
+static DiffResult DiffRun(const ELAN_STREAM& input) {
+	DiffResult result = { false, 0, "" };
+
+	PELAN_SIM_DEVICE live = ElanSimCreateWithOptions(input.Options, false);
+	PELAN_SIM_DEVICE reference = ElanSimCreateWithOptions(input.Options, true);
+	DiffReports liveReports, referenceReports;
+
+	if (!live || !reference) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	live->OnReport = DiffOnReport;
+	live->OnReportContext = &liveReports;
+	reference->OnReport = DiffOnReport;
+	reference->OnReportContext = &referenceReports;
+
+	for (size_t frame = 0; frame < input.Frames.size(); frame++) {
+		const ELAN_STREAM_FRAME* f = &input.Frames[frame];
+
+		liveReports.clear();
+		referenceReports.clear();
+
+		BOOLEAN liveWait = ElanSimFrame(live, f->Data, f->Length, f->Time);
+		BOOLEAN referenceWait = ElanSimFrame(reference, f->Data, f->Length, f->Time);
+
+		std::string what;
+		if (liveWait != referenceWait)
+			what = DiffFormat("read ahead %d vs %d", liveWait, referenceWait);
+		else if (liveReports.size() != referenceReports.size())
+			what = DiffFormat("%zu reports vs %zu", liveReports.size(), referenceReports.size());
+		else {
+			for (size_t r = 0; r < liveReports.size() && what.empty(); r++) {
+				if (liveReports[r] != referenceReports[r])
+					what = DiffFormat("report %zu differs", r);
+			}
+		}
+
+		if (what.empty())
+			what = DiffState(&live->Context, &reference->Context);
+
+		if (!what.empty()) {
+			result.Diverged = true;
+			result.Frame = frame;
+			result.What = what;
+			break;
+		}
+	}
+
+	ElanSimDestroy(live);
+	ElanSimDestroy(reference);
+	return result;
+}
+
+//
+// Shrinks a diverging input while the decoders keep disagreeing
+//
+static ELAN_STREAM DiffMinimize(ELAN_STREAM input, const DiffResult& first) {
+	//
+	// Nothing after the divergence matters. Frames keep their times, so
+	// dropping one leaves the others where they were.
+	//
+	input.Frames.resize(first.Frame + 1);
+
+	bool progress = true;
+	while (progress) {
+		progress = false;
+
+		for (size_t f = input.Frames.size(); f-- > 0 && input.Frames.size() > 1;) {
+			ELAN_STREAM candidate = input;
+			candidate.Frames.erase(candidate.Frames.begin() + f);
+
+			DiffResult result = DiffRun(candidate);
+			if (result.Diverged) {
+				candidate.Frames.resize(result.Frame + 1);
+				input = candidate;
+				progress = true;
+			}
+		}
+
+		for (int bit = 0; bit < 8; bit++) {
+			if (!(input.Options & (1 << bit)))
+				continue;
+
+			ELAN_STREAM candidate = input;
+			candidate.Options &= ~(1 << bit);
+			if (DiffRun(candidate).Diverged) {
+				input = candidate;
+				progress = true;
+			}
+		}
+	}
+
+	if (input.Frames.size() <= 32) {
+		for (size_t f = 0; f < input.Frames.size(); f++) {
+			for (size_t i = 0; i < input.Frames[f].Length; i++) {
+				if (!input.Frames[f].Data[i])
+					continue;
+
+				ELAN_STREAM candidate = input;
+				candidate.Frames[f].Data[i] = 0;
+				if (DiffRun(candidate).Diverged)
+					input = candidate;
+			}
+		}
+	}
+
+	return input;
+}
+
+//
+// Random case generator
+//
+
+struct DiffContact
+{
+	bool Down;
+
+	int X, Y, Dx, Dy;
+
+	uint8_t Width, Pressure;
+};
+
+class DiffGenerator
+{
+public:
+	DiffGenerator(uint64_t seed) : m_State(seed * 0x9e3779b97f4a7c15ULL | 1) {
+		memset(m_Contacts, 0, sizeof(m_Contacts));
+	}
+
+	ELAN_STREAM Generate(size_t maxFrames) {
+		DiffInput input;
+		uint8_t frame[MAX_PACKET_SIZE];
+		uint8_t last[MAX_PACKET_SIZE];
+		bool haveLast = false;
+
+		uint8_t options = (uint8_t)Next();
+		input.push_back(options);
+		m_Ektf = !!(options & ELAN_SIM_OPT_CHIP_EKTF);
+
+		size_t frames = 1 + Next() % maxFrames;
+		for (size_t f = 0; f < frames; f++) {
+			unsigned kind = Next() % 100;
+
+			if (kind < 8 && haveLast) {
+				memcpy(frame, last, sizeof(frame));	// repeated frame
+			}
+			else if (kind < 13) {
+				memset(frame, 0, sizeof(frame));
+				memset(frame, QUEUE_HEADER_WAIT, HEADER_SIZE);
+			}
+			else if (kind < 16) {
+				for (size_t i = 0; i < sizeof(frame); i++)
+					frame[i] = (uint8_t)Next();
+			}
+			else {
+				TouchFrame(frame);
+				if (kind < 26) {
+					for (unsigned n = 1 + Next() % 4; n > 0; n--)
+						frame[Next() % (HEADER_SIZE + PACKET_SIZE)] ^= (uint8_t)(1 << (Next() % 8));
+				}
+			}
+
+			memcpy(last, frame, sizeof(frame));
+			haveLast = true;
+			input.insert(input.end(), frame, frame + sizeof(frame));
+		}
+
+		ELAN_STREAM stream;
+		ElanStreamFromInput(input.data(), input.size(), &stream);
+		return stream;
+	}
+
+private:
+	uint64_t Next() {
+		m_State ^= m_State << 13;
+		m_State ^= m_State >> 7;
+		m_State ^= m_State << 17;
+		return m_State;
+	}
+
+	void Step() {
+		for (int i = 0; i < MAX_CONTACT_NUM; i++) {
+			DiffContact* c = &m_Contacts[i];
+			unsigned roll = Next() % 100;
+
+			if (!c->Down) {
+				if (roll < 4) {
+					c->Down = true;
+					c->X = (int)(Next() % 4096);
+					c->Y = (int)(Next() % 4096);
+					c->Dx = (int)(Next() % 41) - 20;
+					c->Dy = (int)(Next() % 41) - 20;
+					c->Width = (uint8_t)Next();
+					c->Pressure = (uint8_t)Next();
+				}
+				continue;
+			}
+
+			if (roll < 3) {
+				c->Down = false;
+				continue;
+			}
+
+			//
+			// Holds, slow drift inside the jitter threshold, and motion
+			//
+			if (roll < 20)
+				c->Dx = c->Dy = 0;
+			else if (roll < 30) {
+				c->Dx = (int)(Next() % 5) - 2;
+				c->Dy = (int)(Next() % 5) - 2;
+			}
+			else if (roll < 35) {
+				c->Dx = (int)(Next() % 81) - 40;
+				c->Dy = (int)(Next() % 81) - 40;
+			}
+
+			c->X = std::min(std::max(c->X + c->Dx, 0), 4095);
+			c->Y = std::min(std::max(c->Y + c->Dy, 0), 4095);
+			if (roll >= 95) {
+				c->Width = (uint8_t)Next();
+				c->Pressure = (uint8_t)Next();
+			}
+		}
+	}
+
+	void TouchFrame(uint8_t* frame) {
+		ELAN_SIM_CONTACT touch[MAX_CONTACT_NUM];
+		uint8_t packets[ELAN_MAX_REPORT_COUNT * PACKET_SIZE];
+		size_t packetSize = (m_Ektf && Next() % 2) ? PACKET_SIZE_OLD : PACKET_SIZE;
+		int count = 1 + (int)(Next() % ELAN_MAX_REPORT_COUNT);
+		uint8_t header;
+
+		if (count == 1 && Next() % 2)
+			header = QUEUE_HEADER_SINGLE;
+		else
+			header = Next() % 2 ? QUEUE_HEADER_NORMAL : QUEUE_HEADER_NORMAL2;
+
+		for (int p = 0; p < count; p++) {
+			Step();
+
+			int down = 0;
+			for (int i = 0; i < MAX_CONTACT_NUM; i++) {
+				if (!m_Contacts[i].Down)
+					continue;
+				touch[down].Slot = (uint8_t)i;
+				touch[down].X = (uint16_t)m_Contacts[i].X;
+				touch[down].Y = (uint16_t)m_Contacts[i].Y;
+				touch[down].Width = m_Contacts[i].Width;
+				touch[down].Pressure = m_Contacts[i].Pressure;
+				down++;
+			}
+
+			ElanSimBuildPacket(&packets[p * packetSize], packetSize, touch, down);
+		}
+
+		ElanSimBuildFrame(frame, header, packets, count, packetSize);
+	}
+
+	uint64_t m_State;
+
+	bool m_Ektf;
+
+	DiffContact m_Contacts[MAX_CONTACT_NUM];
+};
+
+//
+// Gesture streams, every script on both chips and a random tuning
+// profile, a few seconds each
+//
+static ELAN_STREAM DiffGesture(uint64_t seed) {
+	ELAN_GESTURE_SCRIPT script;
+	ELAN_STREAM stream;
+	uint64_t state = seed * 0x9e3779b97f4a7c15ULL | 1;
+
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+
+	ElanGestureDefaults((ELAN_GESTURE_KIND)(seed % ElanGestureKinds), &script);
+	script.Seed = seed;
+	script.DurationMs = 3000;
+	script.Options = (uint8_t)state;
+	script.OldFormat = (script.Options & ELAN_SIM_OPT_CHIP_EKTF) && (state >> 8) % 2;
+	script.BufferedPercent = (ULONG)((state >> 16) % 40);
+	ElanGestureGenerate(&script, &stream);
+	return stream;
+}
+
+//
+// Recorded sequences
+//
+
+static void DiffCollect(const std::string& path, std::vector<std::string>* paths) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		exit(2);
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		paths->push_back(path);
+		return;
+	}
+
+	DIR* dir = opendir(path.c_str());
+	std::vector<std::string> names;
+	for (struct dirent* entry; dir && (entry = readdir(dir)) != NULL;) {
+		if (entry->d_name[0] != '.')
+			names.push_back(path + "/" + entry->d_name);
+	}
+	if (dir)
+		closedir(dir);
+
+	std::sort(names.begin(), names.end());
+	for (size_t i = 0; i < names.size(); i++)
+		DiffCollect(names[i], paths);
+}
+
+//
+// Reporting
+//
+
+static void DiffReport(const char* name, const ELAN_STREAM& input, const DiffResult& result,
+	const char* reproPath) {
+	fprintf(stderr, "DIVERGED: %s, frame %zu of %zu: %s\n", name, result.Frame,
+		input.Frames.size(), result.What.c_str());
+
+	ELAN_STREAM repro = DiffMinimize(input, result);
+	DiffResult minimized = DiffRun(repro);
+
+	fprintf(stderr, "minimized to %zu frame(s), options %02x, diverging at frame %zu: %s\n",
+		repro.Frames.size(), repro.Options, minimized.Frame, minimized.What.c_str());
+
+	for (size_t f = 0; f < repro.Frames.size(); f++) {
+		const ELAN_STREAM_FRAME* frame = &repro.Frames[f];
+		size_t length = frame->Length;
+		while (length > HEADER_SIZE && !frame->Data[length - 1])
+			length--;
+
+		fprintf(stderr, "  frame %zu at %llu:", f, (unsigned long long)frame->Time);
+		for (size_t i = 0; i < length; i++)
+			fprintf(stderr, "%s%02x", i % 32 ? " " : "\n    ", frame->Data[i]);
+		fprintf(stderr, "\n");
+	}
+
+	if (ElanStreamSave(reproPath, &repro)) {
+		fprintf(stderr, "repro written to %s, replay with diff_decoder -cases=0 %s\n",
+			reproPath, reproPath);
+	}
+}
+
+int main(int argc, char** argv) {
+	unsigned long cases = 2000;
+	unsigned long gestures = 0;
+	size_t maxFrames = 300;
+	uint64_t seed = 1;
+	unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+	std::string reproPath = "diff-repro.bin";
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 7, "-cases=") == 0)
+			cases = strtoul(arg.c_str() + 7, NULL, 0);
+		else if (arg.compare(0, 10, "-gestures=") == 0)
+			gestures = strtoul(arg.c_str() + 10, NULL, 0);
+		else if (arg.compare(0, 8, "-frames=") == 0)
+			maxFrames = std::max(1ul, strtoul(arg.c_str() + 8, NULL, 0));
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else if (arg.compare(0, 6, "-jobs=") == 0)
+			jobs = std::max(1ul, strtoul(arg.c_str() + 6, NULL, 0));
+		else if (arg.compare(0, 7, "-repro=") == 0)
+			reproPath = arg.substr(7);
+		else if (arg[0] == '-') {
+			fprintf(stderr, "usage: %s [-cases=N] [-gestures=N] [-frames=N] [-seed=S] [-jobs=N]\n"
+				"          [-repro=path] [file|dir...]\n", argv[0]);
+			return 2;
+		}
+		else
+			DiffCollect(arg, &paths);
+	}
+
+	//
+	// Recorded sequences first, then the random cases and the gesture
+	// streams. Workers take work in order and stop once a lower numbered
+	// item has diverged, so the reported divergence does not depend on the
+	// number of jobs.
+	//
+	size_t total = paths.size() + cases + gestures;
+	std::atomic<size_t> nextItem(0);
+	std::atomic<size_t> firstFailure(total);
+	std::mutex lock;
+	ELAN_STREAM failedInput;
+	DiffResult failedResult = { false, 0, "" };
+	bool readError = false;
+
+	auto worker = [&]() {
+		for (;;) {
+			size_t item = nextItem++;
+			if (item >= total || item > firstFailure)
+				return;
+
+			ELAN_STREAM input;
+			if (item < paths.size()) {
+				if (!ElanStreamLoad(paths[item].c_str(), &input)) {
+					std::lock_guard<std::mutex> guard(lock);
+					fprintf(stderr, "cannot read %s\n", paths[item].c_str());
+					readError = true;
+					continue;
+				}
+			}
+			else if (item < paths.size() + cases) {
+				DiffGenerator generator(seed + (item - paths.size()));
+				input = generator.Generate(maxFrames);
+			}
+			else
+				input = DiffGesture(seed + (item - paths.size() - cases));
+
+			DiffResult result = DiffRun(input);
+			if (!result.Diverged)
+				continue;
+
+			std::lock_guard<std::mutex> guard(lock);
+			if (item < firstFailure) {
+				firstFailure = item;
+				failedInput = input;
+				failedResult = result;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned j = 0; j < jobs; j++)
+		threads.push_back(std::thread(worker));
+	for (size_t j = 0; j < threads.size(); j++)
+		threads[j].join();
+
+	if (firstFailure < total) {
+		size_t item = firstFailure;
+		std::string name;
+		if (item < paths.size())
+			name = paths[item];
+		else if (item < paths.size() + cases)
+			name = DiffFormat("random case %zu (-seed=%llu -cases=1)", item - paths.size(),
+				(unsigned long long)(seed + (item - paths.size())));
+		else
+			name = DiffFormat("gesture stream %zu (-seed=%llu -cases=0 -gestures=1)",
+				item - paths.size() - cases,
+				(unsigned long long)(seed + (item - paths.size() - cases)));
+		DiffReport(name.c_str(), failedInput, failedResult, reproPath.c_str());
+		return 1;
+	}
+
+	printf("%zu recorded, %lu random and %lu gesture sequences, no divergence\n", paths.size(),
+		cases, gestures);
+	return readError ? 2 : 0;
+}
@@ -0,0 +1,18 @@
+#
+# Regenerates the seed corpus into OUT and compares it with CORPUS
+#
+file(REMOVE_RECURSE ${OUT})
+file(MAKE_DIRECTORY ${OUT})
+execute_process(COMMAND ${MAKE_CORPUS} ${OUT} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "make_corpus failed")
+endif()
+
+file(GLOB seeds RELATIVE ${OUT} ${OUT}/*)
+foreach(seed ${seeds})
+	execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUT}/${seed} ${CORPUS}/${seed}
+		RESULT_VARIABLE differs)
+	if(NOT differs EQUAL 0)
+		message(FATAL_ERROR "seed ${seed} is stale, run make_corpus ${CORPUS}")
+	endif()
+endforeach()
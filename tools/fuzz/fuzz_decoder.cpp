@@ -0,0 +1,288 @@
+/*++
+
+Module Name:
+
+fuzz_decoder.cpp
+
+Abstract:
+
+Fuzz target for the frame decoder. Inputs are in the simulator's input
+format: an options byte selecting the chip and tuning profile, then
+MAX_PACKET_SIZE byte frames fed one per scan period. Stream files from
+the gesture generator are accepted too and replayed at their times.
+After every frame the contact bookkeeping is checked, and every
+delivered report is checked against the panel geometry; any problem
+aborts.
+
+Built against libFuzzer when the compiler supports it. Otherwise a small
+driver replays the files and directories given on the command line and,
+with -mutate=N, N random mutations of them; stream files are converted
+to the input format first so they mutate like the other seeds.
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "elanstream.h"
+
+static void (*FuzzFailureHook)(void);
+
+static void FuzzFail(const char* what) {
+	fprintf(stderr, "decoder invariant broken: %s\n", what);
+	if (FuzzFailureHook)
+		FuzzFailureHook();
+	abort();
+}
+
+static VOID FuzzOnReport(PELAN_SIM_DEVICE Sim, const BYTE* Report, ULONG Length) {
+	const char* problem = ElanSimCheckReport(Sim, Report, Length);
+	if (problem)
+		FuzzFail(problem);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	ELAN_STREAM stream;
+
+	if (size < 1)
+		return 0;
+
+	//
+	// A mutated stream file that no longer parses is run as input format
+	//
+	if (!ElanStreamParse(data, size, &stream))
+		ElanStreamFromInput(data, size, &stream);
+
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(stream.Options, false);
+	if (!sim)
+		return 0;
+
+	sim->OnReport = FuzzOnReport;
+
+	for (size_t n = 0; n < stream.Frames.size(); n++) {
+		const ELAN_STREAM_FRAME* frame = &stream.Frames[n];
+		ElanSimFrame(sim, frame->Data, frame->Length, frame->Time);
+
+		const char* problem = ElanSimCheckContacts(sim);
+		if (problem)
+			FuzzFail(problem);
+	}
+
+	ElanSimDestroy(sim);
+	return 0;
+}
+
+#if !defined(ELAN_LIBFUZZER)
+
+extern "C" void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+static const std::vector<uint8_t>* FuzzInput;
+static const char* FuzzInputName;
+static unsigned long FuzzMutation;
+
+//
+// Saves the failing input next to the working directory so it can be
+// replayed and minimized
+//
+static void FuzzSaveInput(void) {
+	if (!FuzzInput)
+		return;
+
+	FILE* file = fopen("fuzz-failure.bin", "wb");
+	if (file) {
+		fwrite(FuzzInput->data(), 1, FuzzInput->size(), file);
+		fclose(file);
+	}
+
+	if (FuzzInputName)
+		fprintf(stderr, "failing input %s saved to fuzz-failure.bin\n", FuzzInputName);
+	else
+		fprintf(stderr, "failing mutation %lu saved to fuzz-failure.bin\n", FuzzMutation);
+}
+
+static bool FuzzReadFile(const std::string& path, std::vector<uint8_t>* data) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	uint8_t chunk[4096];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data->insert(data->end(), chunk, chunk + read);
+
+	fclose(file);
+	return true;
+}
+
+static void FuzzCollect(const std::string& path, std::vector<std::vector<uint8_t>>* inputs,
+	std::vector<std::string>* inputNames) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		exit(2);
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		DIR* dir = opendir(path.c_str());
+		std::vector<std::string> names;
+		for (struct dirent* entry; dir && (entry = readdir(dir)) != NULL;) {
+			if (entry->d_name[0] != '.')
+				names.push_back(path + "/" + entry->d_name);
+		}
+		if (dir)
+			closedir(dir);
+
+		//
+		// Sorted so mutation runs are reproducible
+		//
+		std::sort(names.begin(), names.end());
+		for (size_t i = 0; i < names.size(); i++)
+			FuzzCollect(names[i], inputs, inputNames);
+		return;
+	}
+
+	std::vector<uint8_t> data;
+	if (!FuzzReadFile(path, &data)) {
+		fprintf(stderr, "cannot read %s\n", path.c_str());
+		exit(2);
+	}
+
+	if (ElanStreamIsStream(data.data(), data.size())) {
+		ELAN_STREAM stream;
+		if (!ElanStreamParse(data.data(), data.size(), &stream)) {
+			fprintf(stderr, "malformed stream %s\n", path.c_str());
+			exit(2);
+		}
+		ElanStreamToInput(&stream, &data);
+	}
+	inputs->push_back(data);
+	inputNames->push_back(path);
+}
+
+static uint64_t FuzzRandom(uint64_t* state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+//
+// Byte flips, bit flips, interesting values, frame header fields and
+// splices, enough to walk the decoder's branches from the seeds without
+// libFuzzer
+//
+static void FuzzMutate(std::vector<uint8_t>* data, const std::vector<std::vector<uint8_t>>& inputs,
+	uint64_t* state) {
+	static const uint8_t interesting[] = {
+		0x00, 0x01, 0x03, 0x04, 0xff, 0x7f, 0x80,
+		QUEUE_HEADER_SINGLE, QUEUE_HEADER_NORMAL, QUEUE_HEADER_WAIT, QUEUE_HEADER_NORMAL2,
+		PACKET_SIZE, PACKET_SIZE_OLD, PACKET_SIZE * 2, PACKET_SIZE * 3, PACKET_SIZE_OLD * 3,
+		HEADER_REPORT_10_FINGER, CMD_HEADER_RESP, CMD_HEADER_HELLO,
+	};
+
+	static const uint8_t headers[][8] = {
+		{ QUEUE_HEADER_SINGLE, QUEUE_HEADER_NORMAL, QUEUE_HEADER_WAIT, QUEUE_HEADER_NORMAL2,
+			CMD_HEADER_RESP, CMD_HEADER_HELLO, 0x00, 0xff },	// FW_HDR_TYPE
+		{ 0, 1, 2, 3, 4, 5, 0x80, 0xff },	// FW_HDR_COUNT
+		{ PACKET_SIZE, PACKET_SIZE * 2, PACKET_SIZE * 3, PACKET_SIZE * 4,
+			PACKET_SIZE_OLD, PACKET_SIZE_OLD * 3, PACKET_SIZE_OLD * 4, 0xff },	// FW_HDR_LENGTH
+	};
+
+	int edits = 1 + (int)(FuzzRandom(state) % 8);
+	for (int n = 0; n < edits && !data->empty(); n++) {
+		size_t at = FuzzRandom(state) % data->size();
+		switch (FuzzRandom(state) % 6) {
+		case 5:
+		{
+			//
+			// A header field of one of the frames
+			//
+			int field = (int)(FuzzRandom(state) % 3);
+			size_t frame = 1 + (at / MAX_PACKET_SIZE) * MAX_PACKET_SIZE;
+			if (frame + field < data->size())
+				(*data)[frame + field] = headers[field][FuzzRandom(state) % 8];
+			break;
+		}
+		case 0:
+			(*data)[at] = (uint8_t)FuzzRandom(state);
+			break;
+		case 1:
+			(*data)[at] ^= (uint8_t)(1 << (FuzzRandom(state) % 8));
+			break;
+		case 2:
+			(*data)[at] = interesting[FuzzRandom(state) % sizeof(interesting)];
+			break;
+		case 3:
+		{
+			const std::vector<uint8_t>& other = inputs[FuzzRandom(state) % inputs.size()];
+			if (other.size() > 1) {
+				size_t from = 1 + FuzzRandom(state) % (other.size() - 1);
+				size_t count = 1 + FuzzRandom(state) % (other.size() - from);
+				data->resize(at);
+				data->insert(data->end(), other.begin() + from, other.begin() + from + count);
+			}
+			break;
+		}
+		default:
+			data->resize(at + 1 + FuzzRandom(state) % (MAX_PACKET_SIZE * 2));
+			break;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::vector<uint8_t>> inputs;
+	std::vector<std::string> names;
+	unsigned long mutations = 0;
+	uint64_t seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 8, "-mutate=") == 0)
+			mutations = strtoul(arg.c_str() + 8, NULL, 0);
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0) | 1;
+		else
+			FuzzCollect(arg, &inputs, &names);
+	}
+
+	FuzzFailureHook = FuzzSaveInput;
+	if (__sanitizer_set_death_callback)
+		__sanitizer_set_death_callback(FuzzSaveInput);
+
+	if (inputs.empty()) {
+		fprintf(stderr, "usage: %s [-mutate=N] [-seed=S] file|dir...\n", argv[0]);
+		return 2;
+	}
+
+	for (size_t i = 0; i < inputs.size(); i++) {
+		FuzzInput = &inputs[i];
+		FuzzInputName = names[i].c_str();
+		LLVMFuzzerTestOneInput(inputs[i].data(), inputs[i].size());
+	}
+
+	FuzzInputName = NULL;
+
+	uint64_t state = seed;
+	for (FuzzMutation = 0; FuzzMutation < mutations; FuzzMutation++) {
+		std::vector<uint8_t> data = inputs[FuzzRandom(&state) % inputs.size()];
+		FuzzMutate(&data, inputs, &state);
+		FuzzInput = &data;
+		LLVMFuzzerTestOneInput(data.data(), data.size());
+	}
+
+	printf("%zu inputs, %lu mutations, no problems found\n", inputs.size(), mutations);
+	return 0;
+}
+
+#endif
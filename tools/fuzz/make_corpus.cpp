@@ -0,0 +1,257 @@
+/*++
+
+Module Name:
+
+make_corpus.cpp
+
+Abstract:
+
+Writes the fuzz seed corpus. No captures from real panels are checked
+in, so the seeds are synthesized with the simulator's packet builder to
+cover every frame type, both packet formats and the malformed frames the
+decoder rejects, under the tuning profiles the options byte selects, and
+short gesture workloads from the generator.
+
+Usage: make_corpus <directory>
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gesture.h"
+
+typedef std::vector<uint8_t> Seed;
+
+static void SeedFrame(Seed* seed, const uint8_t* frame) {
+	seed->insert(seed->end(), frame, frame + MAX_PACKET_SIZE);
+}
+
+//
+// Count contacts in slots First.. moving diagonally by Step per frame
+//
+static void SeedContacts(ELAN_SIM_CONTACT* contacts, int first, int count, int frame, int step) {
+	for (int n = 0; n < count; n++) {
+		contacts[n].Slot = (uint8_t)(first + n);
+		contacts[n].X = (uint16_t)(200 + n * 280 + frame * step);
+		contacts[n].Y = (uint16_t)(150 + n * 150 + frame * step);
+		contacts[n].Width = (uint8_t)(8 + n);
+		contacts[n].Pressure = (uint8_t)(40 + n * 10);
+	}
+}
+
+static void SeedGesture(Seed* seed, uint8_t header, size_t packetSize, int contacts, int frames,
+	int packetsPerFrame) {
+	ELAN_SIM_CONTACT touch[MAX_CONTACT_NUM];
+	uint8_t packets[ELAN_MAX_REPORT_COUNT * PACKET_SIZE];
+	uint8_t frame[MAX_PACKET_SIZE];
+
+	for (int f = 0; f < frames; f += packetsPerFrame) {
+		for (int p = 0; p < packetsPerFrame; p++) {
+			SeedContacts(touch, 0, contacts, f + p, 7);
+			ElanSimBuildPacket(&packets[p * packetSize], packetSize, touch, contacts);
+		}
+		ElanSimBuildFrame(frame, header, packets, packetsPerFrame, packetSize);
+		SeedFrame(seed, frame);
+	}
+
+	//
+	// Lift everything
+	//
+	ElanSimBuildPacket(packets, packetSize, touch, 0);
+	ElanSimBuildFrame(frame, header, packets, 1, packetSize);
+	SeedFrame(seed, frame);
+}
+
+//
+// The first frames of a gesture script, in the input format
+//
+static void SeedScript(Seed* seed, ELAN_GESTURE_KIND kind, uint8_t options, BOOLEAN oldFormat,
+	ULONG bufferedPercent) {
+	ELAN_GESTURE_SCRIPT script;
+	ELAN_STREAM stream;
+
+	ElanGestureDefaults(kind, &script);
+	script.Options = options;
+	script.OldFormat = oldFormat;
+	script.BufferedPercent = bufferedPercent;
+	script.DurationMs = 0;
+	script.Frames = 48;
+	ElanGestureGenerate(&script, &stream);
+	ElanStreamToInput(&stream, seed);
+}
+
+static bool SeedWrite(const std::string& dir, const char* name, const Seed& seed) {
+	std::string path = dir + "/" + name;
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		fprintf(stderr, "cannot write %s\n", path.c_str());
+		return false;
+	}
+
+	fwrite(seed.data(), 1, seed.size(), file);
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <directory>\n", argv[0]);
+		return 2;
+	}
+
+	std::string dir = argv[1];
+	ELAN_SIM_CONTACT touch[MAX_CONTACT_NUM];
+	uint8_t packets[ELAN_MAX_REPORT_COUNT * PACKET_SIZE];
+	uint8_t frame[MAX_PACKET_SIZE];
+	bool ok = true;
+
+	{
+		Seed seed(1, 0);
+		SeedGesture(&seed, QUEUE_HEADER_SINGLE, PACKET_SIZE, 1, 6, 1);
+		ok &= SeedWrite(dir, "ekth-single-tap", seed);
+	}
+
+	{
+		Seed seed(1, ELAN_SIM_OPT_NO_COALESCE);
+		SeedGesture(&seed, QUEUE_HEADER_NORMAL, PACKET_SIZE, 2, 12, 3);
+		ok &= SeedWrite(dir, "ekth-normal-two-finger", seed);
+	}
+
+	{
+		Seed seed(1, ELAN_SIM_OPT_PREDICT | ELAN_SIM_OPT_NO_JITTER);
+		SeedGesture(&seed, QUEUE_HEADER_NORMAL2, PACKET_SIZE, MAX_CONTACT_NUM, 8, 2);
+		ok &= SeedWrite(dir, "ekth-normal2-ten-finger-predict", seed);
+	}
+
+	{
+		Seed seed(1, ELAN_SIM_OPT_NO_PRESSURE | ELAN_SIM_OPT_SWAP_XY | ELAN_SIM_OPT_INVERT);
+		SeedGesture(&seed, QUEUE_HEADER_NORMAL, PACKET_SIZE, 3, 6, 1);
+		ok &= SeedWrite(dir, "ekth-transform-no-pressure", seed);
+	}
+
+	{
+		Seed seed(1, ELAN_SIM_OPT_DROP_REPORTS);
+		SeedGesture(&seed, QUEUE_HEADER_SINGLE, PACKET_SIZE, 4, 9, 1);
+		ok &= SeedWrite(dir, "ekth-dropped-reports", seed);
+	}
+
+	{
+		Seed seed(1, ELAN_SIM_OPT_CHIP_EKTF);
+		SeedGesture(&seed, QUEUE_HEADER_NORMAL, PACKET_SIZE_OLD, 2, 9, 3);
+		ok &= SeedWrite(dir, "ektf-normal-old-format", seed);
+	}
+
+	{
+		Seed seed(1, ELAN_SIM_OPT_CHIP_EKTF);
+		SeedGesture(&seed, QUEUE_HEADER_SINGLE, PACKET_SIZE_OLD, 1, 4, 1);
+		ok &= SeedWrite(dir, "ektf-single-old-format", seed);
+	}
+
+	{
+		Seed seed(1, ELAN_SIM_OPT_CHIP_EKTF);
+		SeedGesture(&seed, QUEUE_HEADER_NORMAL2, PACKET_SIZE, 5, 4, 2);
+		ok &= SeedWrite(dir, "ektf-normal2-new-format", seed);
+	}
+
+	{
+		//
+		// Read ahead handshake, then the queued packets
+		//
+		Seed seed(1, 0);
+		const uint8_t wait[MAX_PACKET_SIZE] = {
+			QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT
+		};
+		SeedFrame(&seed, wait);
+		SeedGesture(&seed, QUEUE_HEADER_NORMAL, PACKET_SIZE, 2, 3, 3);
+		ok &= SeedWrite(dir, "ekth-wait-then-normal", seed);
+	}
+
+	{
+		//
+		// Every rejected frame kind between good ones
+		//
+		Seed seed(1, 0);
+
+		SeedContacts(touch, 0, 2, 0, 0);
+		ElanSimBuildPacket(packets, PACKET_SIZE, touch, 2);
+		ElanSimBuildFrame(frame, QUEUE_HEADER_NORMAL, packets, 1, PACKET_SIZE);
+		SeedFrame(&seed, frame);
+
+		frame[HEADER_SIZE + FW_POS_CHECKSUM] ^= 0x5a;	// checksum
+		SeedFrame(&seed, frame);
+
+		ElanSimBuildFrame(frame, QUEUE_HEADER_NORMAL, packets, 1, PACKET_SIZE);
+		frame[HEADER_SIZE + FW_POS_HEADER] = 0x00;	// packet type
+		SeedFrame(&seed, frame);
+
+		ElanSimBuildFrame(frame, QUEUE_HEADER_WAIT, packets, 1, PACKET_SIZE);	// wait
+		SeedFrame(&seed, frame);
+
+		ElanSimBuildFrame(frame, QUEUE_HEADER_NORMAL, packets, 1, PACKET_SIZE);
+		frame[FW_HDR_COUNT] = ELAN_MAX_REPORT_COUNT + 1;	// report count
+		SeedFrame(&seed, frame);
+
+		ElanSimBuildFrame(frame, QUEUE_HEADER_NORMAL, packets, 1, PACKET_SIZE);
+		frame[FW_HDR_LENGTH] = MAX_PACKET_SIZE;	// frame length
+		SeedFrame(&seed, frame);
+
+		ElanSimBuildFrame(frame, QUEUE_HEADER_NORMAL, packets, 1, PACKET_SIZE);
+		frame[FW_HDR_LENGTH] = PACKET_SIZE_OLD;	// report length on EKTH
+		SeedFrame(&seed, frame);
+
+		ElanSimBuildFrame(frame, CMD_HEADER_HELLO, packets, 1, PACKET_SIZE);	// header
+		SeedFrame(&seed, frame);
+
+		ElanSimBuildPacket(packets, PACKET_SIZE, touch, 0);
+		ElanSimBuildFrame(frame, QUEUE_HEADER_NORMAL, packets, 1, PACKET_SIZE);
+		SeedFrame(&seed, frame);
+
+		ok &= SeedWrite(dir, "ekth-rejected-frames", seed);
+	}
+
+	{
+		//
+		// The packet claims fewer contacts than it has state bits for
+		//
+		Seed seed(1, 0);
+
+		SeedContacts(touch, 0, 4, 0, 0);
+		ElanSimBuildPacket(packets, PACKET_SIZE, touch, 4);
+		packets[FW_POS_STATE + 1] = (packets[FW_POS_STATE + 1] & 0xf0) | 2;
+		uint8_t checksum = 0;
+		for (int i = 0; i < FW_POS_CHECKSUM; i++)
+			checksum += packets[i];
+		packets[FW_POS_CHECKSUM] = checksum;
+		ElanSimBuildFrame(frame, QUEUE_HEADER_SINGLE, packets, 1, PACKET_SIZE);
+		SeedFrame(&seed, frame);
+
+		ok &= SeedWrite(dir, "ekth-short-count", seed);
+	}
+
+	{
+		Seed seed;
+		SeedScript(&seed, ElanGesturePinch, 0, false, 50);
+		ok &= SeedWrite(dir, "gesture-pinch-buffered", seed);
+	}
+
+	{
+		Seed seed;
+		SeedScript(&seed, ElanGestureTapStorm, ELAN_SIM_OPT_PREDICT, false, 10);
+		ok &= SeedWrite(dir, "gesture-taps-predict", seed);
+	}
+
+	{
+		Seed seed;
+		SeedScript(&seed, ElanGesturePalmRest, ELAN_SIM_OPT_CHIP_EKTF, true, 10);
+		ok &= SeedWrite(dir, "gesture-palm-ektf-old-format", seed);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*++
+
+Module Name:
+
+gen_gestures.cpp
+
+Abstract:
+
+Writes a gesture workload as a stream file, or in the simulator's input
+format for tools that take that (the times are dropped, frames are then
+replayed one scan period apart). Prints a summary of the stream and of
+what the decoder made of it.
+
+Usage: gen_gestures [-script=taps|scroll|pinch|palm|mix] [-seed=S]
+                    [-ms=N] [-frames=N] [-chip=ekth|ektf] [-old-format]
+                    [-options=hex] [-fingers=N] [-taps=N] [-gesture-ms=N]
+                    [-gap-ms=N] [-noise=N] [-buffered=percent] [-input]
+                    <file>
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "gesture.h"
+
+static void GenUsage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-script=taps|scroll|pinch|palm|mix] [-seed=S] [-ms=N] [-frames=N]\n"
+		"          [-chip=ekth|ektf] [-old-format] [-options=hex] [-fingers=N] [-taps=N]\n"
+		"          [-gesture-ms=N] [-gap-ms=N] [-noise=N] [-buffered=percent] [-input] <file>\n",
+		name);
+}
+
+static bool GenOption(const std::string& arg, const char* name, ULONG* value) {
+	size_t length = strlen(name);
+	if (arg.compare(0, length, name) != 0)
+		return false;
+	*value = strtoul(arg.c_str() + length, NULL, 0);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	ELAN_GESTURE_SCRIPT script;
+	ELAN_GESTURE_KIND kind = ElanGestureMix;
+	std::vector<std::string> args(argv + 1, argv + argc);
+	std::string path;
+	bool input = false;
+
+	//
+	// The script picks the defaults the other options adjust
+	//
+	for (size_t i = 0; i < args.size(); i++) {
+		if (args[i].compare(0, 8, "-script=") == 0) {
+			kind = ElanGestureKindFromName(args[i].c_str() + 8);
+			if (kind == ElanGestureKinds) {
+				fprintf(stderr, "unknown script %s\n", args[i].c_str() + 8);
+				return 2;
+			}
+		}
+	}
+	ElanGestureDefaults(kind, &script);
+
+	for (size_t i = 0; i < args.size(); i++) {
+		const std::string& arg = args[i];
+		ULONG value;
+
+		if (arg.compare(0, 8, "-script=") == 0)
+			continue;
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			script.Seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else if (GenOption(arg, "-ms=", &script.DurationMs) ||
+			GenOption(arg, "-frames=", &script.Frames) ||
+			GenOption(arg, "-fingers=", &script.Fingers) ||
+			GenOption(arg, "-taps=", &script.TapsPerSecond) ||
+			GenOption(arg, "-gesture-ms=", &script.GestureMs) ||
+			GenOption(arg, "-gap-ms=", &script.GapMs) ||
+			GenOption(arg, "-noise=", &script.Noise) ||
+			GenOption(arg, "-buffered=", &script.BufferedPercent))
+			continue;
+		else if (arg == "-chip=ekth")
+			script.Options &= ~ELAN_SIM_OPT_CHIP_EKTF;
+		else if (arg == "-chip=ektf")
+			script.Options |= ELAN_SIM_OPT_CHIP_EKTF;
+		else if (arg == "-old-format")
+			script.OldFormat = true;
+		else if (arg.compare(0, 9, "-options=") == 0) {
+			value = strtoul(arg.c_str() + 9, NULL, 16);
+			script.Options = (uint8_t)value;
+		}
+		else if (arg == "-input")
+			input = true;
+		else if (arg[0] == '-' || !path.empty()) {
+			GenUsage(argv[0]);
+			return 2;
+		}
+		else
+			path = arg;
+	}
+
+	if (path.empty() || (!script.DurationMs && !script.Frames) || script.BufferedPercent > 100) {
+		GenUsage(argv[0]);
+		return 2;
+	}
+
+	if (script.OldFormat && !(script.Options & ELAN_SIM_OPT_CHIP_EKTF)) {
+		fprintf(stderr, "-old-format needs -chip=ektf\n");
+		return 2;
+	}
+
+	ELAN_STREAM stream;
+	ElanGestureGenerate(&script, &stream);
+
+	bool written;
+	if (input) {
+		std::vector<uint8_t> data;
+		ElanStreamToInput(&stream, &data);
+
+		FILE* file = fopen(path.c_str(), "wb");
+		written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+		if (file)
+			written = fclose(file) == 0 && written;
+	}
+	else
+		written = ElanStreamSave(path.c_str(), &stream);
+
+	if (!written) {
+		fprintf(stderr, "cannot write %s\n", path.c_str());
+		return 1;
+	}
+
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(stream.Options, false);
+	if (!sim) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	ElanStreamReplay(sim, &stream);
+
+	ULONGLONG end = stream.Frames.empty() ? 0 : stream.Frames.back().Time;
+	printf("%s: %s, seed %llu, %zu frames over %.2f s, %u packets, %u reports, %u bad frames\n",
+		path.c_str(), ElanGestureKindName(script.Kind), (unsigned long long)script.Seed,
+		stream.Frames.size(), end / 1e7, (unsigned)sim->Context.Counters.Packets,
+		sim->Reports, (unsigned)sim->Context.HealthStats.BadFrames);
+
+	ElanSimDestroy(sim);
+	return 0;
+}
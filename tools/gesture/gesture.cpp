@@ -0,0 +1,509 @@
+/*++
+
+Module Name:
+
+gesture.cpp
+
+Abstract:
+
+Gesture workload generator for the host tools, see gesture.h
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gesture.h"
+
+#define ELAN_GESTURE_PI	3.14159265358979323846
+
+static const char* const ElanGestureNames[ElanGestureKinds] = {
+	"taps", "scroll", "pinch", "palm", "mix"
+};
+
+VOID
+ElanGestureDefaults(
+	IN ELAN_GESTURE_KIND Kind,
+	OUT PELAN_GESTURE_SCRIPT Script
+)
+{
+	RtlZeroMemory(Script, sizeof(*Script));
+	Script->Kind = Kind;
+	Script->Seed = 1;
+	Script->DurationMs = 10000;
+	Script->Fingers = Kind == ElanGesturePalmRest ? 2 : 3;
+	Script->TapsPerSecond = Kind == ElanGesturePalmRest ? 3 : 10;
+	Script->GestureMs = Kind == ElanGestureScroll ? 500 : 600;
+	Script->GapMs = 400;
+	Script->Noise = 2;
+	Script->BufferedPercent = 10;
+}
+
+ELAN_GESTURE_KIND
+ElanGestureKindFromName(
+	IN const char* Name
+)
+{
+	for (int kind = 0; kind < ElanGestureKinds; kind++) {
+		if (strcmp(Name, ElanGestureNames[kind]) == 0)
+			return (ELAN_GESTURE_KIND)kind;
+	}
+	return ElanGestureKinds;
+}
+
+const char*
+ElanGestureKindName(
+	IN ELAN_GESTURE_KIND Kind
+)
+{
+	return Kind < ElanGestureKinds ? ElanGestureNames[Kind] : "unknown";
+}
+
+//
+// One finger or palm from touch-down to lift. Scans are relative to the
+// start of the gesture.
+//
+struct GestureStroke
+{
+	int Start;	// first scan down
+
+	int End;	// first scan up again
+
+	int MoveStart, MoveEnd;	// travel, eased in and out; a fling lifts before MoveEnd
+
+	bool Polar;	// travels along an arc around X0,Y0
+
+	double X0, Y0, X1, Y1;	// from and to, or with Polar the center
+
+	double R0, R1, A0, A1;	// radius and angle from and to, with Polar
+
+	int Width, Pressure;	// once fully down
+
+	int Wobble;	// size changes by up to this much every scan, palms only
+
+	int Noise;
+
+	int Slot;	// -1 while up, or when the controller had no slot free
+};
+
+class GestureGenerator
+{
+public:
+	GestureGenerator(const ELAN_GESTURE_SCRIPT* script, PELAN_STREAM stream) :
+		m_Script(*script), m_Stream(stream), m_State(script->Seed * 0x9e3779b97f4a7c15ULL | 1),
+		m_Scan(0), m_Down(0), m_Done(false) {
+		bool ektf = !!(script->Options & ELAN_SIM_OPT_CHIP_EKTF);
+		m_MaxX = ektf ? ELAN_EKTF_MAX_X : ELAN_SIM_MAX_X;
+		m_MaxY = ektf ? ELAN_EKTF_MAX_Y : ELAN_SIM_MAX_Y;
+		m_PacketSize = (ektf && script->OldFormat) ? PACKET_SIZE_OLD : PACKET_SIZE;
+		m_ScansPerSecond = 1000000.0 / ELAN_SCAN_PERIOD_US;
+		m_Target = 0;
+	}
+
+	void Generate() {
+		m_Stream->Options = m_Script.Options;
+		m_Stream->Frames.clear();
+
+		while (!m_Done) {
+			ELAN_GESTURE_KIND kind = m_Script.Kind;
+			if (kind == ElanGestureMix)
+				kind = (ELAN_GESTURE_KIND)(Next() % ElanGestureMix);
+
+			std::vector<GestureStroke> strokes;
+			switch (kind) {
+			case ElanGestureTapStorm:
+				TapStorm(&strokes);
+				break;
+			case ElanGestureScroll:
+				Scroll(&strokes);
+				break;
+			case ElanGesturePinch:
+				Pinch(&strokes);
+				break;
+			default:
+				PalmRest(&strokes);
+				break;
+			}
+
+			Play(&strokes);
+
+			//
+			// Idle until the next gesture, the panel sends nothing
+			//
+			m_Scan += Range(2, std::max(2, Scans(m_Script.GapMs)));
+		}
+	}
+
+private:
+	uint64_t Next() {
+		m_State ^= m_State << 13;
+		m_State ^= m_State >> 7;
+		m_State ^= m_State << 17;
+		return m_State;
+	}
+
+	int Range(int low, int high) {	// inclusive
+		return high <= low ? low : low + (int)(Next() % (uint64_t)(high - low + 1));
+	}
+
+	double Unit() {
+		return (Next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	int Scans(ULONG ms) {
+		return std::max(1, (int)(ms * m_ScansPerSecond / 1000));
+	}
+
+	GestureStroke Finger(int start, int end, double x, double y) {
+		GestureStroke stroke;
+		memset(&stroke, 0, sizeof(stroke));
+		stroke.Start = start;
+		stroke.End = end;
+		stroke.MoveStart = start;
+		stroke.MoveEnd = end;
+		stroke.X0 = stroke.X1 = x;
+		stroke.Y0 = stroke.Y1 = y;
+		stroke.Width = Range(6, 12);
+		stroke.Pressure = Range(50, 110);
+		stroke.Noise = (int)m_Script.Noise;
+		stroke.Slot = -1;
+		return stroke;
+	}
+
+	static int FingersDownAt(const std::vector<GestureStroke>& strokes, int scan) {
+		int down = 0;
+		for (size_t n = 0; n < strokes.size(); n++)
+			down += !strokes[n].Wobble && strokes[n].Start <= scan && scan < strokes[n].End;
+		return down;
+	}
+
+	//
+	// Taps from a Poisson process at TapsPerSecond over the area given in
+	// fractions of the panel, at most Fingers down at once, a quarter of
+	// them followed by a second tap close by
+	//
+	void Taps(std::vector<GestureStroke>* strokes, int from, int to, double top, double bottom,
+		ULONG rate, int fingers) {
+		double mean = m_ScansPerSecond / std::max(1u, rate);
+
+		for (double at = from + mean * -log(1 - Unit()); at < to; at += mean * -log(1 - Unit())) {
+			int start = (int)at;
+			int length = Range(4, 12);
+
+			if (FingersDownAt(*strokes, start) >= fingers)
+				continue;
+
+			double x = m_MaxX * (0.05 + 0.9 * Unit());
+			double y = m_MaxY * (top + (bottom - top) * Unit());
+			GestureStroke tap = Finger(start, start + length, x, y);
+			tap.X1 = x + Range(-3, 3);
+			tap.Y1 = y + Range(-3, 3);
+			strokes->push_back(tap);
+
+			if (Next() % 4 == 0) {
+				int again = start + length + Range(8, 15);
+				GestureStroke second = Finger(again, again + Range(4, 10), x + Range(-30, 30), y + Range(-30, 30));
+				second.X1 = second.X0;
+				second.Y1 = second.Y0;
+				strokes->push_back(second);
+			}
+		}
+	}
+
+	void TapStorm(std::vector<GestureStroke>* strokes) {
+		Taps(strokes, 0, 3 * Scans(m_Script.GestureMs), 0.05, 0.95, m_Script.TapsPerSecond,
+			(int)std::max(1u, m_Script.Fingers));
+	}
+
+	//
+	// Two fingers land a scan or two apart, rest, travel together and
+	// either lift after stopping or fling, lifting while still moving
+	//
+	void Scroll(std::vector<GestureStroke>* strokes) {
+		bool vertical = Next() % 5 != 0;
+		int sign = Next() % 2 ? 1 : -1;
+		double along = vertical ? m_MaxY : m_MaxX;
+		double distance = along * (0.15 + 0.3 * Unit());
+		double spacing = m_MaxX * (0.08 + 0.08 * Unit());
+		double start = sign > 0 ? along * 0.05 + (along * 0.9 - distance) * Unit() :
+			along * 0.95 - (along * 0.9 - distance) * Unit();
+		double across = (vertical ? m_MaxX : m_MaxY) * (0.2 + 0.5 * Unit());
+
+		int moveStart = Range(3, 6);
+		int moveEnd = moveStart + std::max(4, (int)(Scans(m_Script.GestureMs) * (0.5 + 0.5 * Unit())));
+		bool fling = Next() % 5 < 2;
+		int lift = fling ? moveStart + (int)((moveEnd - moveStart) * (0.7 + 0.15 * Unit())) :
+			moveEnd + Range(1, 4);
+
+		for (int n = 0; n < 2; n++) {
+			int land = n ? Range(0, 2) : 0;
+			double offset = n * spacing + Range(-8, 8);
+			GestureStroke finger = Finger(land, lift + (n ? Range(0, 2) : 0), 0, 0);
+
+			finger.MoveStart = moveStart + Range(0, 1);
+			finger.MoveEnd = moveEnd;
+			if (vertical) {
+				finger.X0 = finger.X1 = across + offset;
+				finger.Y0 = start;
+				finger.Y1 = start + sign * (distance + Range(-10, 10));
+			}
+			else {
+				finger.Y0 = finger.Y1 = across + offset;
+				finger.X0 = start;
+				finger.X1 = start + sign * (distance + Range(-10, 10));
+			}
+			strokes->push_back(finger);
+		}
+	}
+
+	//
+	// Thumb and four fingers around a center, closing or opening with a
+	// little rotation, landing and lifting a few scans apart
+	//
+	void Pinch(std::vector<GestureStroke>* strokes) {
+		double size = std::min(m_MaxX, m_MaxY);
+		double cx = m_MaxX * (0.35 + 0.3 * Unit());
+		double cy = m_MaxY * (0.35 + 0.3 * Unit());
+		double wide = size * (0.28 + 0.08 * Unit());
+		double narrow = size * (0.06 + 0.04 * Unit());
+		bool closing = Next() % 2;
+		double rotate = (Unit() - 0.5) * 0.6;
+		double base = Unit() * 2 * ELAN_GESTURE_PI;
+
+		int moveStart = Range(4, 8);
+		int moveEnd = moveStart + Scans(m_Script.GestureMs);
+
+		for (int n = 0; n < 5; n++) {
+			double angle = base + (n == 0 ? ELAN_GESTURE_PI : (n - 2.5) * 0.45);
+			double reach = n == 0 ? 0.85 : 0.9 + 0.2 * Unit();
+
+			GestureStroke finger = Finger(Range(0, 4), moveEnd + Range(1, 5), cx, cy);
+			finger.Polar = true;
+			finger.MoveStart = moveStart;
+			finger.MoveEnd = moveEnd;
+			finger.R0 = (closing ? wide : narrow) * reach;
+			finger.R1 = (closing ? narrow : wide) * reach;
+			finger.A0 = angle;
+			finger.A1 = angle + rotate;
+			strokes->push_back(finger);
+		}
+	}
+
+	//
+	// A palm resting along the bottom, sometimes seen as two contacts,
+	// drifting and changing size, while fingers tap above it
+	//
+	void PalmRest(std::vector<GestureStroke>* strokes) {
+		int length = 3 * Scans(m_Script.GestureMs);
+		double x = m_MaxX * (0.15 + 0.7 * Unit());
+		double y = m_MaxY * (0.8 + 0.15 * Unit());
+		int parts = Next() % 10 < 3 ? 2 : 1;
+
+		for (int n = 0; n < parts; n++) {
+			GestureStroke palm = Finger(n ? Range(1, 3) : 0, length + Range(0, 3),
+				x + n * m_MaxX * 0.06, y + Range(-20, 20));
+			palm.X1 = palm.X0 + Range(-40, 40);
+			palm.Y1 = palm.Y0 + Range(-25, 25);
+			palm.Width = Range(30, 60);
+			palm.Pressure = Range(15, 35);
+			palm.Wobble = 4;
+			palm.Noise = 3 * (int)m_Script.Noise;
+			strokes->push_back(palm);
+		}
+
+		Taps(strokes, Range(10, 30), length - 10, 0.1, 0.6, m_Script.TapsPerSecond,
+			(int)std::max(1u, m_Script.Fingers));
+	}
+
+	//
+	// Where a stroke is at scan s, with sensor noise, clipped to the panel
+	//
+	void Position(const GestureStroke& stroke, int s, ELAN_SIM_CONTACT* contact) {
+		double t = stroke.MoveEnd > stroke.MoveStart ?
+			(double)(s - stroke.MoveStart) / (stroke.MoveEnd - stroke.MoveStart) : 1;
+		t = std::min(std::max(t, 0.0), 1.0);
+		double eased = t * t * (3 - 2 * t);
+
+		double x, y;
+		if (stroke.Polar) {
+			double r = stroke.R0 + (stroke.R1 - stroke.R0) * eased;
+			double a = stroke.A0 + (stroke.A1 - stroke.A0) * eased;
+			x = stroke.X0 + r * cos(a);
+			y = stroke.Y0 + r * sin(a);
+		}
+		else {
+			x = stroke.X0 + (stroke.X1 - stroke.X0) * eased;
+			y = stroke.Y0 + (stroke.Y1 - stroke.Y0) * eased;
+		}
+
+		x += Range(-stroke.Noise, stroke.Noise);
+		y += Range(-stroke.Noise, stroke.Noise);
+		contact->X = (uint16_t)std::min(std::max(x, 0.0), (double)m_MaxX);
+		contact->Y = (uint16_t)std::min(std::max(y, 0.0), (double)m_MaxY);
+
+		//
+		// Contact grows over the first scans and eases off on the last
+		//
+		int k = s - stroke.Start;
+		int percent = k == 0 ? 50 : k == 1 ? 80 : s == stroke.End - 1 ? 60 : 100;
+		int width = stroke.Width * (k == 0 ? 70 : percent) / 100 + Range(-stroke.Wobble, stroke.Wobble);
+		int pressure = stroke.Pressure * percent / 100 + Range(-2, 2);
+
+		if (m_PacketSize == PACKET_SIZE_OLD)
+			width = (width + 3) / 4;	// a nibble
+		contact->Width = (uint8_t)std::min(std::max(width, 1), m_PacketSize == PACKET_SIZE_OLD ? 15 : 255);
+		contact->Pressure = (uint8_t)std::min(std::max(pressure, 1), 255);
+	}
+
+	//
+	// Scans the strokes, lifts before touch-downs, and hands every packet
+	// to the read model
+	//
+	void Play(std::vector<GestureStroke>* strokes) {
+		int length = 0;
+		for (size_t n = 0; n < strokes->size(); n++)
+			length = std::max(length, (*strokes)[n].End);
+
+		USHORT used = 0;
+		for (int s = 0; s <= length && !m_Done; s++) {
+			USHORT freed = 0;
+			for (size_t n = 0; n < strokes->size(); n++) {
+				GestureStroke* stroke = &(*strokes)[n];
+				if (stroke->End == s && stroke->Slot >= 0) {
+					used &= ~(1 << stroke->Slot);
+					freed |= 1 << stroke->Slot;
+					stroke->Slot = -1;
+				}
+			}
+
+			//
+			// Lowest free slot, not one given up on this same scan
+			//
+			for (size_t n = 0; n < strokes->size(); n++) {
+				GestureStroke* stroke = &(*strokes)[n];
+				if (stroke->Start != s)
+					continue;
+				for (int slot = 0; slot < MAX_CONTACT_NUM; slot++) {
+					if (!((used | freed) & (1 << slot))) {
+						stroke->Slot = slot;
+						used |= 1 << slot;
+						break;
+					}
+				}
+			}
+
+			ELAN_SIM_CONTACT touch[MAX_CONTACT_NUM];
+			int down = 0;
+			for (size_t n = 0; n < strokes->size(); n++) {
+				const GestureStroke* stroke = &(*strokes)[n];
+				if (stroke->Slot < 0 || s < stroke->Start || s >= stroke->End)
+					continue;
+				touch[down].Slot = (uint8_t)stroke->Slot;
+				Position(*stroke, s, &touch[down]);
+				down++;
+			}
+
+			//
+			// Nothing while idle, one empty packet after the last lift
+			//
+			if (down || m_Down)
+				Scan(touch, down);
+			m_Down = down;
+			m_Scan++;
+		}
+
+		Flush();
+	}
+
+	//
+	// Read model: one packet per interrupt, or a read that finds two or
+	// three scans queued behind the wait handshake
+	//
+	void Scan(const ELAN_SIM_CONTACT* touch, int down) {
+		if (m_Queued.empty()) {
+			m_Target = (int)(Next() % 100) < (int)m_Script.BufferedPercent ? Range(2, ELAN_MAX_REPORT_COUNT) : 1;
+		}
+
+		m_Queued.resize(m_Queued.size() + m_PacketSize);
+		ElanSimBuildPacket(&m_Queued[m_Queued.size() - m_PacketSize], m_PacketSize, touch, down);
+
+		if ((int)(m_Queued.size() / m_PacketSize) >= m_Target || !down)
+			Flush();
+	}
+
+	void Flush() {
+		int count = (int)(m_Queued.size() / m_PacketSize);
+		if (!count)
+			return;
+
+		//
+		// Interrupt time of the last scan, plus the latency of raising and
+		// taking the interrupt
+		//
+		ULONGLONG time = ((ULONGLONG)m_Scan + 1) * ELAN_SCAN_PERIOD_US * 10 + Range(50, 1500);
+		uint8_t frame[MAX_PACKET_SIZE];
+
+		if (count == 1) {
+			Emit(time, frame, ElanSimBuildFrame(frame, QUEUE_HEADER_SINGLE, m_Queued.data(), 1, m_PacketSize));
+		}
+		else {
+			static const uint8_t wait[HEADER_SIZE] = {
+				QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT, QUEUE_HEADER_WAIT
+			};
+			Emit(time, wait, sizeof(wait));
+			Emit(time, frame, ElanSimBuildFrame(frame, QUEUE_HEADER_NORMAL, m_Queued.data(), count, m_PacketSize));
+		}
+
+		m_Queued.clear();
+	}
+
+	void Emit(ULONGLONG time, const uint8_t* frame, size_t length) {
+		if (m_Done)
+			return;
+
+		ElanStreamAppend(m_Stream, time, frame, length);
+
+		if ((m_Script.Frames && m_Stream->Frames.size() >= m_Script.Frames) ||
+			(m_Script.DurationMs && time >= (ULONGLONG)m_Script.DurationMs * 10000))
+			m_Done = true;
+	}
+
+	ELAN_GESTURE_SCRIPT m_Script;
+
+	PELAN_STREAM m_Stream;
+
+	uint64_t m_State;
+
+	int m_MaxX, m_MaxY;
+
+	size_t m_PacketSize;
+
+	double m_ScansPerSecond;
+
+	ULONGLONG m_Scan;	// scans since the start of the stream
+
+	int m_Down;	// contacts in the last packet
+
+	std::vector<uint8_t> m_Queued;	// packets not read yet
+
+	int m_Target;	// packets the next read finds
+
+	bool m_Done;
+};
+
+VOID
+ElanGestureGenerate(
+	IN const ELAN_GESTURE_SCRIPT* Script,
+	OUT PELAN_STREAM Stream
+)
+{
+	GestureGenerator generator(Script, Stream);
+	generator.Generate();
+}
@@ -0,0 +1,104 @@
+/*++
+
+Module Name:
+
+gesture.h
+
+Abstract:
+
+Gesture workload generator for the host tools. Turns a parameterized
+gesture script into the frame stream a controller would produce for it:
+fingers land and lift staggered by a few scans, taps are short with
+pressure ramping up and down, scrolls ease in and out or fling, pinches
+move five fingers along arcs, palms are large low pressure contacts that
+drift and change size, and resting contacts carry sensor noise. Slots are
+assigned the way the controller does, lowest free slot first.
+
+Every scan with a contact down produces a touch packet, and the scan
+after the last lift produces one with no contacts; an idle panel produces
+nothing. Packets are read one per interrupt in QUEUE_HEADER_SINGLE
+frames, except that a read may find two or three scans queued, in which
+case the interrupt reads the wait handshake and then a QUEUE_HEADER_NORMAL
+frame carrying all of them, as in buffer mode.
+
+Output is deterministic for a given script and seed.
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#pragma once
+
+#include "elanstream.h"
+
+typedef enum _ELAN_GESTURE_KIND
+{
+	ElanGestureTapStorm,	// overlapping quick taps and double taps
+	ElanGestureScroll,	// two finger scrolls and flings
+	ElanGesturePinch,	// five finger pinch in and out
+	ElanGesturePalmRest,	// resting palms with fingers tapping nearby
+	ElanGestureMix,	// all of the above in random order
+	ElanGestureKinds
+} ELAN_GESTURE_KIND;
+
+typedef struct _ELAN_GESTURE_SCRIPT
+{
+	ELAN_GESTURE_KIND Kind;
+
+	uint8_t Options;	// ELAN_SIM_OPT_*, selects the chip and panel
+
+	BOOLEAN OldFormat;	// PACKET_SIZE_OLD packets, eKTF only
+
+	ULONGLONG Seed;
+
+	ULONG DurationMs;	// stop after this much input, 0 no limit
+
+	ULONG Frames;	// or after this many frames, 0 no limit
+
+	ULONG Fingers;	// most fingers down at once in a tap storm or next to a palm
+
+	ULONG TapsPerSecond;
+
+	ULONG GestureMs;	// length of one scroll, pinch or palm rest
+
+	ULONG GapMs;	// longest idle time between gestures
+
+	ULONG Noise;	// counts of sensor noise on every contact
+
+	ULONG BufferedPercent;	// reads that find more than one scan queued
+} ELAN_GESTURE_SCRIPT, *PELAN_GESTURE_SCRIPT;
+
+//
+// Fills Script with the defaults for Kind, on an EKTH3500 panel
+//
+VOID
+ElanGestureDefaults(
+	IN ELAN_GESTURE_KIND Kind,
+	OUT PELAN_GESTURE_SCRIPT Script
+);
+
+//
+// Kind names as accepted on command lines: taps, scroll, pinch, palm, mix.
+// Returns ElanGestureKinds for an unknown name.
+//
+ELAN_GESTURE_KIND
+ElanGestureKindFromName(
+	IN const char* Name
+);
+
+const char*
+ElanGestureKindName(
+	IN ELAN_GESTURE_KIND Kind
+);
+
+//
+// Generates the stream for Script. At least one of DurationMs and Frames
+// must be set.
+//
+VOID
+ElanGestureGenerate(
+	IN const ELAN_GESTURE_SCRIPT* Script,
+	OUT PELAN_STREAM Stream
+);
@@ -0,0 +1,330 @@
+/*++
+
+Module Name:
+
+iap_update.cpp
+
+Abstract:
+
+End-to-end test of the IAP engine (iap.cpp) against the simulated boot
+code. Each scenario writes a firmware image into the given directory and
+updates a simulated controller with it through ElanStartFwUpdate and the
+update work item, then checks the flash contents, the controller and
+driver state afterwards and the firmware update report:
+
+  update     a clean update of a running controller
+  retries    pages whose acknowledgement fails and are written again
+  recovery   a page that never acknowledges, leaving the controller in
+             boot code, then the update in recovery mode that fixes it
+  busy       a second update requested while one is queued
+  health     an update requested while the health monitor recovers the
+             controller
+  remark     an image built for another panel, refused before anything
+             is erased
+  remark-rec the same image flashed to a controller in recovery mode
+  old-boot   the same image flashed through boot code too old to report
+             its remark ID
+  bad-image  an image that is not a whole number of pages
+  no-image   no image file
+
+Updates run in simulated time, the elapsed time printed is what they
+would take on the bus.
+
+Usage: iap_update [-pages=N] [-seed=S] <dir>
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "elansim.h"
+
+static int IapFailures;
+
+static void IapCheck(const char* scenario, bool ok, const char* what) {
+	if (!ok) {
+		fprintf(stderr, "FAIL: %s: %s\n", scenario, what);
+		IapFailures++;
+	}
+}
+
+static bool IapWriteImage(const std::string& path, const std::vector<uint8_t>& image) {
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+	return fclose(file) == 0 && ok;
+}
+
+static void IapStampRemarkId(std::vector<uint8_t>* image, uint16_t remarkId) {
+	(*image)[image->size() - ELAN_FW_REMARK_ID_OFFSET] = (uint8_t)remarkId;
+	(*image)[image->size() - ELAN_FW_REMARK_ID_OFFSET + 1] = (uint8_t)(remarkId >> 8);
+}
+
+static void IapPrint(const char* scenario, PELAN_SIM_DEVICE sim) {
+	ElanFwUpdateReport report;
+
+	RtlZeroMemory(&report, sizeof(report));
+	ElanFillFwUpdateReport(&sim->Context, &report);
+
+	static const char* const states[] = { "idle", "running", "done", "failed" };
+	printf("%-10s %-7s 0x%08x  %4u/%-4u pages  %5u ms  %3u retries, max %u on page %u, %u pages retried  %s\n",
+		scenario, report.State < ARRAYSIZE(states) ? states[report.State] : "?",
+		(unsigned)report.Status, report.PagesWritten, report.PageCount, (unsigned)report.ElapsedMs,
+		report.RetryTotal, report.RetryMax, report.RetryMaxPage, report.PagesRetried,
+		report.IapMode == ELAN_IAP_RECOVERY ? "recovery" : "operational");
+}
+
+static PELAN_SIM_DEVICE IapCreate(ULONG pages, BOOLEAN valid) {
+	PELAN_SIM_DEVICE sim = ElanSimCreate(EKTH3500, NULL, false);
+	if (!sim || !ElanSimBootInit(sim, pages, valid)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	ElanShimDeviceRestarts = 0;
+	return sim;
+}
+
+static bool IapFlashed(PELAN_SIM_DEVICE sim, const std::vector<uint8_t>& image) {
+	return sim->Boot.Valid && sim->Boot.PageCount * ELAN_FW_PAGESIZE == image.size() &&
+		!memcmp(sim->Boot.Flash, image.data(), image.size());
+}
+
+//
+// Checks a successful update left the new firmware running
+//
+static void IapCheckDone(const char* scenario, PELAN_SIM_DEVICE sim, const std::vector<uint8_t>& image) {
+	PELAN_FW_UPDATE_STATS stats = &sim->Context.FwUpdateStats;
+
+	IapCheck(scenario, sim->Context.FwUpdateState == FWUPDATE_STATE_DONE, "update did not complete");
+	IapCheck(scenario, stats->Status == STATUS_SUCCESS, "update status is not success");
+	IapCheck(scenario, stats->PageCount == image.size() / ELAN_FW_PAGESIZE, "wrong page count");
+	IapCheck(scenario, stats->PagesWritten == stats->PageCount, "not every page was written");
+	IapCheck(scenario, IapFlashed(sim, image), "flash does not hold the image");
+	IapCheck(scenario, sim->Boot.State == ElanSimBootRunning, "controller is not running firmware");
+	IapCheck(scenario, sim->Context.TouchScreenBooted, "driver did not boot the controller");
+	IapCheck(scenario, sim->Context.IapMode == ELAN_IAP_OPERATIONAL, "driver is still in recovery mode");
+	IapCheck(scenario, stats->ElapsedTime > 0, "no elapsed time reported");
+}
+
+int main(int argc, char** argv) {
+	ULONG pages = 256;
+	ULONGLONG seed = 1;
+	std::string dir;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 7, "-pages=") == 0)
+			pages = strtoul(arg.c_str() + 7, NULL, 0);
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else if (arg[0] != '-' && dir.empty())
+			dir = arg;
+		else
+			usage = true;
+	}
+
+	if (usage || dir.empty() || pages < 2 || pages * ELAN_FW_PAGESIZE > ELAN_FW_MAX_SIZE) {
+		fprintf(stderr, "usage: %s [-pages=N] [-seed=S] <dir>\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<uint8_t> image(pages * ELAN_FW_PAGESIZE);
+	srand((unsigned)seed);
+	for (size_t i = 0; i < image.size(); i++)
+		image[i] = (uint8_t)rand();
+	IapStampRemarkId(&image, ELAN_SIM_REMARK_ID);
+
+	std::vector<uint8_t> foreign(image);
+	IapStampRemarkId(&foreign, ELAN_SIM_REMARK_ID ^ 0x0101);
+
+	std::string path = dir + "/elants_i2c.bin";
+	std::string badPath = dir + "/elants_i2c-bad.bin";
+	std::string foreignPath = dir + "/elants_i2c-foreign.bin";
+	std::vector<uint8_t> bad(image.begin(), image.end() - 1);
+	if (!IapWriteImage(path, image) || !IapWriteImage(badPath, bad) ||
+		!IapWriteImage(foreignPath, foreign)) {
+		fprintf(stderr, "cannot write images to %s\n", dir.c_str());
+		return 1;
+	}
+
+	PELAN_SIM_DEVICE sim;
+	PELAN_FW_UPDATE_STATS stats;
+	NTSTATUS status;
+
+	sim = IapCreate(pages, true);
+	stats = &sim->Context.FwUpdateStats;
+	status = ElanSimFwUpdate(sim, path.c_str());
+	IapPrint("update", sim);
+	IapCheck("update", status == STATUS_SUCCESS, "update did not start");
+	IapCheckDone("update", sim, image);
+	IapCheck("update", stats->RetryTotal == 0 && stats->PagesRetried == 0, "retries without failures");
+	IapCheck("update", ElanShimDeviceRestarts == 0, "stack restarted after a normal update");
+	IapCheck("update", !sim->Boot.Error, sim->Boot.Error ? sim->Boot.Error : "");
+	ElanSimDestroy(sim);
+
+	//
+	// Every 16th page fails once and one page five times, all within
+	// MAX_FW_UPDATE_RETRIES
+	//
+	ULONG nakPage = pages / 3;
+	sim = IapCreate(pages, true);
+	stats = &sim->Context.FwUpdateStats;
+	sim->Boot.NakEvery = 16;
+	sim->Boot.NakPage = nakPage;
+	sim->Boot.NakCount = 5;
+	ElanSimFwUpdate(sim, path.c_str());
+	IapPrint("retries", sim);
+	IapCheckDone("retries", sim, image);
+	IapCheck("retries", stats->RetryTotal == sim->Boot.Naks, "retry total differs from the failed acks");
+	IapCheck("retries", stats->PagesRetried == pages / 16 + ((nakPage + 1) % 16 != 0), "wrong number of pages retried");
+	IapCheck("retries", stats->RetryMax == 5 && stats->RetryMaxPage == nakPage, "wrong worst page");
+	IapCheck("retries", !sim->Boot.Error, sim->Boot.Error ? sim->Boot.Error : "");
+	ElanSimDestroy(sim);
+
+	//
+	// A page that never acknowledges fails the update part way and leaves
+	// the controller in boot code, the next update goes through recovery
+	//
+	ULONG failPage = pages / 2;
+	sim = IapCreate(pages, true);
+	stats = &sim->Context.FwUpdateStats;
+	sim->Boot.NakPage = failPage;
+	sim->Boot.NakCount = MAX_FW_UPDATE_RETRIES;
+	ElanSimFwUpdate(sim, path.c_str());
+	IapPrint("recovery", sim);
+	IapCheck("recovery", sim->Context.FwUpdateState == FWUPDATE_STATE_FAILED, "update did not fail");
+	IapCheck("recovery", stats->Status == STATUS_DEVICE_DATA_ERROR, "wrong failure status");
+	IapCheck("recovery", stats->PagesWritten == failPage, "wrong pages written before the failure");
+	IapCheck("recovery", stats->RetryMax == MAX_FW_UPDATE_RETRIES && stats->RetryMaxPage == failPage,
+		"failing page not reported");
+	IapCheck("recovery", !sim->Boot.Valid && sim->Boot.State == ElanSimBootCode,
+		"controller is not left in boot code");
+	IapCheck("recovery", sim->Context.IapMode == ELAN_IAP_RECOVERY, "driver did not detect recovery mode");
+	IapCheck("recovery", !sim->Context.TouchScreenBooted, "driver booted a controller without firmware");
+
+	sim->Boot.NakPage = (ULONG)-1;
+	status = ElanSimFwUpdate(sim, path.c_str());
+	IapPrint("recovery", sim);
+	IapCheck("recovery", status == STATUS_SUCCESS, "recovery update did not start");
+	IapCheckDone("recovery", sim, image);
+	IapCheck("recovery", ElanShimDeviceRestarts == 1, "stack not restarted after recovery");
+	IapCheck("recovery", !sim->Boot.Error, sim->Boot.Error ? sim->Boot.Error : "");
+	ElanSimDestroy(sim);
+
+	//
+	// A start while one is queued is refused, the queued one still runs
+	//
+	sim = IapCreate(pages, true);
+	ElanShimFilePath = path.c_str();
+	ElanShimInterruptTime = sim->Boot.Time;
+	status = ElanStartFwUpdate(&sim->Context);
+	IapCheck("busy", status == STATUS_SUCCESS, "first update did not start");
+	status = ElanStartFwUpdate(&sim->Context);
+	IapCheck("busy", status == STATUS_DEVICE_BUSY, "second update was not refused");
+	ElanFwUpdateWorkItem(sim->Context.FwUpdateWorkItem);
+	ElanShimInterruptTime = 0;
+	ElanShimFilePath = NULL;
+	IapPrint("busy", sim);
+	IapCheckDone("busy", sim, image);
+	ElanSimDestroy(sim);
+
+	//
+	// A start while the health workitem owns the line is refused
+	//
+	sim = IapCreate(pages, true);
+	sim->Context.HealthRecovering = true;
+	status = ElanSimFwUpdate(sim, path.c_str());
+	IapPrint("health", sim);
+	IapCheck("health", status == STATUS_DEVICE_BUSY, "update started during health recovery");
+	IapCheck("health", sim->Context.FwUpdateState == FWUPDATE_STATE_IDLE, "update state changed");
+	IapCheck("health", sim->Boot.Transfers == 0, "controller was touched");
+	ElanSimDestroy(sim);
+
+	//
+	// An image built for another panel is refused before the controller
+	// enters IAP, which boots back into the firmware it has
+	//
+	sim = IapCreate(pages, true);
+	std::vector<uint8_t> flash(sim->Boot.Flash, sim->Boot.Flash + image.size());
+	status = ElanSimFwUpdate(sim, foreignPath.c_str());
+	IapPrint("remark", sim);
+	IapCheck("remark", status == STATUS_SUCCESS, "update did not start");
+	IapCheck("remark", sim->Context.FwUpdateState == FWUPDATE_STATE_FAILED, "update did not fail");
+	IapCheck("remark", sim->Context.FwUpdateStats.Status == STATUS_REVISION_MISMATCH, "wrong failure status");
+	IapCheck("remark", sim->Context.FwUpdateStats.PagesWritten == 0, "pages were written");
+	IapCheck("remark", sim->Boot.Valid && !memcmp(sim->Boot.Flash, flash.data(), flash.size()),
+		"flash was changed");
+	IapCheck("remark", sim->Boot.State == ElanSimBootRunning, "controller is not running firmware");
+	IapCheck("remark", sim->Context.TouchScreenBooted &&
+		sim->Context.IapMode == ELAN_IAP_OPERATIONAL, "driver state changed");
+	IapCheck("remark", ElanShimDeviceRestarts == 0, "stack restarted");
+	IapCheck("remark", !sim->Boot.Error, sim->Boot.Error ? sim->Boot.Error : "");
+	ElanSimDestroy(sim);
+
+	//
+	// A controller without firmware takes it, there is nothing to lose
+	//
+	sim = IapCreate(pages, false);
+	status = ElanSimFwUpdate(sim, foreignPath.c_str());
+	IapPrint("remark-rec", sim);
+	IapCheck("remark-rec", status == STATUS_SUCCESS, "update did not start");
+	IapCheckDone("remark-rec", sim, foreign);
+	IapCheck("remark-rec", !sim->Boot.Error, sim->Boot.Error ? sim->Boot.Error : "");
+	ElanSimDestroy(sim);
+
+	//
+	// Boot code before IAP version 0x60 has no remark ID to compare
+	//
+	sim = IapCreate(pages, true);
+	sim->Context.BcVersion = (ELAN_IAP_REMARK_ID_VERSION - 0x10) << 4;
+	status = ElanSimFwUpdate(sim, foreignPath.c_str());
+	IapPrint("old-boot", sim);
+	IapCheck("old-boot", status == STATUS_SUCCESS, "update did not start");
+	IapCheckDone("old-boot", sim, foreign);
+	IapCheck("old-boot", !sim->Boot.Error, sim->Boot.Error ? sim->Boot.Error : "");
+	ElanSimDestroy(sim);
+
+	//
+	// Images that cannot be loaded never reach the bus
+	//
+	const struct {
+		const char* Name;
+		std::string Path;
+		NTSTATUS Status;
+	} rejected[] = {
+		{ "bad-image", badPath, STATUS_INVALID_IMAGE_FORMAT },
+		{ "no-image", dir + "/missing.bin", STATUS_OBJECT_NAME_NOT_FOUND },
+	};
+
+	for (size_t n = 0; n < ARRAYSIZE(rejected); n++) {
+		sim = IapCreate(pages, true);
+		ElanSimFwUpdate(sim, rejected[n].Path.c_str());
+		IapPrint(rejected[n].Name, sim);
+		IapCheck(rejected[n].Name, sim->Context.FwUpdateState == FWUPDATE_STATE_FAILED, "update did not fail");
+		IapCheck(rejected[n].Name, sim->Context.FwUpdateStats.Status == rejected[n].Status, "wrong failure status");
+		IapCheck(rejected[n].Name, sim->Boot.Transfers == 0, "controller was touched");
+		IapCheck(rejected[n].Name, sim->Context.TouchScreenBooted &&
+			sim->Context.IapMode == ELAN_IAP_OPERATIONAL, "driver state changed");
+		ElanSimDestroy(sim);
+	}
+
+	if (IapFailures) {
+		fprintf(stderr, "%d checks failed\n", IapFailures);
+		return 1;
+	}
+
+	printf("all scenarios passed\n");
+	return 0;
+}
@@ -0,0 +1,354 @@
+/*++
+
+Module Name:
+
+eval_predictor.cpp
+
+Abstract:
+
+Offline evaluator for the motion predictor. Replays recorded streams, or
+generated gesture streams, through the simulated controller with the
+filters off to recover every contact's track in controller counts, then
+runs the driver's jitter filter and predictor over each track offline for
+every combination of horizon, alpha and beta asked for.
+
+At each report the predicted position is compared with where the contact
+actually was one horizon later, interpolated between its raw reports,
+and so is the position the driver reports without prediction. Reports
+whose horizon reaches past the lift, and reports before the predictor has
+ELAN_PREDICT_MIN_SAMPLES, are not scored. Errors are in controller
+counts; the best setting for each horizon is marked.
+
+Usage: eval_predictor [-script=taps|scroll|pinch|palm|mix] [-seed=S] [-ms=N]
+                      [-horizons=us,...] [-alpha=q8,...] [-beta=q8,...]
+                      [-no-jitter] [stream...]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gesture.h"
+
+struct EvalSample
+{
+	ULONGLONG Time;
+
+	uint16_t X;
+
+	uint16_t Y;
+};
+
+typedef std::vector<EvalSample> EvalTrack;
+
+struct EvalCapture
+{
+	std::map<BYTE, EvalTrack> Open;	// by contact ID
+
+	std::vector<EvalTrack> Tracks;
+};
+
+struct EvalError
+{
+	std::vector<double> Errors;
+
+	double Mean() const {
+		double sum = 0;
+		for (size_t i = 0; i < Errors.size(); i++)
+			sum += Errors[i];
+		return Errors.empty() ? 0 : sum / Errors.size();
+	}
+
+	double Percentile(double p) {
+		if (Errors.empty())
+			return 0;
+		size_t n = (size_t)(p / 100 * (Errors.size() - 1));
+		std::nth_element(Errors.begin(), Errors.begin() + n, Errors.end());
+		return Errors[n];
+	}
+
+	double Max() const {
+		return Errors.empty() ? 0 : *std::max_element(Errors.begin(), Errors.end());
+	}
+};
+
+static VOID EvalOnReport(PELAN_SIM_DEVICE Sim, const BYTE* Report, ULONG Length) {
+	EvalCapture* capture = (EvalCapture*)Sim->OnReportContext;
+	ULONG touchSize = (Sim->Context.Config.Flags & ELAN_CONFIG_PRESSURE) ?
+		sizeof(TOUCH) : FIELD_OFFSET(TOUCH, Pressure);
+	BYTE count = Report[Length - 1];
+
+	for (int n = 0; n < count && n < MULTI_MAX_COUNT; n++) {
+		TOUCH touch;
+		RtlZeroMemory(&touch, sizeof(touch));
+		RtlCopyMemory(&touch, &Report[1 + n * touchSize], touchSize);
+
+		if (!(touch.Status & MULTI_TIPSWITCH_BIT)) {
+			std::map<BYTE, EvalTrack>::iterator it = capture->Open.find(touch.ContactID);
+			if (it != capture->Open.end()) {
+				capture->Tracks.push_back(it->second);
+				capture->Open.erase(it);
+			}
+			continue;
+		}
+
+		EvalTrack& track = capture->Open[touch.ContactID];
+		EvalSample sample = { Sim->Context.FrameTime, touch.XValue, touch.YValue };
+
+		//
+		// Packets read together share the frame time, keep the last
+		//
+		if (!track.empty() && track.back().Time == sample.Time)
+			track.back() = sample;
+		else
+			track.push_back(sample);
+	}
+}
+
+//
+// Replays the stream with prediction, jitter filtering, coalescing and the
+// transform off, so reports carry the raw controller positions
+//
+static BOOLEAN EvalCaptureTracks(const ELAN_STREAM& stream, std::vector<EvalTrack>* tracks,
+	uint16_t* maxX, uint16_t* maxY) {
+	uint8_t options = (stream.Options & (ELAN_SIM_OPT_CHIP_EKTF | ELAN_SIM_OPT_NO_PRESSURE)) |
+		ELAN_SIM_OPT_NO_COALESCE | ELAN_SIM_OPT_NO_JITTER;
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(options, false);
+	if (!sim)
+		return false;
+
+	EvalCapture capture;
+	sim->OnReport = EvalOnReport;
+	sim->OnReportContext = &capture;
+	ElanStreamReplay(sim, &stream);
+
+	for (std::map<BYTE, EvalTrack>::iterator it = capture.Open.begin(); it != capture.Open.end(); ++it)
+		capture.Tracks.push_back(it->second);
+
+	tracks->insert(tracks->end(), capture.Tracks.begin(), capture.Tracks.end());
+	*maxX = sim->Context.max_x;
+	*maxY = sim->Context.max_y;
+	ElanSimDestroy(sim);
+	return true;
+}
+
+//
+// Raw position at Time, false past the end of the track
+//
+static bool EvalPositionAt(const EvalTrack& track, size_t from, ULONGLONG time, double* x, double* y) {
+	for (size_t i = from; i + 1 < track.size(); i++) {
+		const EvalSample& a = track[i];
+		const EvalSample& b = track[i + 1];
+		if (time > b.Time)
+			continue;
+
+		double f = (double)(time - a.Time) / (b.Time - a.Time);
+		*x = a.X + f * ((double)b.X - a.X);
+		*y = a.Y + f * ((double)b.Y - a.Y);
+		return true;
+	}
+
+	return false;
+}
+
+static void EvalRun(const std::vector<EvalTrack>& tracks, const ELAN_PREDICTOR_CONFIG* predict,
+	const ELAN_JITTER_CONFIG* jitter, uint16_t maxX, uint16_t maxY,
+	EvalError* predicted, EvalError* reported) {
+	for (size_t t = 0; t < tracks.size(); t++) {
+		const EvalTrack& track = tracks[t];
+		ELAN_PREDICTOR predictor;
+		ELAN_JITTER_FILTER filter;
+
+		ElanPredictorReset(&predictor);
+		ElanJitterReset(&filter);
+
+		for (size_t i = 0; i < track.size(); i++) {
+			uint16_t x = track[i].X, y = track[i].Y;
+
+			ElanJitterFilter(&filter, jitter, &x, &y);
+			ElanPredictorUpdate(&predictor, predict, x, y, track[i].Time);
+
+			double ax, ay;
+			if (predictor.Samples < ELAN_PREDICT_MIN_SAMPLES ||
+				!EvalPositionAt(track, i, track[i].Time + (ULONGLONG)predict->HorizonUs * 10, &ax, &ay))
+				continue;
+
+			uint16_t px = x, py = y;
+			ElanPredictorPredict(&predictor, predict, maxX, maxY, &px, &py);
+
+			predicted->Errors.push_back(hypot(px - ax, py - ay));
+			reported->Errors.push_back(hypot(x - ax, y - ay));
+		}
+	}
+}
+
+static bool EvalList(const char* value, std::vector<ULONG>* list) {
+	list->clear();
+	while (*value) {
+		char* end;
+		list->push_back(strtoul(value, &end, 0));
+		if (end == value || (*end && *end != ','))
+			return false;
+		value = *end ? end + 1 : end;
+	}
+	return !list->empty();
+}
+
+static void EvalUsage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-script=taps|scroll|pinch|palm|mix] [-seed=S] [-ms=N]\n"
+		"          [-horizons=us,...] [-alpha=q8,...] [-beta=q8,...] [-no-jitter] [stream...]\n",
+		name);
+}
+
+int main(int argc, char** argv) {
+	std::vector<ELAN_GESTURE_KIND> kinds;
+	std::vector<std::string> paths;
+	std::vector<ULONG> horizons, alphas, betas;
+	ULONGLONG seed = 1;
+	ULONG ms = 10000;
+	BOOLEAN jitterOn = true;
+
+	horizons.push_back(ELAN_SCAN_PERIOD_US / 2);
+	horizons.push_back(ELAN_SCAN_PERIOD_US);
+	horizons.push_back(ELAN_SCAN_PERIOD_US * 2);
+	alphas.push_back(128);
+	alphas.push_back(ELAN_PREDICT_ALPHA);
+	alphas.push_back(224);
+	betas.push_back(16);
+	betas.push_back(ELAN_PREDICT_BETA);
+	betas.push_back(64);
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool ok = true;
+
+		if (arg.compare(0, 8, "-script=") == 0) {
+			ELAN_GESTURE_KIND kind = ElanGestureKindFromName(arg.c_str() + 8);
+			ok = kind != ElanGestureKinds;
+			kinds.push_back(kind);
+		}
+		else if (arg.compare(0, 6, "-seed=") == 0)
+			seed = strtoull(arg.c_str() + 6, NULL, 0);
+		else if (arg.compare(0, 4, "-ms=") == 0)
+			ok = (ms = strtoul(arg.c_str() + 4, NULL, 0)) != 0;
+		else if (arg.compare(0, 10, "-horizons=") == 0)
+			ok = EvalList(arg.c_str() + 10, &horizons);
+		else if (arg.compare(0, 7, "-alpha=") == 0)
+			ok = EvalList(arg.c_str() + 7, &alphas);
+		else if (arg.compare(0, 6, "-beta=") == 0)
+			ok = EvalList(arg.c_str() + 6, &betas);
+		else if (arg == "-no-jitter")
+			jitterOn = false;
+		else if (arg[0] == '-')
+			ok = false;
+		else
+			paths.push_back(arg);
+
+		if (!ok) {
+			EvalUsage(argv[0]);
+			return 2;
+		}
+	}
+
+	//
+	// Moving contacts are what the predictor is for
+	//
+	if (kinds.empty() && paths.empty()) {
+		kinds.push_back(ElanGestureScroll);
+		kinds.push_back(ElanGesturePinch);
+	}
+
+	std::vector<EvalTrack> tracks;
+	uint16_t maxX = ELAN_SIM_MAX_X, maxY = ELAN_SIM_MAX_Y;
+	ULONGLONG frames = 0;
+
+	for (size_t i = 0; i < kinds.size() + paths.size(); i++) {
+		ELAN_STREAM stream;
+
+		if (i < kinds.size()) {
+			ELAN_GESTURE_SCRIPT script;
+			ElanGestureDefaults(kinds[i], &script);
+			script.Seed = seed;
+			script.DurationMs = ms;
+			script.Frames = 0;
+			ElanGestureGenerate(&script, &stream);
+		}
+		else if (!ElanStreamLoad(paths[i - kinds.size()].c_str(), &stream)) {
+			fprintf(stderr, "cannot read %s\n", paths[i - kinds.size()].c_str());
+			return 1;
+		}
+
+		if (!EvalCaptureTracks(stream, &tracks, &maxX, &maxY)) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		frames += stream.Frames.size();
+	}
+
+	ELAN_JITTER_CONFIG jitter;
+	jitter.HoldThreshold = jitterOn ? ELAN_JITTER_HOLD_THRESHOLD : 0;
+	jitter.MoveThreshold = ELAN_JITTER_MOVE_THRESHOLD;
+	jitter.SettleFrames = ELAN_JITTER_SETTLE_FRAMES;
+
+	printf("%llu frames, %zu tracks, jitter filter %s, errors in counts\n",
+		(unsigned long long)frames, tracks.size(), jitterOn ? "on" : "off");
+	printf("%8s %5s %5s %8s %8s %8s %8s %8s\n",
+		"horizon", "alpha", "beta", "scored", "mean", "p95", "max", "lag");
+
+	int status = 1;
+	for (size_t h = 0; h < horizons.size(); h++) {
+		std::vector<std::string> lines;
+		double bestMean = 0;
+		size_t best = (size_t)-1;
+
+		for (size_t a = 0; a < alphas.size(); a++) {
+			for (size_t b = 0; b < betas.size(); b++) {
+				ELAN_PREDICTOR_CONFIG predict;
+				EvalError predicted, reported;
+
+				predict.HorizonUs = horizons[h];
+				predict.Alpha = (uint16_t)alphas[a];
+				predict.Beta = (uint16_t)betas[b];
+				EvalRun(tracks, &predict, &jitter, maxX, maxY, &predicted, &reported);
+
+				//
+				// Lag is the error of the unpredicted position, the same for
+				// every setting
+				//
+				char line[128];
+				snprintf(line, sizeof(line), "%8u %5u %5u %8zu %8.1f %8.1f %8.1f %8.1f",
+					(unsigned)predict.HorizonUs, (unsigned)predict.Alpha, (unsigned)predict.Beta,
+					predicted.Errors.size(), predicted.Mean(), predicted.Percentile(95),
+					predicted.Max(), reported.Mean());
+				lines.push_back(line);
+
+				if (!predicted.Errors.empty()) {
+					status = 0;
+					if (best == (size_t)-1 || predicted.Mean() < bestMean) {
+						bestMean = predicted.Mean();
+						best = lines.size() - 1;
+					}
+				}
+			}
+		}
+
+		for (size_t n = 0; n < lines.size(); n++)
+			printf("%s%s\n", lines[n].c_str(), n == best ? "  best" : "");
+	}
+
+	if (status)
+		fprintf(stderr, "no reports could be scored\n");
+	return status;
+}
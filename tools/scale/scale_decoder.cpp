@@ -0,0 +1,227 @@
+/*++
+
+Module Name:
+
+scale_decoder.cpp
+
+Abstract:
+
+Multi-device scaling harness. Runs N independent simulated controllers,
+each with its own device context and workload on its own thread, for
+each N from 1 to the maximum, and prints aggregate frames per second,
+per-device latency percentiles and scaling efficiency.
+
+By default devices run flat out, which measures throughput and shows
+contention; with -paced every device reads its frames at their stream
+times, as the controller delivers them, and latency is measured from
+that deadline so scheduling delay counts too.
+
+Each device replays its own gesture stream of taps, scrolls, pinches
+and palm rests in random order, see tools/gesture.
+
+Every device's report stream is also compared with a run of the same
+workload alone. A difference means state is shared between device
+contexts and fails the run. Unthrottled efficiency is measured against
+the cores available, paced efficiency against every device keeping up
+with the scan rate; the former only gates the run with -min-efficiency.
+
+Usage: scale_decoder [-devices=N] [-frames=N] [-paced] [-min-efficiency=percent]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gesture.h"
+
+struct ScaleDevice
+{
+	ELAN_STREAM Stream;
+
+	ULONGLONG SoloHash;
+
+	ULONGLONG Hash;
+
+	std::vector<ULONGLONG> Latency;	// ns per frame
+};
+
+static ULONGLONG ScaleNow(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ULONGLONG)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void ScaleSleepUntil(ULONGLONG deadline) {
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+		;
+}
+
+//
+// A different gesture stream for every device
+//
+static void ScaleWorkload(PELAN_STREAM stream, size_t count, int device) {
+	ELAN_GESTURE_SCRIPT script;
+
+	ElanGestureDefaults(ElanGestureMix, &script);
+	script.Seed = 1 + device;
+	script.DurationMs = 0;
+	script.Frames = (ULONG)count;
+	ElanGestureGenerate(&script, stream);
+}
+
+static void ScaleRunDevice(ScaleDevice* device, bool paced, ULONGLONG start) {
+	const ELAN_STREAM* stream = &device->Stream;
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(stream->Options, false);
+	if (!sim) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	device->Latency.resize(stream->Frames.size());
+
+	for (size_t f = 0; f < stream->Frames.size(); f++) {
+		const ELAN_STREAM_FRAME* frame = &stream->Frames[f];
+		ULONGLONG begin;
+		if (paced) {
+			begin = start + (frame->Time - stream->Frames[0].Time) * 100;
+			ScaleSleepUntil(begin);
+		}
+		else
+			begin = ScaleNow();
+
+		ElanSimFrame(sim, frame->Data, frame->Length, frame->Time);
+		device->Latency[f] = ScaleNow() - begin;
+	}
+
+	device->Hash = sim->ReportHash;
+	ElanSimDestroy(sim);
+}
+
+static ULONGLONG ScalePercentile(std::vector<ULONGLONG>* sorted, double percentile) {
+	size_t index = (size_t)(percentile / 100 * (sorted->size() - 1));
+	return (*sorted)[index];
+}
+
+int main(int argc, char** argv) {
+	int maxDevices = 16;
+	size_t count = 20000;
+	bool paced = false;
+	double minEfficiency = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 9, "-devices=") == 0)
+			maxDevices = atoi(arg.c_str() + 9);
+		else if (arg.compare(0, 8, "-frames=") == 0)
+			count = strtoul(arg.c_str() + 8, NULL, 0);
+		else if (arg == "-paced")
+			paced = true;
+		else if (arg.compare(0, 16, "-min-efficiency=") == 0)
+			minEfficiency = atof(arg.c_str() + 16);
+		else {
+			fprintf(stderr, "usage: %s [-devices=N] [-frames=N] [-paced] [-min-efficiency=percent]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (maxDevices < 1 || maxDevices > 64 || count < 1) {
+		fprintf(stderr, "devices must be 1 to 64 and frames positive\n");
+		return 2;
+	}
+
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+	//
+	// Workloads and their solo report streams
+	//
+	std::vector<ScaleDevice> devices(maxDevices);
+	for (int d = 0; d < maxDevices; d++) {
+		ScaleWorkload(&devices[d].Stream, count, d);
+		ScaleRunDevice(&devices[d], false, 0);
+		devices[d].SoloHash = devices[d].Hash;
+	}
+
+	printf("%s, %zu frames per device, %u cores\n",
+		paced ? "paced at the stream times" : "unthrottled", count, cores);
+	printf("devices  frames/s total  frames/s each  p50 us  p99 us  p99.9 us   max us  efficiency\n");
+
+	double single = 0;
+	bool failed = false;
+
+	for (int n = 1; n <= maxDevices; n++) {
+		std::vector<std::thread> threads;
+		std::atomic<int> ready(0);
+		std::atomic<bool> go(false);
+		ULONGLONG start = 0;
+
+		for (int d = 0; d < n; d++) {
+			threads.push_back(std::thread([&, d]() {
+				ready++;
+				while (!go)
+					std::this_thread::yield();
+				ScaleRunDevice(&devices[d], paced, start);
+			}));
+		}
+
+		while (ready < n)
+			std::this_thread::yield();
+		start = ScaleNow() + 1000000;
+		ULONGLONG begin = ScaleNow();
+		go = true;
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		ULONGLONG elapsed = ScaleNow() - begin;
+
+		std::vector<ULONGLONG> all;
+		ULONGLONG worstP99 = 0;
+		for (int d = 0; d < n; d++) {
+			if (devices[d].Hash != devices[d].SoloHash) {
+				fprintf(stderr, "FAIL: device %d of %d reported differently than alone\n", d, n);
+				failed = true;
+			}
+
+			std::vector<ULONGLONG> sorted = devices[d].Latency;
+			std::sort(sorted.begin(), sorted.end());
+			worstP99 = std::max(worstP99, ScalePercentile(&sorted, 99));
+			all.insert(all.end(), sorted.begin(), sorted.end());
+		}
+
+		std::sort(all.begin(), all.end());
+		double aggregate = (double)n * count * 1e9 / elapsed;
+		if (n == 1)
+			single = aggregate;
+
+		//
+		// Against what the available cores could give flat out, and
+		// against every device keeping up with its stream when paced
+		//
+		double efficiency = aggregate / (single * (paced ? n : std::min((unsigned)n, cores))) * 100;
+
+		printf("%7d  %14.0f  %13.0f  %6.2f  %6.2f  %8.2f  %7.2f  %9.1f%%\n",
+			n, aggregate, aggregate / n,
+			ScalePercentile(&all, 50) / 1000.0, ScalePercentile(&all, 99) / 1000.0,
+			ScalePercentile(&all, 99.9) / 1000.0, all.back() / 1000.0, efficiency);
+		printf("         worst per-device p99 %.2f us\n", worstP99 / 1000.0);
+
+		if (!paced && minEfficiency > 0 && efficiency < minEfficiency) {
+			fprintf(stderr, "FAIL: %d devices scale at %.1f%%, below %.1f%%\n", n, efficiency, minEfficiency);
+			failed = true;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+/*++
+
+Module Name:
+
+hidport.h
+
+Abstract:
+
+Host stand-in for the HID minidriver header
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#pragma once
+
+#define HID_CTL_CODE(id) \
+	CTL_CODE(FILE_DEVICE_KEYBOARD, (id), METHOD_NEITHER, FILE_ANY_ACCESS)
+#define HID_IN_CTL_CODE(id) \
+	CTL_CODE(FILE_DEVICE_KEYBOARD, (id), METHOD_IN_DIRECT, FILE_ANY_ACCESS)
+#define HID_OUT_CTL_CODE(id) \
+	CTL_CODE(FILE_DEVICE_KEYBOARD, (id), METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+
+#define IOCTL_HID_GET_DEVICE_DESCRIPTOR             HID_CTL_CODE(0)
+#define IOCTL_HID_GET_REPORT_DESCRIPTOR             HID_CTL_CODE(1)
+#define IOCTL_HID_READ_REPORT                       HID_CTL_CODE(2)
+#define IOCTL_HID_WRITE_REPORT                      HID_CTL_CODE(3)
+#define IOCTL_HID_GET_STRING                        HID_CTL_CODE(4)
+#define IOCTL_HID_ACTIVATE_DEVICE                   HID_CTL_CODE(7)
+#define IOCTL_HID_DEACTIVATE_DEVICE                 HID_CTL_CODE(8)
+#define IOCTL_HID_GET_DEVICE_ATTRIBUTES             HID_CTL_CODE(9)
+#define IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST    HID_CTL_CODE(10)
+#define IOCTL_HID_SET_FEATURE                       HID_IN_CTL_CODE(100)
+#define IOCTL_HID_GET_FEATURE                       HID_OUT_CTL_CODE(100)
+#define IOCTL_HID_SET_OUTPUT_REPORT                 HID_IN_CTL_CODE(101)
+#define IOCTL_HID_GET_INPUT_REPORT                  HID_OUT_CTL_CODE(104)
+
+#pragma pack(push, 1)
+typedef struct _HID_DESCRIPTOR
+{
+	UCHAR bLength;
+	UCHAR bDescriptorType;
+	USHORT bcdHID;
+	UCHAR bCountry;
+	UCHAR bNumDescriptors;
+	struct _HID_DESCRIPTOR_DESC_LIST {
+		UCHAR bReportType;
+		USHORT wReportLength;
+	} DescriptorList[1];
+} HID_DESCRIPTOR, *PHID_DESCRIPTOR;
+#pragma pack(pop)
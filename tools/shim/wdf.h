@@ -0,0 +1,123 @@
+/*++
+
+Module Name:
+
+wdf.h
+
+Abstract:
+
+Host stand-in for the framework headers. Handles are opaque pointers;
+a device context is reached directly through its handle, so a host tool
+passes the context itself wherever the driver would pass a WDFDEVICE,
+and a work item's handle is its parent device's. There is no interrupt
+or timer to synchronize with, so their routines do nothing.
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#pragma once
+
+#include <stdlib.h>
+
+#include "wdm.h"
+
+#define WDF_DECLARE_HANDLE(h) typedef struct h##__ *h
+
+WDF_DECLARE_HANDLE(WDFDRIVER);
+WDF_DECLARE_HANDLE(WDFDEVICE);
+WDF_DECLARE_HANDLE(WDFQUEUE);
+WDF_DECLARE_HANDLE(WDFREQUEST);
+WDF_DECLARE_HANDLE(WDFINTERRUPT);
+WDF_DECLARE_HANDLE(WDFTIMER);
+WDF_DECLARE_HANDLE(WDFWORKITEM);
+WDF_DECLARE_HANDLE(WDFIOTARGET);
+WDF_DECLARE_HANDLE(WDFMEMORY);
+WDF_DECLARE_HANDLE(WDFWAITLOCK);
+WDF_DECLARE_HANDLE(WDFOBJECT);
+WDF_DECLARE_HANDLE(WDFCMRESLIST);
+
+typedef struct _WDFDEVICE_INIT *PWDFDEVICE_INIT;
+typedef struct _IRP *PIRP;
+
+#define WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(_contexttype, _castingfunction) \
+	inline _contexttype *_castingfunction(void *Handle) { return (_contexttype *)Handle; }
+
+typedef VOID EVT_WDF_DRIVER_UNLOAD(WDFDRIVER Driver);
+typedef NTSTATUS EVT_WDF_DRIVER_DEVICE_ADD(WDFDRIVER Driver, PWDFDEVICE_INIT DeviceInit);
+typedef NTSTATUS EVT_WDFDEVICE_WDM_IRP_PREPROCESS(WDFDEVICE Device, PIRP Irp);
+typedef VOID EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL(WDFQUEUE Queue, WDFREQUEST Request,
+	size_t OutputBufferLength, size_t InputBufferLength, ULONG IoControlCode);
+typedef VOID EVT_WDF_TIMER(WDFTIMER Timer);
+typedef VOID EVT_WDF_WORKITEM(WDFWORKITEM WorkItem);
+
+typedef struct _WDF_OBJECT_ATTRIBUTES *PWDF_OBJECT_ATTRIBUTES;
+#define WDF_NO_OBJECT_ATTRIBUTES NULL
+
+typedef enum _WDF_DEVICE_FAILED_ACTION {
+	WdfDeviceFailedAttemptRestart = 1,
+	WdfDeviceFailedNoRestart
+} WDF_DEVICE_FAILED_ACTION;
+
+FORCEINLINE VOID WdfInterruptAcquireLock(WDFINTERRUPT Interrupt) { (void)Interrupt; }
+FORCEINLINE VOID WdfInterruptReleaseLock(WDFINTERRUPT Interrupt) { (void)Interrupt; }
+FORCEINLINE VOID WdfInterruptEnable(WDFINTERRUPT Interrupt) { (void)Interrupt; }
+FORCEINLINE VOID WdfInterruptDisable(WDFINTERRUPT Interrupt) { (void)Interrupt; }
+
+#define WDF_REL_TIMEOUT_IN_MS(Time) (-(LONGLONG)(Time) * 10000)
+
+//
+// Timers never fire on the host, tools call the timer routines themselves
+//
+FORCEINLINE BOOLEAN WdfTimerStart(WDFTIMER Timer, LONGLONG DueTime) {
+	(void)Timer;
+	(void)DueTime;
+	return FALSE;
+}
+
+FORCEINLINE BOOLEAN WdfTimerStop(WDFTIMER Timer, BOOLEAN Wait) {
+	(void)Timer;
+	(void)Wait;
+	return FALSE;
+}
+
+FORCEINLINE WDFOBJECT WdfWorkItemGetParentObject(WDFWORKITEM WorkItem) {
+	return (WDFOBJECT)WorkItem;
+}
+
+//
+// Work items are run by the tool, queueing one does nothing
+//
+FORCEINLINE VOID WdfWorkItemEnqueue(WDFWORKITEM WorkItem) { (void)WorkItem; }
+
+//
+// Memory objects are the only objects created and deleted on the host,
+// the handle is the buffer
+//
+FORCEINLINE NTSTATUS WdfMemoryCreate(PWDF_OBJECT_ATTRIBUTES Attributes, POOL_TYPE PoolType,
+	ULONG PoolTag, size_t BufferSize, WDFMEMORY *Memory, PVOID *Buffer) {
+	(void)Attributes;
+	(void)PoolType;
+	(void)PoolTag;
+
+	*Buffer = malloc(BufferSize ? BufferSize : 1);
+	*Memory = (WDFMEMORY)*Buffer;
+	return *Buffer ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES;
+}
+
+FORCEINLINE VOID WdfObjectDelete(PVOID Object) {
+	free(Object);
+}
+
+//
+// Counts the restarts asked for, so tools can check for them
+//
+inline thread_local ULONG ElanShimDeviceRestarts;
+
+FORCEINLINE VOID WdfDeviceSetFailed(WDFDEVICE Device, WDF_DEVICE_FAILED_ACTION FailedAction) {
+	(void)Device;
+	if (FailedAction == WdfDeviceFailedAttemptRestart)
+		ElanShimDeviceRestarts++;
+}
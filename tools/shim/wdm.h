@@ -0,0 +1,292 @@
+/*++
+
+Module Name:
+
+wdm.h
+
+Abstract:
+
+Host stand-in for the kernel headers. Provides only the types, status
+codes and routines the framework independent parts of the driver use
+(the frame decoder, filters, report layouts and the IAP engine), with
+the same sizes as on Windows so packed report structures keep their
+layout.
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define IN
+#define OUT
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(n)
+#define __in
+#define __out
+#define CONST const
+#define VOID void
+#define FORCEINLINE inline __attribute__((always_inline))
+#define C_ASSERT(e) static_assert(e, #e)
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+
+typedef uint8_t UCHAR, *PUCHAR, BYTE, BOOLEAN, *PBOOLEAN;
+typedef char CHAR, *PCHAR;
+typedef uint16_t USHORT, *PUSHORT;
+typedef int16_t SHORT;
+typedef uint32_t ULONG, *PULONG, UINT32;
+typedef int32_t LONG, *PLONG, NTSTATUS;
+typedef int64_t LONGLONG, LONG64;
+typedef uint64_t ULONGLONG, *PULONGLONG;
+typedef void *PVOID;
+typedef uint16_t WCHAR;
+typedef WCHAR *PWSTR;
+typedef const WCHAR *PCWSTR;
+typedef size_t SIZE_T;
+typedef uintptr_t ULONG_PTR;
+typedef void *HANDLE;
+typedef HANDLE *PHANDLE;
+typedef ULONG ACCESS_MASK;
+typedef uint8_t KPROCESSOR_MODE;
+
+#define TRUE 1
+#define FALSE 0
+
+typedef union _LARGE_INTEGER {
+	struct {
+		ULONG LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _UNICODE_STRING {
+	USHORT Length;
+	USHORT MaximumLength;
+	PWSTR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef struct _DRIVER_OBJECT *PDRIVER_OBJECT;
+typedef NTSTATUS DRIVER_INITIALIZE(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath);
+
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+
+#define STATUS_SUCCESS                   ((NTSTATUS)0x00000000L)
+#define STATUS_UNSUCCESSFUL              ((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED           ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER         ((NTSTATUS)0xC000000DL)
+#define STATUS_NO_MORE_ENTRIES           ((NTSTATUS)0x8000001AL)
+#define STATUS_BUFFER_TOO_SMALL          ((NTSTATUS)0xC0000023L)
+#define STATUS_INVALID_DEVICE_REQUEST    ((NTSTATUS)0xC0000010L)
+#define STATUS_INVALID_BUFFER_SIZE       ((NTSTATUS)0xC0000206L)
+#define STATUS_DEVICE_NOT_READY          ((NTSTATUS)0xC00000A3L)
+#define STATUS_DEVICE_BUSY               ((NTSTATUS)0x80000011L)
+#define STATUS_IO_TIMEOUT                ((NTSTATUS)0xC00000B5L)
+#define STATUS_CANCELLED                 ((NTSTATUS)0xC0000120L)
+#define STATUS_DATA_ERROR                ((NTSTATUS)0xC000003EL)
+#define STATUS_INSUFFICIENT_RESOURCES    ((NTSTATUS)0xC000009AL)
+#define STATUS_PENDING                   ((NTSTATUS)0x00000103L)
+#define STATUS_BUFFER_OVERFLOW           ((NTSTATUS)0x80000005L)
+#define STATUS_END_OF_FILE               ((NTSTATUS)0xC0000011L)
+#define STATUS_INVALID_IMAGE_FORMAT      ((NTSTATUS)0xC000007BL)
+#define STATUS_REVISION_MISMATCH         ((NTSTATUS)0xC0000059L)
+#define STATUS_DEVICE_DATA_ERROR         ((NTSTATUS)0xC000009CL)
+#define STATUS_NOT_SUPPORTED             ((NTSTATUS)0xC00000BBL)
+#define STATUS_INVALID_DEVICE_STATE      ((NTSTATUS)0xC0000184L)
+#define STATUS_NO_CALLBACK_ACTIVE        ((NTSTATUS)0xC000021CL)
+#define STATUS_NOT_FOUND                 ((NTSTATUS)0xC0000225L)
+#define STATUS_OBJECT_NAME_NOT_FOUND     ((NTSTATUS)0xC0000034L)
+
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+	(((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+
+#define FILE_DEVICE_KEYBOARD             0x0000000b
+#define METHOD_BUFFERED                  0
+#define METHOD_IN_DIRECT                 1
+#define METHOD_OUT_DIRECT                2
+#define METHOD_NEITHER                   3
+#define FILE_ANY_ACCESS                  0
+
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define CONTAINING_RECORD(address, type, field) \
+	((type *)((char *)(address) - offsetof(type, field)))
+
+#define RtlZeroMemory(d, n) memset((d), 0, (n))
+#define RtlCopyMemory(d, s, n) memcpy((d), (s), (n))
+
+FORCEINLINE LONG InterlockedIncrement(volatile LONG *Addend) {
+	return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+FORCEINLINE LONG InterlockedExchange(volatile LONG *Target, LONG Value) {
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+FORCEINLINE LONG64 InterlockedIncrement64(volatile LONG64 *Addend) {
+	return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+#define KeMemoryBarrierWithoutFence() __asm__ __volatile__("" ::: "memory")
+
+//
+// 100ns units from a monotonic clock, like the interrupt time. While the
+// simulator decodes a frame it sets ElanShimInterruptTime to the frame's
+// time, so trace records carry the time of the replayed stream.
+//
+inline thread_local ULONGLONG ElanShimInterruptTime;
+
+FORCEINLINE ULONGLONG KeQueryInterruptTime(void) {
+	if (ElanShimInterruptTime)
+		return ElanShimInterruptTime;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ULONGLONG)ts.tv_sec * 10000000 + (ULONGLONG)ts.tv_nsec / 100;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ReadTimeStampCounter() ((ULONGLONG)__rdtsc())
+#else
+#define ReadTimeStampCounter() KeQueryInterruptTime()
+#endif
+
+//
+// Delays advance the interrupt time instead of sleeping while a tool has
+// set it, so simulated runs take no wall-clock time
+//
+#define KernelMode 0
+
+FORCEINLINE NTSTATUS KeDelayExecutionThread(KPROCESSOR_MODE WaitMode, BOOLEAN Alertable,
+	PLARGE_INTEGER Interval) {
+	(void)WaitMode;
+	(void)Alertable;
+
+	LONGLONG delay = Interval->QuadPart < 0 ? -Interval->QuadPart : 0;
+	if (ElanShimInterruptTime) {
+		ElanShimInterruptTime += delay;
+		return STATUS_SUCCESS;
+	}
+
+	struct timespec ts = { (time_t)(delay / 10000000), (long)(delay % 10000000) * 100 };
+	nanosleep(&ts, NULL);
+	return STATUS_SUCCESS;
+}
+
+//
+// Files. There is no object namespace on the host: ZwCreateFile opens
+// ElanShimFilePath whatever name it is given, and the name is not kept.
+//
+inline thread_local const char *ElanShimFilePath;
+
+typedef enum _POOL_TYPE {
+	NonPagedPool
+} POOL_TYPE;
+
+typedef struct _OBJECT_ATTRIBUTES {
+	PUNICODE_STRING ObjectName;
+	ULONG Attributes;
+} OBJECT_ATTRIBUTES, *POBJECT_ATTRIBUTES;
+
+#define OBJ_CASE_INSENSITIVE             0x00000040L
+#define OBJ_KERNEL_HANDLE                0x00000200L
+
+#define InitializeObjectAttributes(p, n, a, r, s) \
+	((p)->ObjectName = (n), (p)->Attributes = (a), (void)(r), (void)(s))
+
+typedef struct _IO_STATUS_BLOCK {
+	NTSTATUS Status;
+	ULONG_PTR Information;
+} IO_STATUS_BLOCK, *PIO_STATUS_BLOCK;
+
+typedef struct _FILE_STANDARD_INFORMATION {
+	LARGE_INTEGER AllocationSize;
+	LARGE_INTEGER EndOfFile;
+	ULONG NumberOfLinks;
+	BOOLEAN DeletePending;
+	BOOLEAN Directory;
+} FILE_STANDARD_INFORMATION;
+
+typedef enum _FILE_INFORMATION_CLASS {
+	FileStandardInformation = 5
+} FILE_INFORMATION_CLASS;
+
+#define GENERIC_READ                     0x80000000L
+#define SYNCHRONIZE                      0x00100000L
+#define FILE_ATTRIBUTE_NORMAL            0x00000080
+#define FILE_SHARE_READ                  0x00000001
+#define FILE_OPEN                        0x00000001
+#define FILE_NON_DIRECTORY_FILE          0x00000040
+#define FILE_SYNCHRONOUS_IO_NONALERT     0x00000020
+
+FORCEINLINE void RtlInitUnicodeString(PUNICODE_STRING Destination, const wchar_t *Source) {
+	(void)Source;
+	Destination->Length = 0;
+	Destination->MaximumLength = 0;
+	Destination->Buffer = NULL;
+}
+
+FORCEINLINE NTSTATUS ZwCreateFile(PHANDLE FileHandle, ACCESS_MASK DesiredAccess,
+	POBJECT_ATTRIBUTES ObjectAttributes, PIO_STATUS_BLOCK IoStatusBlock,
+	PLARGE_INTEGER AllocationSize, ULONG FileAttributes, ULONG ShareAccess,
+	ULONG CreateDisposition, ULONG CreateOptions, PVOID EaBuffer, ULONG EaLength) {
+	(void)DesiredAccess; (void)ObjectAttributes; (void)AllocationSize; (void)FileAttributes;
+	(void)ShareAccess; (void)CreateDisposition; (void)CreateOptions; (void)EaBuffer; (void)EaLength;
+
+	FILE *file = ElanShimFilePath ? fopen(ElanShimFilePath, "rb") : NULL;
+	IoStatusBlock->Status = file ? STATUS_SUCCESS : STATUS_OBJECT_NAME_NOT_FOUND;
+	IoStatusBlock->Information = 0;
+	*FileHandle = file;
+	return IoStatusBlock->Status;
+}
+
+FORCEINLINE NTSTATUS ZwQueryInformationFile(HANDLE FileHandle, PIO_STATUS_BLOCK IoStatusBlock,
+	PVOID FileInformation, ULONG Length, FILE_INFORMATION_CLASS FileInformationClass) {
+	FILE *file = (FILE *)FileHandle;
+	FILE_STANDARD_INFORMATION *info = (FILE_STANDARD_INFORMATION *)FileInformation;
+
+	if (FileInformationClass != FileStandardInformation || Length < sizeof(*info))
+		return STATUS_INVALID_PARAMETER;
+
+	long position = ftell(file);
+	fseek(file, 0, SEEK_END);
+	RtlZeroMemory(info, sizeof(*info));
+	info->EndOfFile.QuadPart = ftell(file);
+	info->AllocationSize = info->EndOfFile;
+	info->NumberOfLinks = 1;
+	fseek(file, position, SEEK_SET);
+
+	IoStatusBlock->Status = STATUS_SUCCESS;
+	IoStatusBlock->Information = sizeof(*info);
+	return STATUS_SUCCESS;
+}
+
+FORCEINLINE NTSTATUS ZwReadFile(HANDLE FileHandle, HANDLE Event, PVOID ApcRoutine,
+	PVOID ApcContext, PIO_STATUS_BLOCK IoStatusBlock, PVOID Buffer, ULONG Length,
+	PLARGE_INTEGER ByteOffset, PULONG Key) {
+	(void)Event; (void)ApcRoutine; (void)ApcContext; (void)ByteOffset; (void)Key;
+
+	size_t read = fread(Buffer, 1, Length, (FILE *)FileHandle);
+	IoStatusBlock->Status = read || !Length ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+	IoStatusBlock->Information = read;
+	return IoStatusBlock->Status;
+}
+
+FORCEINLINE NTSTATUS ZwClose(HANDLE Handle) {
+	fclose((FILE *)Handle);
+	return STATUS_SUCCESS;
+}
@@ -0,0 +1,334 @@
+/*++
+
+Module Name:
+
+elanboot.cpp
+
+Abstract:
+
+Simulated controller on the bus, see elansim.h: register reads answered
+by the running firmware and the boot code for the IAP engine. Stands in
+for the bus routines and the driver entry points the update work item
+calls. Every transfer takes its time at ELAN_SIM_I2C_HZ, and delays pass
+in simulated time, so an update runs instantly with the timing it would
+have on the bus.
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdlib.h>
+
+#include "elansim.h"
+
+static const uint8_t ElanBootCloseIdle[] = { 0x54, 0x2c, 0x01, 0x01 };
+static const uint8_t ElanBootReset[] = { 0x77, 0x77, 0x77, 0x77 };
+static const uint8_t ElanBootMain[] = { 0x4D, 0x61, 0x69, 0x6E };
+static const uint8_t ElanBootEnterIap[] = { 0x45, 0x49, 0x41, 0x50 };
+static const uint8_t ElanBootEnterIap2[] = { 0x54, 0x00, 0x12, 0x34 };
+static const uint8_t ElanBootHello[] = { 0x55, 0x55, 0x55, 0x55 };
+static const uint8_t ElanBootRecovery[] = { 0x55, 0x55, 0x80, 0x80 };
+static const uint8_t ElanBootIapAck[] = { 0x55, 0xaa, 0x33, 0xcc };
+static const uint8_t ElanBootPageAck[] = { 0xaa, 0xaa };
+static const uint8_t ElanBootPageNak[] = { 0x55, 0x55 };
+static const uint8_t ElanBootRemarkId[] = { CMD_HEADER_ROM_READ, 0x80, 0x1F, 0x00, 0x00, 0x21 };
+
+static PELAN_SIM_DEVICE ElanBootFromContext(PELAN_CONTEXT pDevice) {
+	return CONTAINING_RECORD(pDevice, ELAN_SIM_DEVICE, Context);
+}
+
+static void ElanBootRespond(PELAN_SIM_BOOT Boot, const uint8_t* Data, ULONG Length) {
+	RtlCopyMemory(Boot->Response, Data, Length);
+	Boot->ResponseLength = Length;
+}
+
+static void ElanBootError(PELAN_SIM_BOOT Boot, const char* Error) {
+	if (!Boot->Error)
+		Boot->Error = Error;
+}
+
+static void ElanBootTransfer(PELAN_SIM_BOOT Boot, size_t Size) {
+	Boot->Transfers++;
+	if (ElanShimInterruptTime)
+		ElanShimInterruptTime += (Size + 1) * 9 * 10000000ULL / ELAN_SIM_I2C_HZ;
+}
+
+template <size_t N>
+static BOOLEAN ElanBootCommand(const uint8_t* Data, size_t Size, const uint8_t (&Command)[N]) {
+	return Size == sizeof(Command) && !memcmp(Data, Command, sizeof(Command));
+}
+
+static void ElanBootPage(PELAN_SIM_BOOT Boot, const uint8_t* Page) {
+	if (!Boot->Cleared) {
+		Boot->Cleared = true;
+		ElanBootRespond(Boot, ElanBootPageAck, sizeof(ElanBootPageAck));
+		return;
+	}
+
+	if (Boot->NextPage >= Boot->PageCount) {
+		ElanBootError(Boot, "page written past the end of the flash");
+		ElanBootRespond(Boot, ElanBootPageNak, sizeof(ElanBootPageNak));
+		return;
+	}
+
+	ULONG page = Boot->NextPage;
+	ULONG naks = 0;
+	if (page == Boot->NakPage)
+		naks = Boot->NakCount;
+	else if (Boot->NakEvery && (page + 1) % Boot->NakEvery == 0)
+		naks = 1;
+
+	if (Boot->Attempts < naks) {
+		Boot->Attempts++;
+		Boot->Naks++;
+		ElanBootRespond(Boot, ElanBootPageNak, sizeof(ElanBootPageNak));
+		return;
+	}
+
+	RtlCopyMemory(&Boot->Flash[page * ELAN_FW_PAGESIZE], Page, ELAN_FW_PAGESIZE);
+	Boot->NextPage++;
+	Boot->Attempts = 0;
+	Boot->Valid = Boot->NextPage == Boot->PageCount;
+	ElanBootRespond(Boot, ElanBootPageAck, sizeof(ElanBootPageAck));
+}
+
+//
+// Bus routines
+//
+
+NTSTATUS
+elants_i2c_send(
+	PELAN_CONTEXT pDevice,
+	uint8_t *data,
+	size_t size
+)
+{
+	PELAN_SIM_BOOT boot = &ElanBootFromContext(pDevice)->Boot;
+
+	ElanBootTransfer(boot, size);
+
+	if (ElanBootCommand(data, size, ElanBootReset)) {
+		boot->State = ElanSimBootCode;
+		boot->ResponseLength = 0;
+		return STATUS_SUCCESS;
+	}
+
+	switch (boot->State) {
+	case ElanSimBootRunning:
+		if (ElanBootCommand(data, size, ElanBootCloseIdle))
+			return STATUS_SUCCESS;
+
+		//
+		// The answer comes back in the frame stream, see
+		// ElanSimCommandFrame
+		//
+		if (size == HEADER_SIZE && data[0] == CMD_HEADER_READ) {
+			const uint8_t answer[] = { CMD_HEADER_RESP, data[1],
+				(uint8_t)(boot->Register >> 8), (uint8_t)boot->Register };
+
+			if (boot->ResponseLength)
+				ElanBootError(boot, "register read while an answer is pending");
+			ElanBootRespond(boot, answer, sizeof(answer));
+			boot->Commands++;
+			return STATUS_SUCCESS;
+		}
+		break;
+
+	case ElanSimBootCode:
+		if (ElanBootCommand(data, size, ElanBootMain)) {
+			if (boot->Valid) {
+				boot->State = ElanSimBootRunning;
+				ElanBootRespond(boot, ElanBootHello, sizeof(ElanBootHello));
+			}
+			else
+				ElanBootRespond(boot, ElanBootRecovery, sizeof(ElanBootRecovery));
+			return STATUS_SUCCESS;
+		}
+
+		if (ElanBootCommand(data, size, ElanBootRemarkId)) {
+			const uint8_t answer[] = { CMD_HEADER_ROM_RESP, 0x80, 0x1F,
+				(uint8_t)(boot->RemarkId >> 8), (uint8_t)boot->RemarkId, 0x00 };
+
+			ElanBootRespond(boot, answer, sizeof(answer));
+			return STATUS_SUCCESS;
+		}
+
+		if (ElanBootCommand(data, size, ElanBootEnterIap) ||
+			ElanBootCommand(data, size, ElanBootEnterIap2)) {
+			boot->State = ElanSimBootIap;
+			ElanBootRespond(boot, ElanBootIapAck, sizeof(ElanBootIapAck));
+			return STATUS_SUCCESS;
+		}
+		break;
+
+	case ElanSimBootIap:
+		if (size == 1 && data[0] == ELAN_IAP_SEND_ID) {
+			boot->State = ElanSimBootPages;
+			boot->Valid = false;
+			boot->Cleared = false;
+			boot->NextPage = 0;
+			boot->Attempts = 0;
+			return STATUS_SUCCESS;
+		}
+		break;
+
+	case ElanSimBootPages:
+		if (size == ELAN_FW_PAGESIZE) {
+			ElanBootPage(boot, data);
+			return STATUS_SUCCESS;
+		}
+		break;
+	}
+
+	ElanBootError(boot, "unexpected write for the controller state");
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+elants_i2c_read(
+	PELAN_CONTEXT pDevice,
+	uint8_t *data,
+	size_t size
+)
+{
+	PELAN_SIM_BOOT boot = &ElanBootFromContext(pDevice)->Boot;
+
+	ElanBootTransfer(boot, size);
+
+	RtlZeroMemory(data, size);
+	if (!boot->ResponseLength) {
+		ElanBootError(boot, "read with no answer pending");
+		return STATUS_SUCCESS;
+	}
+
+	RtlCopyMemory(data, boot->Response, size < boot->ResponseLength ? size : boot->ResponseLength);
+	boot->ResponseLength = 0;
+	return STATUS_SUCCESS;
+}
+
+BOOLEAN
+ElanSimCommandFrame(
+	IN PELAN_SIM_DEVICE Sim,
+	IN ULONGLONG Time
+)
+{
+	PELAN_SIM_BOOT boot = &Sim->Boot;
+
+	if (boot->State != ElanSimBootRunning || !boot->ResponseLength)
+		return false;
+
+	uint8_t frame[HEADER_SIZE];
+	RtlCopyMemory(frame, boot->Response, sizeof(frame));
+	boot->ResponseLength = 0;
+
+	ElanSimFrame(Sim, frame, sizeof(frame), Time);
+	return true;
+}
+
+//
+// Driver entry points called by the update work item
+//
+
+NTSTATUS
+BOOTTOUCHSCREEN(
+	_In_  PELAN_CONTEXT  devContext
+)
+{
+	uint8_t soft_rst_cmd[] = { 0x77, 0x77, 0x77, 0x77 };
+	uint8_t boot_cmd[] = { 0x4D, 0x61, 0x69, 0x6E };
+	uint8_t buf[HEADER_SIZE];
+	LARGE_INTEGER delay;
+
+	if (devContext->TouchScreenBooted)
+		return STATUS_SUCCESS;
+
+	devContext->IapMode = ELAN_IAP_OPERATIONAL;
+
+	elants_i2c_send(devContext, soft_rst_cmd, sizeof(soft_rst_cmd));
+	delay.QuadPart = -30 * 10;
+	KeDelayExecutionThread(KernelMode, FALSE, &delay);
+
+	elants_i2c_send(devContext, boot_cmd, sizeof(boot_cmd));
+	delay.QuadPart = -1 * (LONGLONG)devContext->Config.BootDelayMs * 10000;
+	KeDelayExecutionThread(KernelMode, FALSE, &delay);
+
+	elants_i2c_read(devContext, buf, sizeof(buf));
+	if (!memcmp(buf, ElanBootRecovery, sizeof(ElanBootRecovery))) {
+		devContext->IapMode = ELAN_IAP_RECOVERY;
+		return STATUS_SUCCESS;
+	}
+
+	if (memcmp(buf, ElanBootHello, sizeof(ElanBootHello)))
+		return STATUS_DEVICE_DATA_ERROR;
+
+	devContext->TouchScreenBooted = true;
+	return STATUS_SUCCESS;
+}
+
+VOID
+ElanStopPolling(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	UNREFERENCED_PARAMETER(pDevice);
+}
+
+//
+// Simulated boot code
+//
+
+BOOLEAN
+ElanSimBootInit(
+	IN PELAN_SIM_DEVICE Sim,
+	IN ULONG PageCount,
+	IN BOOLEAN Valid
+)
+{
+	PELAN_SIM_BOOT boot = &Sim->Boot;
+	PELAN_CONTEXT pDevice = &Sim->Context;
+
+	free(boot->Flash);
+	RtlZeroMemory(boot, sizeof(*boot));
+
+	boot->Flash = (uint8_t*)malloc((size_t)PageCount * ELAN_FW_PAGESIZE + 1);
+	if (!boot->Flash)
+		return false;
+	memset(boot->Flash, 0xff, (size_t)PageCount * ELAN_FW_PAGESIZE);
+
+	boot->PageCount = PageCount;
+	boot->NextPage = Valid ? PageCount : 0;
+	boot->Valid = Valid;
+	boot->State = Valid ? ElanSimBootRunning : ElanSimBootCode;
+	boot->NakPage = (ULONG)-1;
+	boot->Time = 10000000;
+	boot->RemarkId = ELAN_SIM_REMARK_ID;
+
+	pDevice->TouchScreenBooted = Valid;
+	pDevice->IapMode = Valid ? ELAN_IAP_OPERATIONAL : ELAN_IAP_RECOVERY;
+	pDevice->BcVersion = ELAN_SIM_BC_VERSION;
+	pDevice->FwUpdateWorkItem = (WDFWORKITEM)pDevice;
+	return true;
+}
+
+NTSTATUS
+ElanSimFwUpdate(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const char* Path
+)
+{
+	PELAN_CONTEXT pDevice = &Sim->Context;
+
+	ElanShimFilePath = Path;
+	ElanShimInterruptTime = Sim->Boot.Time;
+
+	NTSTATUS status = ElanStartFwUpdate(pDevice);
+	if (NT_SUCCESS(status))
+		ElanFwUpdateWorkItem(pDevice->FwUpdateWorkItem);
+
+	Sim->Boot.Time = ElanShimInterruptTime;
+	ElanShimInterruptTime = 0;
+	ElanShimFilePath = NULL;
+	return status;
+}
@@ -0,0 +1,381 @@
+/*++
+
+Module Name:
+
+elansim.cpp
+
+Abstract:
+
+Simulated controller for the host tools, see elansim.h
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdlib.h>
+
+#include "elansim.h"
+
+static PELAN_SIM_DEVICE ElanSimFromContext(PELAN_CONTEXT pDevice) {
+	return CONTAINING_RECORD(pDevice, ELAN_SIM_DEVICE, Context);
+}
+
+//
+// Driver entry points called by the decoder
+//
+
+NTSTATUS
+ElanProcessVendorReport(
+	IN PELAN_CONTEXT DevContext,
+	IN PVOID ReportBuffer,
+	IN ULONG ReportBufferLen,
+	OUT size_t* BytesWritten
+)
+{
+	PELAN_SIM_DEVICE sim = ElanSimFromContext(DevContext);
+
+	sim->Deliveries++;
+	if (sim->DropEvery && sim->Deliveries % sim->DropEvery == 0) {
+		ElanCount(DevContext, QueueMisses);
+		return STATUS_NO_MORE_ENTRIES;
+	}
+
+	const BYTE* report = (const BYTE*)ReportBuffer;
+	for (ULONG i = 0; i < ReportBufferLen; i++) {
+		sim->ReportHash ^= report[i];
+		sim->ReportHash *= 0x100000001b3ULL;
+	}
+
+	sim->Reports++;
+	if (sim->OnReport)
+		sim->OnReport(sim, report, ReportBufferLen);
+
+	*BytesWritten = ReportBufferLen;
+	ElanCount(DevContext, ReportsDelivered);
+	return STATUS_SUCCESS;
+}
+
+VOID
+ElanArmSweepTimer(
+	IN PELAN_CONTEXT pDevice
+)
+{
+	UNREFERENCED_PARAMETER(pDevice);
+}
+
+//
+// Simulated device
+//
+
+VOID
+ElanSimDefaultConfig(
+	OUT PELAN_CONFIG Config
+)
+{
+	RtlZeroMemory(Config, sizeof(*Config));
+	Config->PollPeriodUs = ELAN_POLL_PERIOD_US;
+	Config->PollIdleMs = ELAN_POLL_IDLE_MS;
+	Config->DuplicateMax = ELAN_DUPLICATE_MAX;
+	Config->ReportPressure = ELAN_REPORT_PRESSURE;
+	Config->Predict.HorizonUs = ELAN_PREDICT_HORIZON_US;
+	Config->Predict.Alpha = ELAN_PREDICT_ALPHA;
+	Config->Predict.Beta = ELAN_PREDICT_BETA;
+	Config->Jitter.HoldThreshold = ELAN_JITTER_HOLD_THRESHOLD;
+	Config->Jitter.MoveThreshold = ELAN_JITTER_MOVE_THRESHOLD;
+	Config->Jitter.SettleFrames = ELAN_JITTER_SETTLE_FRAMES;
+	Config->ReleaseTimeoutUs = ELAN_RELEASE_TIMEOUT_SCANS * ELAN_SCAN_PERIOD_US;
+	Config->IdleTimeoutMs = ELAN_IDLE_TIMEOUT_MS;
+	Config->BootDelayMs = BOOT_TIME_DELAY_MS;
+	Config->BootRetries = MAX_RETRIES;
+
+	ElanSimConfigFlags(Config);
+}
+
+VOID
+ElanSimConfigFlags(
+	IN OUT PELAN_CONFIG Config
+)
+{
+	Config->Flags = 0;
+	if (Config->PollPeriodUs != 0)
+		Config->Flags |= ELAN_CONFIG_POLLING;
+	if (Config->DuplicateMax != 0)
+		Config->Flags |= ELAN_CONFIG_COALESCE;
+	if (Config->ReportPressure)
+		Config->Flags |= ELAN_CONFIG_PRESSURE;
+	if (Config->Predict.HorizonUs != 0)
+		Config->Flags |= ELAN_CONFIG_PREDICT;
+	if (Config->Jitter.HoldThreshold != 0)
+		Config->Flags |= ELAN_CONFIG_JITTER;
+	if (Config->ReleaseTimeoutUs != 0)
+		Config->Flags |= ELAN_CONFIG_SWEEP;
+	if (Config->IdleTimeoutMs != 0)
+		Config->Flags |= ELAN_CONFIG_IDLE;
+}
+
+PELAN_SIM_DEVICE
+ElanSimCreate(
+	IN UCHAR Chip,
+	IN const ELAN_CONFIG* Config,
+	IN BOOLEAN Reference
+)
+{
+	PELAN_SIM_DEVICE sim = (PELAN_SIM_DEVICE)calloc(1, sizeof(*sim));
+	if (!sim)
+		return NULL;
+
+	PELAN_CONTEXT pDevice = &sim->Context;
+
+	if (Config)
+		pDevice->Config = *Config;
+	else
+		ElanSimDefaultConfig(&pDevice->Config);
+
+	if (Chip == EKTF3624) {
+		sim->ChipOps.Name = "EKTF3624";
+		sim->ChipOps.Frame = Reference ? ElanReferenceFrameEktf3624 : elants_i2c_frame_ektf3624;
+		pDevice->max_x = ELAN_EKTF_MAX_X;
+		pDevice->max_y = ELAN_EKTF_MAX_Y;
+	}
+	else {
+		sim->ChipOps.Name = "EKTH3500";
+		sim->ChipOps.Frame = Reference ? ElanReferenceFrameEkth3500 : elants_i2c_frame_ekth3500;
+		pDevice->max_x = ELAN_SIM_MAX_X;
+		pDevice->max_y = ELAN_SIM_MAX_Y;
+	}
+
+	pDevice->Chip = &sim->ChipOps;
+	pDevice->DeviceMode = DEVICE_MODE_MULTI_INPUT;
+	pDevice->ConnectInterrupt = true;
+	pDevice->TouchScreenBooted = true;
+	pDevice->QueueReads = ELAN_QUEUE_MAX_READS;
+
+	ElanTransformInit(&pDevice->Transform, &pDevice->Config.Transform,
+		pDevice->max_x, pDevice->max_y);
+
+	sim->ReportHash = ELAN_SIM_HASH_SEED;
+	return sim;
+}
+
+PELAN_SIM_DEVICE
+ElanSimCreateWithOptions(
+	IN uint8_t Options,
+	IN BOOLEAN Reference
+)
+{
+	ELAN_CONFIG config;
+
+	ElanSimDefaultConfig(&config);
+	if (Options & ELAN_SIM_OPT_NO_PRESSURE)
+		config.ReportPressure = 0;
+	if (Options & ELAN_SIM_OPT_PREDICT)
+		config.Predict.HorizonUs = ELAN_SCAN_PERIOD_US;
+	if (Options & ELAN_SIM_OPT_NO_COALESCE)
+		config.DuplicateMax = 0;
+	if (Options & ELAN_SIM_OPT_NO_JITTER)
+		config.Jitter.HoldThreshold = 0;
+	config.Transform.SwapXY = !!(Options & ELAN_SIM_OPT_SWAP_XY);
+	config.Transform.InvertX = !!(Options & ELAN_SIM_OPT_INVERT);
+	config.Transform.InvertY = !!(Options & ELAN_SIM_OPT_INVERT);
+	ElanSimConfigFlags(&config);
+
+	PELAN_SIM_DEVICE sim = ElanSimCreate((Options & ELAN_SIM_OPT_CHIP_EKTF) ? EKTF3624 : EKTH3500,
+		&config, Reference);
+	if (sim && (Options & ELAN_SIM_OPT_DROP_REPORTS))
+		sim->DropEvery = ELAN_SIM_DROP_EVERY;
+
+	return sim;
+}
+
+VOID
+ElanSimDestroy(
+	IN PELAN_SIM_DEVICE Sim
+)
+{
+	free(Sim->Boot.Flash);
+	free(Sim);
+}
+
+BOOLEAN
+ElanSimFrame(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const uint8_t* Frame,
+	IN size_t Length,
+	IN ULONGLONG Time
+)
+{
+	uint8_t buf[MAX_PACKET_SIZE];
+
+	if (Length > sizeof(buf))
+		Length = sizeof(buf);
+
+	RtlCopyMemory(buf, Frame, Length);
+	RtlZeroMemory(buf + Length, sizeof(buf) - Length);
+
+	Sim->Context.FrameTime = Time;
+	ElanCount(&Sim->Context, Frames);
+
+	ElanShimInterruptTime = Time;
+	BOOLEAN wait = Sim->Context.Chip->Frame(&Sim->Context, buf);
+	ElanShimInterruptTime = 0;
+	return wait;
+}
+
+VOID
+ElanSimBuildPacket(
+	OUT uint8_t* Packet,
+	IN size_t PacketSize,
+	IN const ELAN_SIM_CONTACT* Contacts,
+	IN int Count
+)
+{
+	uint16_t state = 0;
+
+	RtlZeroMemory(Packet, PacketSize);
+	Packet[FW_POS_HEADER] = HEADER_REPORT_10_FINGER;
+
+	for (int n = 0; n < Count; n++) {
+		const ELAN_SIM_CONTACT* contact = &Contacts[n];
+		int i = contact->Slot;
+		uint8_t* pos = &Packet[FW_POS_XY + i * 3];
+
+		state |= 1 << i;
+		pos[0] = (uint8_t)(((contact->X >> 4) & 0xf0) | ((contact->Y >> 8) & 0x0f));
+		pos[1] = (uint8_t)contact->X;
+		pos[2] = (uint8_t)contact->Y;
+
+		if (PacketSize == PACKET_SIZE_OLD) {
+			Packet[FW_POS_WIDTH + i / 2] |= (contact->Width & 0x0f) << (4 * (~i & 1));
+		}
+		else {
+			Packet[FW_POS_WIDTH + i] = contact->Width;
+			Packet[FW_POS_PRESSURE + i] = contact->Pressure;
+		}
+	}
+
+	Packet[FW_POS_STATE] = (uint8_t)state;
+	Packet[FW_POS_STATE + 1] = (uint8_t)(((state >> 4) & 0x30) | (Count & 0x0f));
+
+	uint8_t checksum = 0;
+	for (int i = 0; i < FW_POS_CHECKSUM; i++)
+		checksum += Packet[i];
+	Packet[FW_POS_CHECKSUM] = checksum;
+}
+
+size_t
+ElanSimBuildFrame(
+	OUT uint8_t* Frame,
+	IN uint8_t Header,
+	IN const uint8_t* Packets,
+	IN int Count,
+	IN size_t PacketSize
+)
+{
+	size_t length = HEADER_SIZE + Count * PacketSize;
+
+	RtlZeroMemory(Frame, MAX_PACKET_SIZE);
+	if (length > MAX_PACKET_SIZE)
+		return 0;
+
+	Frame[FW_HDR_TYPE] = Header;
+	Frame[FW_HDR_COUNT] = (uint8_t)Count;
+	Frame[FW_HDR_LENGTH] = (uint8_t)(Count * PacketSize);
+	RtlCopyMemory(&Frame[HEADER_SIZE], Packets, Count * PacketSize);
+
+	return length;
+}
+
+const char*
+ElanSimCheckContacts(
+	IN PELAN_SIM_DEVICE Sim
+)
+{
+	PELAN_CONTEXT pDevice = &Sim->Context;
+	USHORT slots = 0;
+	USHORT ids = 0;
+
+	if (pDevice->LiveCount > MAX_CONTACT_NUM)
+		return "live count above MAX_CONTACT_NUM";
+
+	for (int n = 0; n < pDevice->LiveCount; n++) {
+		int i = pDevice->LiveSlots[n];
+		if (i >= MAX_CONTACT_NUM)
+			return "live slot out of range";
+		if (slots & (1 << i))
+			return "slot listed twice";
+		if (!pDevice->Flags[i])
+			return "live slot without flags";
+
+		uint8_t id = pDevice->ContactIds[i];
+		if (id >= MULTI_MAX_COUNT)
+			return "contact ID out of range";
+		if (ids & (1 << id))
+			return "contact ID given twice";
+		if (!(pDevice->ContactIdsInUse & (1 << id)))
+			return "contact ID not marked in use";
+
+		slots |= 1 << i;
+		ids |= 1 << id;
+	}
+
+	if (ids != pDevice->ContactIdsInUse)
+		return "contact ID in use without a live slot";
+
+	for (int i = 0; i < MAX_CONTACT_NUM; i++) {
+		if (!(slots & (1 << i)) && pDevice->Flags[i])
+			return "flagged slot missing from the live list";
+	}
+
+	return NULL;
+}
+
+const char*
+ElanSimCheckReport(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const BYTE* Report,
+	IN ULONG Length
+)
+{
+	PELAN_CONTEXT pDevice = &Sim->Context;
+	ULONG touchSize = (pDevice->Config.Flags & ELAN_CONFIG_PRESSURE) ?
+		sizeof(TOUCH) : FIELD_OFFSET(TOUCH, Pressure);
+	USHORT ids = 0;
+
+	if (Length != 2 + MULTI_MAX_COUNT * touchSize)
+		return "bad report length";
+	if (Report[0] != REPORTID_MTOUCH)
+		return "bad report ID";
+
+	BYTE count = Report[Length - 1];
+	if (count == 0 || count > MULTI_MAX_COUNT)
+		return "bad contact count";
+
+	for (int n = 0; n < MULTI_MAX_COUNT; n++) {
+		TOUCH touch;
+		RtlZeroMemory(&touch, sizeof(touch));
+		RtlCopyMemory(&touch, &Report[1 + n * touchSize], touchSize);
+
+		if (n >= count) {
+			static const TOUCH empty = {};
+			if (memcmp(&touch, &empty, sizeof(touch)))
+				return "unused contact slot not zero";
+			continue;
+		}
+
+		if (touch.Status != (MULTI_CONFIDENCE_BIT | MULTI_TIPSWITCH_BIT) &&
+			touch.Status != MULTI_CONFIDENCE_BIT)
+			return "bad contact status";
+		if (touch.ContactID >= MULTI_MAX_COUNT)
+			return "contact ID out of range";
+		if (ids & (1 << touch.ContactID))
+			return "contact ID reported twice";
+		if (touch.XValue > pDevice->Transform.MaxX || touch.YValue > pDevice->Transform.MaxY)
+			return "position outside the logical range";
+
+		ids |= 1 << touch.ContactID;
+	}
+
+	return NULL;
+}
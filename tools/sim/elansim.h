@@ -0,0 +1,329 @@
+/*++
+
+Module Name:
+
+elansim.h
+
+Abstract:
+
+Simulated controller for the host tools. A simulated device owns a
+device context set up as if the controller had booted, feeds it frames
+through the chip's frame decoder and stands in for the few driver entry
+points the decoder calls: delivered reports are handed to a callback
+instead of HIDclass and the sweeper timer is never armed.
+
+The device also simulates the controller on the bus, see elanboot.cpp:
+the running firmware answers register reads sent through the command
+channel, and the boot code takes the IAP engine through an update.
+
+Include standard headers before this one, elan.h defines true and false.
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#pragma once
+
+#include "elan.h"
+
+//
+// Panel geometry used when a tool does not ask for one, that of the
+// EKTH3500 parts
+//
+
+#define ELAN_SIM_MAX_X	3199
+#define ELAN_SIM_MAX_Y	1799
+
+typedef struct _ELAN_SIM_CONTACT
+{
+	uint8_t Slot;	// 0 to MAX_CONTACT_NUM - 1
+
+	uint16_t X;	// controller counts, 12 bits
+
+	uint16_t Y;
+
+	uint8_t Width;	// a nibble on old eKTF firmware
+
+	uint8_t Pressure;
+} ELAN_SIM_CONTACT, *PELAN_SIM_CONTACT;
+
+//
+// Simulated boot code. It answers the IAP handshake, programs the pages
+// it is sent into Flash and boots the firmware on the next reset once
+// every page has been written. Page acknowledgements can be made to fail.
+//
+
+typedef enum _ELAN_SIM_BOOT_STATE
+{
+	ElanSimBootRunning,	// firmware running
+	ElanSimBootCode,	// reset, waiting for the boot or an IAP command
+	ElanSimBootIap,	// IAP entered, waiting for the send ID byte
+	ElanSimBootPages	// programming, the first page clears the last one
+} ELAN_SIM_BOOT_STATE;
+
+typedef struct _ELAN_SIM_BOOT
+{
+	ELAN_SIM_BOOT_STATE State;
+
+	BOOLEAN Valid;	// every page of Flash has been programmed
+
+	BOOLEAN Cleared;	// the last page has been cleared
+
+	uint8_t* Flash;
+
+	ULONG PageCount;
+
+	ULONG NextPage;
+
+	ULONG Attempts;	// failed writes of NextPage
+
+	uint8_t Response[8];	// answer to the next read, a ROM read's is the longest
+
+	ULONG ResponseLength;
+
+	ULONG NakPage;	// page whose acknowledgement fails NakCount times
+
+	ULONG NakCount;
+
+	ULONG NakEvery;	// fail the first write of every Nth page, 0 never
+
+	ULONG Naks;
+
+	ULONG Transfers;
+
+	uint16_t Register;	// value the running firmware answers register reads with
+
+	ULONG Commands;	// register reads answered
+
+	uint16_t RemarkId;	// answered to a ROM read in boot code
+
+	ULONGLONG Time;	// simulated interrupt time, 100ns units
+
+	const char* Error;	// first protocol violation seen
+} ELAN_SIM_BOOT, *PELAN_SIM_BOOT;
+
+#define ELAN_SIM_I2C_HZ	400000
+
+//
+// Boot code version ElanSimBootInit leaves in the device, new enough to
+// report the remark ID, and the remark ID it reports
+//
+#define ELAN_SIM_BC_VERSION	0x0600
+#define ELAN_SIM_REMARK_ID	0x3c5a
+
+struct _ELAN_SIM_DEVICE;
+
+typedef VOID ELAN_SIM_REPORT_CALLBACK(
+	struct _ELAN_SIM_DEVICE* Sim,
+	const BYTE* Report,
+	ULONG Length
+);
+
+typedef struct _ELAN_SIM_DEVICE
+{
+	ELAN_CONTEXT Context;
+
+	ELAN_CHIP_OPS ChipOps;
+
+	ULONG Reports;	// delivered
+
+	ULONGLONG ReportHash;	// FNV-1a over every delivered report
+
+	ULONG DropEvery;	// fail every Nth report as if no read was pending, 0 never
+
+	ULONG Deliveries;
+
+	ELAN_SIM_REPORT_CALLBACK* OnReport;
+
+	PVOID OnReportContext;
+
+	ELAN_SIM_BOOT Boot;
+} ELAN_SIM_DEVICE, *PELAN_SIM_DEVICE;
+
+#define ELAN_SIM_HASH_SEED	0xcbf29ce484222325ULL
+
+//
+// Fills Config as ElanLoadConfig does for a device without a Settings key
+//
+VOID
+ElanSimDefaultConfig(
+	OUT PELAN_CONFIG Config
+);
+
+//
+// Derives Config->Flags from the values, as ElanLoadConfig does
+//
+VOID
+ElanSimConfigFlags(
+	IN OUT PELAN_CONFIG Config
+);
+
+//
+// Input files for the fuzz target and the differential harness start
+// with one byte of these options, followed by MAX_PACKET_SIZE byte frames
+// read one scan period apart (the last one may be short)
+//
+
+#define ELAN_SIM_OPT_CHIP_EKTF	0x01
+#define ELAN_SIM_OPT_NO_PRESSURE	0x02
+#define ELAN_SIM_OPT_PREDICT	0x04
+#define ELAN_SIM_OPT_NO_COALESCE	0x08
+#define ELAN_SIM_OPT_NO_JITTER	0x10
+#define ELAN_SIM_OPT_SWAP_XY	0x20
+#define ELAN_SIM_OPT_INVERT	0x40
+#define ELAN_SIM_OPT_DROP_REPORTS	0x80	// every third report finds no read pending
+
+#define ELAN_SIM_DROP_EVERY	3
+
+//
+// Creates a device configured from an options byte
+//
+PELAN_SIM_DEVICE
+ElanSimCreateWithOptions(
+	IN uint8_t Options,
+	IN BOOLEAN Reference
+);
+
+//
+// Creates a booted device. A NULL Config uses the defaults. Reference
+// selects the frozen reference decoder instead of the driver's.
+//
+PELAN_SIM_DEVICE
+ElanSimCreate(
+	IN UCHAR Chip,	// elants_chip_id
+	IN const ELAN_CONFIG* Config,
+	IN BOOLEAN Reference
+);
+
+VOID
+ElanSimDestroy(
+	IN PELAN_SIM_DEVICE Sim
+);
+
+//
+// Runs one frame read at Time (100ns units) through the frame decoder.
+// Frame holds up to MAX_PACKET_SIZE bytes, shorter frames are padded
+// with zeros as a short read would leave the buffer. Returns true when
+// the controller asked for a read ahead.
+//
+BOOLEAN
+ElanSimFrame(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const uint8_t* Frame,
+	IN size_t Length,
+	IN ULONGLONG Time
+);
+
+//
+// Builds a HEADER_REPORT_10_FINGER touch packet of PacketSize bytes
+// (PACKET_SIZE, or PACKET_SIZE_OLD for old eKTF firmware)
+//
+VOID
+ElanSimBuildPacket(
+	OUT uint8_t* Packet,
+	IN size_t PacketSize,
+	IN const ELAN_SIM_CONTACT* Contacts,
+	IN int Count
+);
+
+//
+// Builds a frame with the given queue header around Count packets of
+// PacketSize bytes each, returns its length
+//
+size_t
+ElanSimBuildFrame(
+	OUT uint8_t* Frame,	// MAX_PACKET_SIZE bytes
+	IN uint8_t Header,
+	IN const uint8_t* Packets,
+	IN int Count,
+	IN size_t PacketSize
+);
+
+//
+// Checks the decoder's contact bookkeeping, returns NULL when it is
+// consistent or a description of the first problem found
+//
+const char*
+ElanSimCheckContacts(
+	IN PELAN_SIM_DEVICE Sim
+);
+
+//
+// Checks a delivered touch report against the device geometry, returns
+// NULL when it is valid or a description of the first problem found
+//
+const char*
+ElanSimCheckReport(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const BYTE* Report,
+	IN ULONG Length
+);
+
+//
+// Delivers the running firmware's answer to a register read as the frame
+// read at Time. Returns false when no answer is pending.
+//
+BOOLEAN
+ElanSimCommandFrame(
+	IN PELAN_SIM_DEVICE Sim,
+	IN ULONGLONG Time
+);
+
+//
+// Gives the device PageCount pages of flash. With Valid the firmware is
+// running; without, the controller is stuck in boot code and the device
+// is left as BOOTTOUCHSCREEN leaves it in recovery mode. The boot code
+// reports ELAN_SIM_REMARK_ID, images built for it end with it.
+//
+BOOLEAN
+ElanSimBootInit(
+	IN PELAN_SIM_DEVICE Sim,
+	IN ULONG PageCount,
+	IN BOOLEAN Valid
+);
+
+//
+// Updates the firmware with the image at Path through ElanStartFwUpdate
+// and the update work item, in simulated time. Returns the status of
+// ElanStartFwUpdate; the outcome is in the device's FwUpdateStats.
+//
+NTSTATUS
+ElanSimFwUpdate(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const char* Path
+);
+
+//
+// Frozen reference decoder, see tools/reference
+//
+
+BOOLEAN
+ElanReferenceFrameEkth3500(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* buf
+);
+
+BOOLEAN
+ElanReferenceFrameEktf3624(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* buf
+);
+
+//
+// Pre-hardening baseline of the decoder for the benchmark gate, see
+// tools/reference. Only for well-formed frames.
+//
+
+BOOLEAN
+ElanBaselineFrameEkth3500(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* buf
+);
+
+BOOLEAN
+ElanBaselineFrameEktf3624(
+	IN PELAN_CONTEXT pDevice,
+	IN uint8_t* buf
+);
@@ -0,0 +1,208 @@
+/*++
+
+Module Name:
+
+elanstream.cpp
+
+Abstract:
+
+Time-stamped frame streams for the host tools, see elanstream.h
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "elanstream.h"
+
+static ULONGLONG ElanStreamGet(const uint8_t* Data, int Bytes) {
+	ULONGLONG value = 0;
+	for (int i = Bytes; i-- > 0;)
+		value = (value << 8) | Data[i];
+	return value;
+}
+
+static void ElanStreamPut(std::vector<uint8_t>* Data, ULONGLONG Value, int Bytes) {
+	for (int i = 0; i < Bytes; i++)
+		Data->push_back((uint8_t)(Value >> (8 * i)));
+}
+
+VOID
+ElanStreamAppend(
+	IN OUT PELAN_STREAM Stream,
+	IN ULONGLONG Time,
+	IN const uint8_t* Frame,
+	IN size_t Length
+)
+{
+	ELAN_STREAM_FRAME frame;
+
+	if (Length > MAX_PACKET_SIZE)
+		Length = MAX_PACKET_SIZE;
+
+	RtlZeroMemory(&frame, sizeof(frame));
+	frame.Time = Time;
+	frame.Length = (uint8_t)Length;
+	RtlCopyMemory(frame.Data, Frame, Length);
+	Stream->Frames.push_back(frame);
+}
+
+BOOLEAN
+ElanStreamIsStream(
+	IN const uint8_t* Data,
+	IN size_t Size
+)
+{
+	return Size >= ELAN_STREAM_HEADER_SIZE &&
+		memcmp(Data, ELAN_STREAM_MAGIC, 8) == 0;
+}
+
+BOOLEAN
+ElanStreamParse(
+	IN const uint8_t* Data,
+	IN size_t Size,
+	OUT PELAN_STREAM Stream
+)
+{
+	Stream->Options = 0;
+	Stream->Frames.clear();
+
+	if (!ElanStreamIsStream(Data, Size) ||
+		ElanStreamGet(&Data[8], 2) != ELAN_STREAM_VERSION || Data[11] != 0)
+		return false;
+
+	ULONG count = (ULONG)ElanStreamGet(&Data[12], 4);
+	size_t offset = ELAN_STREAM_HEADER_SIZE;
+
+	Stream->Options = Data[10];
+	for (ULONG n = 0; n < count; n++) {
+		if (Size - offset < ELAN_STREAM_FRAME_HEADER_SIZE)
+			return false;
+
+		ULONGLONG time = ElanStreamGet(&Data[offset], 8);
+		uint8_t length = Data[offset + 8];
+		offset += ELAN_STREAM_FRAME_HEADER_SIZE;
+
+		if (length == 0 || length > MAX_PACKET_SIZE || Size - offset < length)
+			return false;
+
+		ElanStreamAppend(Stream, time, &Data[offset], length);
+		offset += length;
+	}
+
+	return offset == Size;
+}
+
+VOID
+ElanStreamSerialize(
+	IN const ELAN_STREAM* Stream,
+	OUT std::vector<uint8_t>* Data
+)
+{
+	Data->clear();
+	Data->reserve(ELAN_STREAM_HEADER_SIZE +
+		Stream->Frames.size() * (ELAN_STREAM_FRAME_HEADER_SIZE + MAX_PACKET_SIZE));
+	Data->insert(Data->end(), ELAN_STREAM_MAGIC, ELAN_STREAM_MAGIC + 8);
+	ElanStreamPut(Data, ELAN_STREAM_VERSION, 2);
+	Data->push_back(Stream->Options);
+	Data->push_back(0);
+	ElanStreamPut(Data, Stream->Frames.size(), 4);
+
+	for (size_t n = 0; n < Stream->Frames.size(); n++) {
+		const ELAN_STREAM_FRAME* frame = &Stream->Frames[n];
+		ElanStreamPut(Data, frame->Time, 8);
+		Data->push_back(frame->Length);
+		Data->insert(Data->end(), frame->Data, frame->Data + frame->Length);
+	}
+}
+
+BOOLEAN
+ElanStreamLoad(
+	IN const char* Path,
+	OUT PELAN_STREAM Stream
+)
+{
+	FILE* file = fopen(Path, "rb");
+	if (!file)
+		return false;
+
+	std::vector<uint8_t> data;
+	uint8_t chunk[4096];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data.insert(data.end(), chunk, chunk + read);
+	fclose(file);
+
+	if (ElanStreamIsStream(data.data(), data.size()))
+		return ElanStreamParse(data.data(), data.size(), Stream);
+
+	ElanStreamFromInput(data.data(), data.size(), Stream);
+	return !data.empty();
+}
+
+BOOLEAN
+ElanStreamSave(
+	IN const char* Path,
+	IN const ELAN_STREAM* Stream
+)
+{
+	std::vector<uint8_t> data;
+	ElanStreamSerialize(Stream, &data);
+
+	FILE* file = fopen(Path, "wb");
+	if (!file)
+		return false;
+
+	BOOLEAN ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && ok;
+}
+
+VOID
+ElanStreamFromInput(
+	IN const uint8_t* Data,
+	IN size_t Size,
+	OUT PELAN_STREAM Stream
+)
+{
+	Stream->Options = Size ? Data[0] : 0;
+	Stream->Frames.clear();
+
+	ULONGLONG time = 0;
+	for (size_t offset = 1; offset < Size; offset += MAX_PACKET_SIZE) {
+		size_t length = Size - offset;
+		if (length > MAX_PACKET_SIZE)
+			length = MAX_PACKET_SIZE;
+
+		time += ELAN_SCAN_PERIOD_US * 10;
+		ElanStreamAppend(Stream, time, &Data[offset], length);
+	}
+}
+
+VOID
+ElanStreamToInput(
+	IN const ELAN_STREAM* Stream,
+	OUT std::vector<uint8_t>* Data
+)
+{
+	Data->assign(1, Stream->Options);
+	for (size_t n = 0; n < Stream->Frames.size(); n++) {
+		const ELAN_STREAM_FRAME* frame = &Stream->Frames[n];
+		Data->insert(Data->end(), frame->Data, frame->Data + MAX_PACKET_SIZE);
+	}
+}
+
+VOID
+ElanStreamReplay(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const ELAN_STREAM* Stream
+)
+{
+	for (size_t n = 0; n < Stream->Frames.size(); n++) {
+		const ELAN_STREAM_FRAME* frame = &Stream->Frames[n];
+		ElanSimFrame(Sim, frame->Data, frame->Length, frame->Time);
+	}
+}
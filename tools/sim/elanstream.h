@@ -0,0 +1,143 @@
+/*++
+
+Module Name:
+
+elanstream.h
+
+Abstract:
+
+Time-stamped frame streams for the host tools. A stream is what the
+interrupt handler reads from the controller: every frame with the
+interrupt time it was read at, read-ahead frames sharing the time of the
+frame that asked for them. Streams are written by the gesture generator
+and replayed through a simulated device by the benchmarks, the
+differential harness and the fuzz target.
+
+Stream files are little endian:
+
+  header, 16 bytes
+    0   "ELANSTRM"
+    8   uint16 version, ELAN_STREAM_VERSION
+    10  uint8 options, ELAN_SIM_OPT_* (chip and tuning profile)
+    11  uint8 reserved, zero
+    12  uint32 frame count
+
+  frame, 9 bytes plus the data
+    0   uint64 interrupt time, 100ns units from the start of the stream
+    8   uint8 length, 1 to MAX_PACKET_SIZE
+    9   the bytes read
+
+The simulator's input format (an options byte and MAX_PACKET_SIZE byte
+frames one scan period apart) converts to a stream without loss; a
+stream converts to it by dropping the times.
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#pragma once
+
+#include <vector>
+
+#include "elansim.h"
+
+#define ELAN_STREAM_MAGIC	"ELANSTRM"
+#define ELAN_STREAM_VERSION	1
+#define ELAN_STREAM_HEADER_SIZE	16
+#define ELAN_STREAM_FRAME_HEADER_SIZE	9
+
+typedef struct _ELAN_STREAM_FRAME
+{
+	ULONGLONG Time;	// 100ns units
+
+	uint8_t Length;
+
+	uint8_t Data[MAX_PACKET_SIZE];
+} ELAN_STREAM_FRAME, *PELAN_STREAM_FRAME;
+
+typedef struct _ELAN_STREAM
+{
+	uint8_t Options;	// ELAN_SIM_OPT_*
+
+	std::vector<ELAN_STREAM_FRAME> Frames;
+} ELAN_STREAM, *PELAN_STREAM;
+
+//
+// Appends a frame of Length bytes read at Time
+//
+VOID
+ElanStreamAppend(
+	IN OUT PELAN_STREAM Stream,
+	IN ULONGLONG Time,
+	IN const uint8_t* Frame,
+	IN size_t Length
+);
+
+//
+// True when Data starts with a stream file header
+//
+BOOLEAN
+ElanStreamIsStream(
+	IN const uint8_t* Data,
+	IN size_t Size
+);
+
+//
+// Parses a stream file, returns false when it is malformed
+//
+BOOLEAN
+ElanStreamParse(
+	IN const uint8_t* Data,
+	IN size_t Size,
+	OUT PELAN_STREAM Stream
+);
+
+VOID
+ElanStreamSerialize(
+	IN const ELAN_STREAM* Stream,
+	OUT std::vector<uint8_t>* Data
+);
+
+//
+// Reads a stream file or, when the file is not one, the simulator's
+// input format. Returns false when the file cannot be read or parsed.
+//
+BOOLEAN
+ElanStreamLoad(
+	IN const char* Path,
+	OUT PELAN_STREAM Stream
+);
+
+BOOLEAN
+ElanStreamSave(
+	IN const char* Path,
+	IN const ELAN_STREAM* Stream
+);
+
+//
+// Converts between a stream and the simulator's input format
+//
+VOID
+ElanStreamFromInput(
+	IN const uint8_t* Data,
+	IN size_t Size,
+	OUT PELAN_STREAM Stream
+);
+
+VOID
+ElanStreamToInput(
+	IN const ELAN_STREAM* Stream,
+	OUT std::vector<uint8_t>* Data
+);
+
+//
+// Replays every frame of the stream at its time through a device created
+// with ElanSimCreateWithOptions(Stream->Options, ...)
+//
+VOID
+ElanStreamReplay(
+	IN PELAN_SIM_DEVICE Sim,
+	IN const ELAN_STREAM* Stream
+);
@@ -0,0 +1,511 @@
+/*++
+
+Module Name:
+
+decode_trace.cpp
+
+Abstract:
+
+Offline decoder for the driver's trace ring. Takes either successive
+trace feature reports (REPORTID_TRACE, sizeof(ElanTraceReport) bytes
+each, as read back to back from the device) or a raw copy of the ring
+(the context's TraceRing, ELAN_TRACE_RECORD entries, as written from a
+debugger), drops torn and repeated records, and prints the records in
+sequence order with their events and arguments decoded from hidcommon.h.
+Gaps in the sequence, records overwritten before they were read, are
+shown.
+
+-replay runs a stream or input file through a simulated device instead
+and decodes its ring; -dump-ring and -dump-reports write that ring in
+the two dump formats.
+
+Usage: decode_trace [-ring|-reports] [-absolute] [-summary] file...
+       decode_trace -replay=file [-dump-ring=path] [-dump-reports=path]
+                    [-absolute] [-summary]
+
+Environment:
+
+User mode, host tools only
+
+--*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "elanstream.h"
+
+C_ASSERT(sizeof(ELAN_TRACE_RECORD) == 32);
+
+typedef std::map<ULONG, ELAN_TRACE_RECORD> TraceRecords;
+
+struct TraceNames
+{
+	ULONG Value;
+
+	const char* Name;
+};
+
+static const TraceNames TraceEvents[] = {
+	{ TRACE_EVENT_ISR, "ISR" },
+	{ TRACE_EVENT_SPB_WRITE, "SPB_WRITE" },
+	{ TRACE_EVENT_SPB_READ, "SPB_READ" },
+	{ TRACE_EVENT_BOOT, "BOOT" },
+	{ TRACE_EVENT_IOCTL, "IOCTL" },
+	{ TRACE_EVENT_BAD_FRAME, "BAD_FRAME" },
+	{ TRACE_EVENT_REPORT, "REPORT" },
+	{ TRACE_EVENT_HEALTH, "HEALTH" },
+	{ TRACE_EVENT_POLL, "POLL" },
+	{ TRACE_EVENT_POWER, "POWER" },
+};
+
+static const TraceNames TraceBootStages[] = {
+	{ TRACE_BOOT_HELLO, "hello" },
+	{ TRACE_BOOT_QUERY, "query" },
+	{ TRACE_BOOT_GEOMETRY, "geometry" },
+	{ TRACE_BOOT_DONE, "done" },
+	{ TRACE_BOOT_FW_ID, "firmware ID" },
+	{ TRACE_BOOT_VERSION, "version" },
+};
+
+static const TraceNames TraceFrameReasons[] = {
+	{ TRACE_FRAME_CHECKSUM, "checksum" },
+	{ TRACE_FRAME_PACKET_TYPE, "packet type" },
+	{ TRACE_FRAME_WAIT, "wait packet" },
+	{ TRACE_FRAME_COUNT, "report count" },
+	{ TRACE_FRAME_LENGTH, "length" },
+	{ TRACE_FRAME_HEADER, "frame header" },
+	{ TRACE_FRAME_NO_DATA, "no data" },
+};
+
+static const TraceNames TraceHealthActions[] = {
+	{ TRACE_HEALTH_RATE_LIMIT, "rate limit" },
+	{ TRACE_HEALTH_RESET, "reset" },
+};
+
+static const TraceNames TracePowerStates[] = {	// WDF_POWER_DEVICE_STATE
+	{ 1, "D0" },
+	{ 2, "D1" },
+	{ 3, "D2" },
+	{ 4, "D3" },
+	{ 5, "D3 final" },
+	{ 6, "hibernation" },
+};
+
+static const TraceNames TraceIoctls[] = {
+	{ IOCTL_HID_GET_DEVICE_DESCRIPTOR, "IOCTL_HID_GET_DEVICE_DESCRIPTOR" },
+	{ IOCTL_HID_GET_REPORT_DESCRIPTOR, "IOCTL_HID_GET_REPORT_DESCRIPTOR" },
+	{ IOCTL_HID_READ_REPORT, "IOCTL_HID_READ_REPORT" },
+	{ IOCTL_HID_GET_DEVICE_ATTRIBUTES, "IOCTL_HID_GET_DEVICE_ATTRIBUTES" },
+	{ IOCTL_HID_WRITE_REPORT, "IOCTL_HID_WRITE_REPORT" },
+	{ IOCTL_HID_SET_FEATURE, "IOCTL_HID_SET_FEATURE" },
+	{ IOCTL_HID_GET_FEATURE, "IOCTL_HID_GET_FEATURE" },
+	{ IOCTL_HID_GET_STRING, "IOCTL_HID_GET_STRING" },
+	{ IOCTL_HID_ACTIVATE_DEVICE, "IOCTL_HID_ACTIVATE_DEVICE" },
+	{ IOCTL_HID_DEACTIVATE_DEVICE, "IOCTL_HID_DEACTIVATE_DEVICE" },
+	{ IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST, "IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST" },
+	{ IOCTL_HID_SET_OUTPUT_REPORT, "IOCTL_HID_SET_OUTPUT_REPORT" },
+	{ IOCTL_HID_GET_INPUT_REPORT, "IOCTL_HID_GET_INPUT_REPORT" },
+};
+
+#define TRACE_STATUS(status)	{ (ULONG)status, #status }
+
+static const TraceNames TraceStatuses[] = {
+	TRACE_STATUS(STATUS_SUCCESS),
+	TRACE_STATUS(STATUS_PENDING),
+	TRACE_STATUS(STATUS_UNSUCCESSFUL),
+	TRACE_STATUS(STATUS_NOT_IMPLEMENTED),
+	TRACE_STATUS(STATUS_INVALID_PARAMETER),
+	TRACE_STATUS(STATUS_NO_MORE_ENTRIES),
+	TRACE_STATUS(STATUS_BUFFER_OVERFLOW),
+	TRACE_STATUS(STATUS_BUFFER_TOO_SMALL),
+	TRACE_STATUS(STATUS_INVALID_DEVICE_REQUEST),
+	TRACE_STATUS(STATUS_INVALID_BUFFER_SIZE),
+	TRACE_STATUS(STATUS_DEVICE_NOT_READY),
+	TRACE_STATUS(STATUS_DEVICE_BUSY),
+	TRACE_STATUS(STATUS_DEVICE_DATA_ERROR),
+	TRACE_STATUS(STATUS_IO_TIMEOUT),
+	TRACE_STATUS(STATUS_CANCELLED),
+	TRACE_STATUS(STATUS_DATA_ERROR),
+	TRACE_STATUS(STATUS_INSUFFICIENT_RESOURCES),
+	TRACE_STATUS(STATUS_END_OF_FILE),
+	TRACE_STATUS(STATUS_INVALID_IMAGE_FORMAT),
+	TRACE_STATUS(STATUS_NOT_SUPPORTED),
+	TRACE_STATUS(STATUS_INVALID_DEVICE_STATE),
+	TRACE_STATUS(STATUS_NO_CALLBACK_ACTIVE),
+	TRACE_STATUS(STATUS_NOT_FOUND),
+};
+
+static std::string TraceName(const TraceNames* names, size_t count, ULONG value) {
+	for (size_t i = 0; i < count; i++) {
+		if (names[i].Value == value)
+			return names[i].Name;
+	}
+
+	char text[16];
+	snprintf(text, sizeof(text), "0x%x", value);
+	return text;
+}
+
+#define TRACE_NAME(names, value)	TraceName(names, ARRAYSIZE(names), value)
+
+static std::string TraceStatus(ULONG status) {
+	std::string name = TRACE_NAME(TraceStatuses, status);
+	if (name.compare(0, 2, "0x") == 0) {
+		char text[16];
+		snprintf(text, sizeof(text), "0x%08x", status);
+		return text;
+	}
+	return name;
+}
+
+//
+// The leading bytes of a transfer, as ElanTraceBytes packed them
+//
+static std::string TraceBytes(ULONG bytes, ULONG length) {
+	std::string text;
+	for (ULONG i = 0; i < length && i < sizeof(bytes); i++) {
+		char byte[4];
+		snprintf(byte, sizeof(byte), "%s%02x", i ? " " : "", (bytes >> (i * 8)) & 0xff);
+		text += byte;
+	}
+	return text;
+}
+
+static std::string TraceFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+static std::string TraceFormat(const char* format, ...) {
+	char text[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	return text;
+}
+
+static std::string TraceDescribe(const ELAN_TRACE_RECORD* record) {
+	const ULONG* a = record->Args;
+
+	switch (record->EventId) {
+	case TRACE_EVENT_ISR:
+		return TraceFormat("claimed %u, low power %u, polling %u", a[0], a[1], a[2]);
+	case TRACE_EVENT_SPB_WRITE:
+	case TRACE_EVENT_SPB_READ:
+		return TraceFormat("%u bytes, %s%s%s", a[0], TraceStatus(a[1]).c_str(),
+			a[0] ? ", " : "", TraceBytes(a[2], a[0]).c_str());
+	case TRACE_EVENT_BOOT:
+	{
+		std::string text = TRACE_NAME(TraceBootStages, a[0]) + ", " + TraceStatus(a[1]);
+		switch (a[0]) {
+		case TRACE_BOOT_HELLO:
+			return text + TraceFormat(", %s, retry %u", TraceBytes(a[2], 4).c_str(), a[3]);
+		case TRACE_BOOT_QUERY:
+			return text + TraceFormat(", %u rows, %u columns, osr %u", a[2] >> 16, a[2] & 0xffff, a[3]);
+		case TRACE_BOOT_GEOMETRY:
+			return text + TraceFormat(", max %u x %u, physical %u x %u",
+				a[2] >> 16, a[2] & 0xffff, a[3] >> 16, a[3] & 0xffff);
+		case TRACE_BOOT_FW_ID:
+			return text + TraceFormat(", firmware ID 0x%04x", a[2]);
+		case TRACE_BOOT_VERSION:
+			return text + TraceFormat(", firmware 0x%04x, test 0x%02x, boot code 0x%04x",
+				a[2], a[3] >> 16, a[3] & 0xffff);
+		default:
+			return text;
+		}
+	}
+	case TRACE_EVENT_IOCTL:
+		return TraceFormat("%s, %s%s", TRACE_NAME(TraceIoctls, a[0]).c_str(),
+			TraceStatus(a[1]).c_str(), a[2] ? "" : ", pending");
+	case TRACE_EVENT_BAD_FRAME:
+		return TraceFormat("%s, %s", TRACE_NAME(TraceFrameReasons, a[0]).c_str(),
+			TraceBytes(a[1], HEADER_SIZE).c_str());
+	case TRACE_EVENT_REPORT:
+		return TraceFormat("%u contacts, %s", a[0], TraceStatus(a[1]).c_str());
+	case TRACE_EVENT_HEALTH:
+		return TraceFormat("%u strikes, %s, %s", a[0], TRACE_NAME(TraceHealthActions, a[1]).c_str(),
+			TraceStatus(a[2]).c_str());
+	case TRACE_EVENT_POLL:
+		return TraceFormat("%s, period %u us", a[0] ? "started" : "stopped", a[1]);
+	case TRACE_EVENT_POWER:
+		return TraceFormat("%s, %s, from %s", a[0] ? "entering D0" : "leaving D0",
+			TraceStatus(a[1]).c_str(), TRACE_NAME(TracePowerStates, a[2]).c_str());
+	default:
+		return TraceFormat("%08x %08x %08x %08x", a[0], a[1], a[2], a[3]);
+	}
+}
+
+//
+// Dump formats
+//
+
+static bool TraceReadFile(const std::string& path, std::vector<uint8_t>* data) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	uint8_t chunk[4096];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data->insert(data->end(), chunk, chunk + read);
+
+	fclose(file);
+	return true;
+}
+
+static bool TraceIsReports(const std::vector<uint8_t>& data) {
+	return !data.empty() && data.size() % sizeof(ElanTraceReport) == 0 &&
+		data[0] == REPORTID_TRACE;
+}
+
+//
+// Records a later report repeats, after the reader rewound, are dropped
+//
+static void TraceAdd(TraceRecords* records, const ELAN_TRACE_RECORD* record) {
+	if (record->Sequence != 0)
+		records->insert(std::make_pair(record->Sequence, *record));
+}
+
+static bool TraceParseReports(const std::vector<uint8_t>& data, TraceRecords* records, ULONG* capacity) {
+	for (size_t offset = 0; offset < data.size(); offset += sizeof(ElanTraceReport)) {
+		ElanTraceReport report;
+		memcpy(&report, &data[offset], sizeof(report));
+
+		if (report.ReportID != REPORTID_TRACE || report.Count > TRACE_REPORT_RECORDS) {
+			fprintf(stderr, "not a trace report at offset %zu\n", offset);
+			return false;
+		}
+
+		*capacity = report.Capacity;
+		for (int n = 0; n < report.Count; n++)
+			TraceAdd(records, &report.Records[n]);
+	}
+	return true;
+}
+
+//
+// A ring slot holds the record whose sequence maps to it; anything else,
+// including the zero sequence of a record being written, is torn
+//
+static bool TraceParseRing(const std::vector<uint8_t>& data, TraceRecords* records, ULONG* capacity,
+	ULONG* torn) {
+	size_t entries = data.size() / sizeof(ELAN_TRACE_RECORD);
+	if (!entries || data.size() % sizeof(ELAN_TRACE_RECORD)) {
+		fprintf(stderr, "a ring dump is a whole number of %zu byte records\n", sizeof(ELAN_TRACE_RECORD));
+		return false;
+	}
+
+	*capacity = (ULONG)entries;
+	for (size_t i = 0; i < entries; i++) {
+		ELAN_TRACE_RECORD record;
+		memcpy(&record, &data[i * sizeof(record)], sizeof(record));
+
+		if (record.Sequence == 0)
+			continue;
+		if ((record.Sequence - 1) % entries != i) {
+			(*torn)++;
+			continue;
+		}
+		TraceAdd(records, &record);
+	}
+	return true;
+}
+
+//
+// A simulated device's ring, and the two dump formats of it
+//
+
+static bool TraceReplay(const std::string& path, ELAN_TRACE_RECORD* ring, ULONG* head) {
+	ELAN_STREAM stream;
+	if (!ElanStreamLoad(path.c_str(), &stream)) {
+		fprintf(stderr, "cannot read %s\n", path.c_str());
+		return false;
+	}
+
+	PELAN_SIM_DEVICE sim = ElanSimCreateWithOptions(stream.Options, false);
+	if (!sim) {
+		fprintf(stderr, "out of memory\n");
+		return false;
+	}
+
+	ElanStreamReplay(sim, &stream);
+	memcpy(ring, sim->Context.TraceRing, sizeof(sim->Context.TraceRing));
+	*head = (ULONG)sim->Context.TraceHead;
+	ElanSimDestroy(sim);
+	return true;
+}
+
+static bool TraceWrite(const std::string& path, const void* data, size_t size) {
+	FILE* file = fopen(path.c_str(), "wb");
+	bool ok = file && fwrite(data, 1, size, file) == size;
+	if (file)
+		ok = fclose(file) == 0 && ok;
+	if (!ok)
+		fprintf(stderr, "cannot write %s\n", path.c_str());
+	return ok;
+}
+
+//
+// Reads the ring as successive gets of the trace feature report do, from
+// the oldest record held
+//
+static std::vector<uint8_t> TraceReports(const ELAN_TRACE_RECORD* ring, ULONG head) {
+	std::vector<uint8_t> data;
+	ULONG cursor = head > ELAN_TRACE_ENTRIES ? head - ELAN_TRACE_ENTRIES + 1 : 1;
+
+	do {
+		ElanTraceReport report;
+		memset(&report, 0, sizeof(report));
+		report.ReportID = REPORTID_TRACE;
+		report.Capacity = ELAN_TRACE_ENTRIES;
+		report.Head = head;
+
+		for (; report.Count < TRACE_REPORT_RECORDS && cursor <= head; cursor++)
+			report.Records[report.Count++] = ring[(cursor - 1) & (ELAN_TRACE_ENTRIES - 1)];
+
+		report.Cursor = cursor;
+		data.insert(data.end(), (uint8_t*)&report, (uint8_t*)&report + sizeof(report));
+	} while (cursor <= head);
+
+	return data;
+}
+
+//
+// Output
+//
+
+static void TracePrint(const TraceRecords& records, bool absolute) {
+	ULONGLONG start = records.begin()->second.Timestamp;
+	ULONG expected = records.begin()->first;
+
+	for (TraceRecords::const_iterator it = records.begin(); it != records.end(); ++it) {
+		const ELAN_TRACE_RECORD* record = &it->second;
+
+		if (record->Sequence != expected)
+			printf("           -- %u records lost --\n", record->Sequence - expected);
+		expected = record->Sequence + 1;
+
+		double ms = absolute ? record->Timestamp / 1e4 : (LONGLONG)(record->Timestamp - start) / 1e4;
+		printf("%10u %14.4f ms  %-10s %s\n", record->Sequence, ms,
+			TRACE_NAME(TraceEvents, record->EventId).c_str(), TraceDescribe(record).c_str());
+	}
+}
+
+static void TraceSummary(const TraceRecords& records) {
+	std::map<std::string, ULONG> events;
+	std::map<std::string, ULONG> badFrames;
+	ULONG failedTransfers = 0;
+
+	for (TraceRecords::const_iterator it = records.begin(); it != records.end(); ++it) {
+		const ELAN_TRACE_RECORD* record = &it->second;
+
+		events[TRACE_NAME(TraceEvents, record->EventId)]++;
+		if (record->EventId == TRACE_EVENT_BAD_FRAME)
+			badFrames[TRACE_NAME(TraceFrameReasons, record->Args[0])]++;
+		if ((record->EventId == TRACE_EVENT_SPB_READ || record->EventId == TRACE_EVENT_SPB_WRITE) &&
+			!NT_SUCCESS((NTSTATUS)record->Args[1]))
+			failedTransfers++;
+	}
+
+	double span = (LONGLONG)(records.rbegin()->second.Timestamp - records.begin()->second.Timestamp) / 1e7;
+	printf("\n%zu records over %.3f s\n", records.size(), span);
+	for (std::map<std::string, ULONG>::const_iterator it = events.begin(); it != events.end(); ++it)
+		printf("  %-10s %8u\n", it->first.c_str(), it->second);
+	for (std::map<std::string, ULONG>::const_iterator it = badFrames.begin(); it != badFrames.end(); ++it)
+		printf("  bad frames, %s: %u\n", it->first.c_str(), it->second);
+	if (failedTransfers)
+		printf("  failed SPB transfers: %u\n", failedTransfers);
+}
+
+int main(int argc, char** argv) {
+	enum { TraceAuto, TraceRing, TraceReportDump } format = TraceAuto;
+	bool absolute = false, summary = false;
+	std::string replay, dumpRing, dumpReports;
+	std::vector<std::string> paths;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-ring")
+			format = TraceRing;
+		else if (arg == "-reports")
+			format = TraceReportDump;
+		else if (arg == "-absolute")
+			absolute = true;
+		else if (arg == "-summary")
+			summary = true;
+		else if (arg.compare(0, 8, "-replay=") == 0)
+			replay = arg.substr(8);
+		else if (arg.compare(0, 11, "-dump-ring=") == 0)
+			dumpRing = arg.substr(11);
+		else if (arg.compare(0, 14, "-dump-reports=") == 0)
+			dumpReports = arg.substr(14);
+		else if (arg[0] != '-')
+			paths.push_back(arg);
+		else
+			usage = true;
+	}
+
+	if (usage || paths.empty() == replay.empty()) {
+		fprintf(stderr,
+			"usage: %s [-ring|-reports] [-absolute] [-summary] file...\n"
+			"       %s -replay=file [-dump-ring=path] [-dump-reports=path] [-absolute] [-summary]\n",
+			argv[0], argv[0]);
+		return 2;
+	}
+
+	TraceRecords records;
+	ULONG capacity = 0, torn = 0;
+
+	if (!replay.empty()) {
+		static ELAN_TRACE_RECORD ring[ELAN_TRACE_ENTRIES];
+		ULONG head;
+
+		if (!TraceReplay(replay, ring, &head))
+			return 1;
+		if (!dumpRing.empty() && !TraceWrite(dumpRing, ring, sizeof(ring)))
+			return 1;
+		if (!dumpReports.empty()) {
+			std::vector<uint8_t> reports = TraceReports(ring, head);
+			if (!TraceWrite(dumpReports, reports.data(), reports.size()))
+				return 1;
+		}
+
+		std::vector<uint8_t> data((uint8_t*)ring, (uint8_t*)ring + sizeof(ring));
+		TraceParseRing(data, &records, &capacity, &torn);
+	}
+
+	for (size_t i = 0; i < paths.size(); i++) {
+		std::vector<uint8_t> data;
+		if (!TraceReadFile(paths[i], &data)) {
+			fprintf(stderr, "cannot read %s\n", paths[i].c_str());
+			return 2;
+		}
+
+		bool reports = format == TraceReportDump || (format == TraceAuto && TraceIsReports(data));
+		if (reports ? !TraceParseReports(data, &records, &capacity) :
+			!TraceParseRing(data, &records, &capacity, &torn))
+			return 1;
+	}
+
+	if (records.empty()) {
+		printf("no records\n");
+		return 0;
+	}
+
+	ULONG first = records.begin()->first;
+	printf("ring of %u records, sequence %u to %u", capacity, first, records.rbegin()->first);
+	if (first > 1)
+		printf(", %u older records overwritten", first - 1);
+	if (torn)
+		printf(", %u torn records dropped", torn);
+	printf("\n");
+
+	TracePrint(records, absolute);
+	if (summary)
+		TraceSummary(records);
+	return 0;
+}